@@ -14,10 +14,15 @@
 //#define SITE_FILES_PATH "/home/brett/projects/cpp/crowsite/crow_test"
 #define CROWSITE_FILES_PATH "/home/brett/Documents/code/c++/crowsite/crow_test"
 #define CROWSITE_STATIC_ENDPOINT "/static/<path>"
+// static files are served by cs::StaticCache instead of crow's own static route
+#define CROW_DISABLE_STATIC_DIR
 
 #define MILES_SITE
 #undef MILES_SITE
 
+// issue HMAC signed session tokens which are validated without a database lookup
+#define CROWSITE_SIGNED_TOKENS
+
 #define SITE_NAME "CrowTest"
 #define SITE_TITLE "Miles and Brett Super Site"
 #define SITE_VERSION "0.0.1"
@@ -25,6 +25,7 @@
 #include "crow/websocket.h"
 #include "crow/parser.h"
 #include "crow/http_response.h"
+#include "crow/task.h"
 #include "crow/multipart.h"
 #include "crow/routing.h"
 #include "crow/middleware.h"
@@ -36,7 +37,7 @@
 #include "crow/middlewares/session.h"
 #include "crow/middlewares/cookie_parser.h"
 
-using Session = crow::SessionMiddleware<crow::FileStore>;
+using Session = crow::SessionMiddleware<crow::LogStore>;
 using CrowApp = crow::App<crow::CookieParser, Session>;
 
 
@@ -6,7 +6,10 @@
 #define CROWSITE_CURL_H
 
 #include <string>
+#include <memory>
+#include <coroutine>
 #include <curl/curl.h>
+#include <crowsite/crow_pch.h>
 
 namespace cs
 {
@@ -16,6 +19,14 @@ namespace cs
         void init();
         
         void cleanup();
+        
+        struct response
+        {
+            long status = 0;
+            std::string body;
+            // set when the transfer itself failed (dns, connection, timeout), status is 0 then
+            bool failed = false;
+        };
     }
     
     class request
@@ -44,6 +55,55 @@ namespace cs
             ~request();
     };
     
+    /**
+     * A request sent through the shared curl multi handle, so waiting on the remote server doesn't hold a thread.
+     * co_await the result of get(...) or post(...) from a coroutine, it continues on the given io_service once the response arrived:
+     *
+     *  cs::async_request request(*req.io_service);
+     *  request.setContentHeaderJson();
+     *  auto response = co_await request.post(url, data);
+     *
+     * The request has to stay alive until it's been awaited, which is given when it lives in the coroutine.
+     */
+    class async_request
+    {
+        public:
+            // the transfer's state, shared with the thread driving the multi handle
+            struct transfer;
+        private:
+            std::unique_ptr<transfer> m_Transfer;
+        public:
+            explicit async_request(asio::io_service& service);
+            
+            async_request(const async_request&) = delete;
+            async_request& operator=(const async_request&) = delete;
+            
+            void setContentHeaderJson();
+            void setContentHeaderXForm();
+            void setContentHeader(const std::string& header);
+            void setAuthHeader(const std::string& header);
+            
+            struct awaiter
+            {
+                transfer* m_Transfer;
+                
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+                
+                bool await_suspend(std::coroutine_handle<> handle);
+                
+                requests::response await_resume();
+            };
+            
+            awaiter get(const std::string& url);
+            
+            awaiter post(const std::string& url, std::string data);
+            
+            ~async_request();
+    };
+    
 }
 
 #endif //CROWSITE_CURL_H
@@ -7,6 +7,7 @@
 
 #include <string_view>
 #include <string>
+#include <crowsite/crow_pch.h>
 
 namespace cs::jellyfin
 {
@@ -34,7 +35,10 @@ namespace cs::jellyfin
     void setToken(std::string_view token);
     
     void processUserData();
-    const client_data& getUserData(const std::string& username);
+    /**
+     * @return a copy of the user's data, default constructed if the user isn't known
+     */
+    client_data getUserData(const std::string& username);
     
     std::string generateAuthHeader();
     std::string getUserData();
@@ -42,6 +46,11 @@ namespace cs::jellyfin
     bool hasUser(std::string_view username);
     auth_response authenticateUser(std::string_view username, std::string_view password);
     
+    /**
+     * Same as authenticateUser(...) but waits on jellyfin without holding a thread, continues on the given io_service.
+     */
+    crow::task<auth_response> authenticateUserAsync(asio::io_service& service, std::string username, std::string password);
+    
 }
 
 #endif //CROWSITE_JELLYFIN_H
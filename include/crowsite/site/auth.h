@@ -6,7 +6,9 @@
 #define CROWSITE_AUTH_H
 
 #include "crowsite/utility.h"
+#include <crowsite/crow_pch.h>
 #include <string>
+#include <optional>
 
 namespace cs {
     
@@ -21,9 +23,31 @@ namespace cs {
     
     constexpr uint32_t PERM_DEFAULT = PERM_READ_FILES | PERM_CREATE_COMMENTS;
     
+    // how long a signed token is trusted before the session table has to be consulted again
+    constexpr int64_t signed_token_age = 60 * 60;
+    // how often the token signing key is rotated, and how many old keys are still accepted
+    constexpr int64_t token_key_age = 7 * 24 * 60 * 60;
+    constexpr size_t token_key_count = 3;
+    
+    // sessions which haven't been seen in this long are removed by the sweeper
+    constexpr int64_t user_session_age = 180 * 24 * 60 * 60;
+    // last_seen / expires_at are only rewritten when they are older than this, keeps lookups from turning into writes
+    constexpr int64_t user_session_touch_interval = 5 * 60;
+    // how often the sweeper wakes up, and how many rows it deletes per transaction
+    constexpr int64_t user_session_sweep_interval = 60;
+    constexpr int64_t user_session_sweep_batch = 256;
+    
     namespace auth {
         void init();
         void cleanup();
+        
+        /**
+         * Deletes expired user sessions in batches of user_session_sweep_batch and revocations older than signed_token_age,
+         * then returns freed pages to the filesystem.
+         * Called periodically by the background sweeper started in init()
+         * @return number of sessions deleted
+         */
+        int64_t sweepExpiredSessions();
     }
     
     struct cookie_data {
@@ -31,6 +55,18 @@ namespace cs {
         std::string clientToken;
     };
     
+    struct token_data {
+        std::string clientID;
+        std::string username;
+        uint32_t perms;
+        // milliseconds since epoch, used to compare against revocations
+        int64_t issued;
+        // seconds since epoch
+        int64_t expires;
+        // identifies the login the token was issued for, see createSignedUserToken(...)
+        std::string session;
+    };
+    
     /**
      *  An interface function which is used to validate login information provided as post data. Is is up to the caller
      *  to inform the user of the clientID and clientToken, along with the auth system of these values.
@@ -43,6 +79,12 @@ namespace cs {
      */
     bool checkUserAuthorization(cs::parser::Post& postData);
     
+    /**
+     * Same as checkUserAuthorization(...) without blocking the calling thread while jellyfin answers.
+     * postData has to outlive the returned task, the coroutine continues on the given io_service.
+     */
+    crow::task<bool> checkUserAuthorizationAsync(asio::io_service& service, cs::parser::Post& postData);
+    
     /**
      * Generates a clientID (UUIDv5 based on user-agent and username) along with a unique high security (512 bit) base64 encoded token string
      * @param postData post data including a "username"
@@ -63,7 +105,44 @@ namespace cs {
      */
     bool storeUserData(const std::string& username, const std::string& useragent, const cookie_data& tokens);
     
-    bool isUserLoggedIn(const std::string& clientID, const std::string& token);
+    /**
+     * Creates a stateless token of the form "v2.keyID.payload.mac" where mac is an HMAC-SHA256 over (clientID, username, perms, issued, expires, session)
+     * using the newest server key. Such tokens can be validated without touching the users database.
+     * Should only be called after storeUserData(...) has succeeded as the permissions are read from the database.
+     * @param clientID clientID the token is bound to
+     * @param username username of the user.
+     * @param sessionToken the clientToken stored for this login. A hash of it is signed into the token so an expired token
+     * is only refreshed while that login is still the current one.
+     * @return signed token to be used in place of the clientToken
+     */
+    std::string createSignedUserToken(const std::string& clientID, const std::string& username, const std::string& sessionToken);
+    
+    /**
+     * Checks the signature of a token created by createSignedUserToken(...). Expiry and revocation are NOT checked.
+     * @return the decoded token if the token was signed by one of the active server keys
+     */
+    std::optional<token_data> verifySignedUserToken(const std::string& token);
+    
+    /**
+     * @return true if the token is in the signed token format, it may still be invalid!
+     */
+    bool isSignedToken(const std::string& token);
+    
+    /**
+     * @return the decoded token if it is signed, bound to clientID, not revoked and not expired. Does not hit the database.
+     */
+    std::optional<token_data> getSignedUserData(const std::string& clientID, const std::string& token);
+    
+    /**
+     * Removes the clientID's session from the database and revokes every signed token issued to it up until now.
+     */
+    void revokeUserSession(const std::string& clientID);
+    
+    /**
+     * @param refreshed if not null and token is an expired signed token that is still backed by a session, receives a newly signed token
+     * which should replace it. Left untouched otherwise.
+     */
+    bool isUserLoggedIn(const std::string& clientID, const std::string& token, std::string* refreshed = nullptr);
     
     std::string getUserFromID(const std::string& clientID);
     bool isUserAdmin(const std::string& username);
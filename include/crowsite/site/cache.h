@@ -6,8 +6,11 @@
 #define CROWSITE_CACHE_H
 
 #include <crowsite/site/web.h>
+#include <crowsite/site/static_cache.h>
 #include <crowsite/util/crow_typedef.h>
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <blt/std/hashmap.h>
 
 namespace cs
@@ -45,17 +48,28 @@ namespace cs
     class CacheEngine
     {
         private:
+            struct StaticReference
+            {
+                std::string path;
+                std::string fingerprint;
+            };
+            
             struct CacheValue
             {
                 int64_t cacheTime;
                 std::filesystem::file_time_type lastModified;
                 std::unique_ptr<HTMLPage> page;
-                std::string renderedPage;
+                // shared with the requests still resolving it, a reload replaces it instead of changing it
+                std::shared_ptr<const std::string> renderedPage;
+                // static files linked by the page, it has to be rebuilt once any of their fingerprints change
+                std::vector<StaticReference> staticReferences;
             };
             
             context& m_Context;
+            StaticCache& m_StaticCache;
             CacheSettings m_Settings;
             HASHMAP<std::string, CacheValue> m_Pages;
+            std::mutex m_PagesMutex;
             
             static uint64_t calculateMemoryUsage(const std::string& path, const CacheValue& value);
             
@@ -64,20 +78,38 @@ namespace cs
              */
             uint64_t calculateMemoryUsage();
             
-            void resolveLinks(const std::string& file, HTMLPage& page);
+            void resolveLinks(const std::string& file, HTMLPage& page, std::vector<StaticReference>& staticReferences);
+            
+            /**
+             * Rewrites every link to a static file into its fingerprinted form so it can be cached by browsers forever.
+             */
+            void fingerprintStaticLinks(std::string& site, std::vector<StaticReference>& staticReferences);
+            
+            bool isOutdated(const std::string& path, const CacheValue& value);
             
             void loadPage(const std::string& path);
             
+            /**
+             * fetch() without taking the lock, loading a page fetches the pages it links while already holding it.
+             */
+            std::shared_ptr<const std::string> fetchPage(const std::string& path);
+            
             /**
              * Prunes the cache starting with the oldest pages we have loaded. (in bytes)
              */
             void prune(uint64_t amount);
         
         public:
-            explicit CacheEngine(context& context, const CacheSettings& settings = {});
+            CacheEngine(context& context, StaticCache& staticCache, const CacheSettings& settings = {});
             
-            const std::string& fetch(const std::string& path);
+            /**
+             * The cached page, it stays valid for as long as it is held even if the page is reloaded meanwhile.
+             */
+            std::shared_ptr<const std::string> fetch(const std::string& path);
             
+            /**
+             * The page with its logical blocks resolved against the context. Built on the heap, so it can be moved into a mustache template.
+             */
             std::string fetch(const std::string& path, const context& context);
     };
     
@@ -13,7 +13,10 @@
 namespace cs
 {
  
-    crow::response handle_login_request(const crow::request& req, CrowApp& app);
+    /**
+     * Coroutine, the jellyfin request is awaited on the request's io_service and the database writes run on the blocking workers.
+     */
+    crow::task<crow::response> handle_login_request(const crow::request& req, CrowApp& app);
     
     crow::response handle_root_page(const site_params& params);
     
@@ -10,9 +10,11 @@
 
 #include <crowsite/crow_pch.h>
 #include "crowsite/site/cache.h"
+#include "crowsite/site/static_cache.h"
 
 namespace cs
 {
+    void establishStaticRoutes(CrowApp& app, StaticCache& cache);
     void establishHomeRoutes(CrowApp& app, CacheEngine& engine);
     void establishProjectRoutes(CrowApp& app, CacheEngine& engine);
 }
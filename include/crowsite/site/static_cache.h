@@ -0,0 +1,185 @@
+#pragma once
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+
+#ifndef CROWSITE_STATIC_CACHE_H
+#define CROWSITE_STATIC_CACHE_H
+
+#include <crowsite/crow_pch.h>
+#include <filesystem>
+#include <unordered_map>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <string>
+
+namespace cs
+{
+
+    struct StaticCacheSettings
+    {
+        // files larger than this are never held in memory and are streamed from disk instead
+        uint64_t maxFileSize = 512 * 1024;
+        // bytes (including the compressed variants) kept before the least recently used assets are evicted
+        uint64_t maxMemory = 64 * 1024 * 1024;
+    };
+
+    /**
+     * A static file held in memory along with everything needed to answer a request for it.
+     * The compressed variants are empty when compressing did not make the file meaningfully smaller.
+     */
+    struct StaticAsset
+    {
+        enum Encoding
+        {
+            IDENTITY, GZIP, BROTLI
+        };
+
+        std::string mime;
+        std::string etag;
+        std::string body;
+        std::string gzip;
+        std::string brotli;
+        std::filesystem::file_time_type lastModified;
+        // pre-serialized response headers, indexed by [encoding][immutable]
+        std::shared_ptr<const crow::serialized_headers> headers[3][2];
+
+        [[nodiscard]] const std::string& variant(Encoding encoding) const
+        {
+            switch (encoding)
+            {
+                case GZIP:
+                    return gzip;
+                case BROTLI:
+                    return brotli;
+                default:
+                    return body;
+            }
+        }
+
+        [[nodiscard]] uint64_t memoryUsage() const
+        {
+            uint64_t usage = sizeof(StaticAsset) + mime.size() + etag.size() + body.size() + gzip.size() + brotli.size();
+            for (const auto& encoding : headers)
+                for (const auto& block : encoding)
+                    usage += block ? sizeof(crow::serialized_headers) + block->data.size() : 0;
+            return usage;
+        }
+    };
+
+    /**
+     * Caches small files from the static directory in memory, with their gzip and brotli variants precomputed.
+     * Entries are dropped as soon as the file watcher sees them change, so a hit needs no filesystem access.
+     * Where no watcher is available each hit compares the file's modification time instead.
+     */
+    class StaticCache
+    {
+        private:
+            struct CacheValue
+            {
+                std::shared_ptr<const StaticAsset> asset;
+                uint64_t memory;
+                mutable std::atomic<uint64_t> lastAccess;
+            };
+
+            std::string m_Root;
+            StaticCacheSettings m_Settings;
+
+            struct Fingerprint
+            {
+                std::string hash;
+                std::filesystem::file_time_type lastModified;
+            };
+
+            std::shared_mutex m_Mutex;
+            std::unordered_map<std::string, CacheValue> m_Assets;
+            // fingerprints are kept for every referenced file, including ones too large to cache
+            std::unordered_map<std::string, Fingerprint> m_Fingerprints;
+            uint64_t m_Memory = 0;
+            std::atomic<uint64_t> m_Clock = 0;
+            // bumped by every invalidation, loads which raced with one are discarded
+            std::atomic<uint64_t> m_Generation = 0;
+
+            int m_WatchFD = -1;
+            std::unordered_map<int, std::string> m_WatchedFolders;
+            std::atomic_bool m_Watching = false;
+            std::thread m_Watcher;
+
+            std::shared_ptr<const StaticAsset> load(const std::string& path);
+
+            void insert(const std::string& path, const std::shared_ptr<const StaticAsset>& asset, uint64_t generation);
+
+            /**
+             * Evicts the least recently used assets until there is room for the requested amount of bytes. Expects m_Mutex to be held.
+             */
+            void prune(uint64_t required);
+
+            void startWatching();
+
+            void watchFolder(const std::string& relativePath);
+
+            void watch();
+
+        public:
+            explicit StaticCache(std::string root = CROW_STATIC_DIRECTORY, const StaticCacheSettings& settings = {});
+
+            StaticCache(const StaticCache&) = delete;
+            StaticCache& operator=(const StaticCache&) = delete;
+
+            ~StaticCache();
+
+            /**
+             * @param path path relative to the static directory, it must already be sanitized
+             * @return the cached asset or nullptr if the file does not exist or is too large to be cached
+             */
+            std::shared_ptr<const StaticAsset> fetch(const std::string& path);
+
+            /**
+             * @param path path relative to the static directory
+             * @return a short hash of the file's content, or an empty string if the file does not exist
+             */
+            std::string fingerprint(const std::string& path);
+
+            /**
+             * @param path path relative to the static directory
+             * @return the path with the content hash inserted before the extension (css/index.css -> css/index.3f9a1c0d2b4e.css),
+             * or an empty string if the file does not exist
+             */
+            std::string fingerprintedPath(const std::string& path);
+
+            /**
+             * Splits a path created by fingerprintedPath back into the file path and the hash, without checking the hash.
+             * @return false if the path does not contain a fingerprint
+             */
+            static bool splitFingerprint(const std::string& path, std::string& base, std::string& hash);
+
+            /**
+             * Drops the path from the cache, if the path is a folder everything inside of it is dropped as well.
+             */
+            void invalidate(const std::string& path);
+
+            /**
+             * Answers the request for a static file, from memory where possible, falling back to streaming it from disk.
+             * Honours If-None-Match and picks the best precompressed variant the client accepts.
+             * Fingerprinted paths whose hash matches the current content are served as immutable.
+             * @param path path relative to the static directory, it must already be sanitized
+             */
+            void serve(const crow::request& req, crow::response& res, const std::string& path);
+
+            /**
+             * @return a quoted strong entity tag for the given content
+             */
+            static std::string createETag(const std::string& content);
+
+            // fingerprinted urls never change content, so browsers may keep them for the maximum of a year without asking
+            static constexpr auto immutableCacheControl = "public, max-age=31536000, immutable";
+            static constexpr size_t fingerprintLength = 12;
+    };
+
+}
+
+#endif //CROWSITE_STATIC_CACHE_H
@@ -8,6 +8,13 @@
 #include <sqlite3.h>
 #include <type_traits>
 #include <filesystem>
+#include <string_view>
+#include <tuple>
+#include <optional>
+#include <iterator>
+#include <vector>
+#include <functional>
+#include <algorithm>
 #include "blt/std/assert.h"
 
 namespace cs::sql
@@ -20,6 +27,70 @@ namespace cs::sql
             {}
     };
     
+    namespace detail
+    {
+        template<typename T>
+        inline constexpr bool is_column_type_v =
+                std::is_arithmetic_v<T> || std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+        
+        /**
+         * Binds t to the (1 indexed) parameter. Text is bound without a copy so it must outlive the statement's execution!
+         */
+        template<typename T>
+        int bind(sqlite3_stmt* stmt, int column, const T& t)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                return sqlite3_bind_double(stmt, column, t);
+            } else if constexpr (std::is_integral_v<T>)
+            {
+                if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>)
+                    return sqlite3_bind_int64(stmt, column, t);
+                else
+                    return sqlite3_bind_int(stmt, column, t);
+            } else if constexpr (std::is_same_v<T, std::string>)
+            {
+                return sqlite3_bind_text(stmt, column, t.c_str(), -1, nullptr);
+            } else if constexpr (std::is_same_v<T, std::string_view>)
+            {
+                return sqlite3_bind_text(stmt, column, t.data(), static_cast<int>(t.size()), nullptr);
+            } else
+            {
+                static_assert(is_column_type_v<T>, "Unsupported type for sqlite parameter binding");
+                return SQLITE_MISUSE;
+            }
+        }
+        
+        /**
+         * Reads the (0 indexed) column of the current row. std::string_view points into sqlite's row buffer
+         * and is only valid until the statement is stepped, reset or finalized.
+         */
+        template<typename T>
+        T column(sqlite3_stmt* stmt, int column)
+        {
+            if constexpr (std::is_floating_point_v<T>)
+            {
+                return sqlite3_column_double(stmt, column);
+            } else if constexpr (std::is_integral_v<T>)
+            {
+                if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>)
+                    return sqlite3_column_int64(stmt, column);
+                else
+                    return sqlite3_column_int(stmt, column);
+            } else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+            {
+                // text must be fetched before the size, sqlite3_column_bytes may otherwise convert the value afterwards
+                auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+                if (text == nullptr)
+                    return T{};
+                return T(text, static_cast<size_t>(sqlite3_column_bytes(stmt, column)));
+            } else
+            {
+                return sqlite3_column_blob(stmt, column);
+            }
+        }
+    }
+    
     static int prepareStatement(sqlite3* db, const std::string& sqlStatement, sqlite3_stmt** ppStmt)
     {
         return sqlite3_prepare_v2(db, sqlStatement.c_str(), static_cast<int>(sqlStatement.size()) + 1, ppStmt, nullptr);
@@ -62,6 +133,11 @@ namespace cs::sql
                 return *this;
             }
             
+            [[nodiscard]] sqlite3* get() const
+            {
+                return db;
+            }
+            
             database(const database& copy) = delete;
             
             database& operator=(const database& copy) = delete;
@@ -142,20 +218,7 @@ namespace cs::sql
             statement* set(const T& t, int column)
             {
                 // make api consistent
-                column = column + 1;
-                if constexpr (std::is_floating_point_v<T>)
-                {
-                    err = sqlite3_bind_double(stmt, column, t);
-                } else if constexpr (std::is_integral_v<T>)
-                {
-                    if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>)
-                        err = sqlite3_bind_int64(stmt, column, t);
-                    else
-                        err = sqlite3_bind_int(stmt, column, t);
-                } else if constexpr (std::is_same_v<T, std::string>)
-                {
-                    err = sqlite3_bind_text(stmt, column, t.c_str(), -1, nullptr);
-                }
+                err = detail::bind(stmt, column + 1, t);
                 return this;
             }
             
@@ -164,22 +227,7 @@ namespace cs::sql
             {
                 if (err != SQLITE_ROW)
                     throw std::runtime_error("Unable to get data as statement didn't return a row!");
-                if constexpr (std::is_floating_point_v<T>)
-                {
-                    return sqlite3_column_double(stmt, column);
-                } else if constexpr (std::is_integral_v<T>)
-                {
-                    if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, uint64_t>)
-                        return sqlite3_column_int64(stmt, column);
-                    else
-                        return sqlite3_column_int(stmt, column);
-                } else if constexpr (std::is_same_v<T, std::string>)
-                {
-                    return std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt, column)));
-                } else
-                {
-                    return sqlite3_column_blob(stmt, column);
-                }
+                return detail::column<T>(stmt, column);
             }
             
             /**
@@ -202,12 +250,247 @@ namespace cs::sql
         
     };
     
+    /**
+     * A typed statement which returns rows of Cols... Rows are streamed directly out of sqlite as tuples,
+     * std::string_view columns point into sqlite's row buffer and are only valid until the next row is fetched.
+     *
+     * The number of columns returned by the SQL is checked against sizeof...(Cols) when the statement is prepared.
+     * @code
+     * sql::query<int64_t, std::string_view> q(db, "SELECT postID, title FROM posts;");
+     * for (auto [id, title] : q)
+     *     ...
+     * @endcode
+     */
+    template<typename... Cols>
+    class query : public statement_base_helper
+    {
+            static_assert((detail::is_column_type_v<Cols> && ...), "query columns must be arithmetic, std::string or std::string_view");
+        public:
+            using row_type = std::tuple<Cols...>;
+            
+            class iterator
+            {
+                    friend class query;
+                private:
+                    query* q = nullptr;
+                    
+                    explicit iterator(query* q): q(q)
+                    {}
+                
+                public:
+                    using iterator_category = std::input_iterator_tag;
+                    using value_type = row_type;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = void;
+                    using reference = row_type;
+                    
+                    iterator() = default;
+                    
+                    row_type operator*() const
+                    {
+                        return q->row();
+                    }
+                    
+                    iterator& operator++()
+                    {
+                        if (!q->next())
+                            q = nullptr;
+                        return *this;
+                    }
+                    
+                    void operator++(int)
+                    {
+                        ++*this;
+                    }
+                    
+                    bool operator==(const iterator& other) const
+                    {
+                        return q == other.q;
+                    }
+                    
+                    bool operator!=(const iterator& other) const
+                    {
+                        return q != other.q;
+                    }
+            };
+            
+            query(query&& move) = delete;
+            
+            query(const query& copy) = delete;
+            
+            query& operator=(query&& move) = delete;
+            
+            query& operator=(const query& copy) = delete;
+            
+            query(const database& db, const std::string& sql, bool throw_errors = true): statement_base_helper(db, sql, throw_errors)
+            {
+                validate(sql, throw_errors);
+            }
+            
+            query(const database* db, const std::string& sql, bool throw_errors = true): statement_base_helper(*db, sql, throw_errors)
+            {
+                validate(sql, throw_errors);
+            }
+            
+            /**
+             * Binds a parameter, indexed from 0 like statement::set. Text parameters are not copied!
+             */
+            template<typename T>
+            query& bind(int column, const T& t)
+            {
+                if (!fail())
+                    err = detail::bind(stmt, column + 1, t);
+                return *this;
+            }
+            
+            /**
+             * @return true if preparing, binding or the last step failed.
+             */
+            [[nodiscard]] bool fail() const
+            {
+                return !(err == SQLITE_OK || err == SQLITE_DONE || err == SQLITE_ROW);
+            }
+            
+            [[nodiscard]] int error() const
+            {
+                return err;
+            }
+            
+            /**
+             * Restarts the query, every call returns the rows from the beginning. Bound parameters are kept.
+             */
+            iterator begin()
+            {
+                if (fail())
+                    return end();
+                sqlite3_reset(stmt);
+                return next() ? iterator{this} : end();
+            }
+            
+            iterator end()
+            {
+                return iterator{};
+            }
+            
+            /**
+             * @return the first row, or nothing if the query returned no rows. Views are valid until the query is used again.
+             */
+            std::optional<row_type> first()
+            {
+                auto it = begin();
+                if (it == end())
+                    return {};
+                return *it;
+            }
+            
+            ~query()
+            {
+                sqlite3_finalize(stmt);
+            }
+        
+        private:
+            void validate(const std::string& sql, bool throw_errors)
+            {
+                if (fail())
+                    return;
+                auto columns = sqlite3_column_count(stmt);
+                if (columns == static_cast<int>(sizeof...(Cols)))
+                    return;
+                auto msg = "Query '" + sql + "' returns " + std::to_string(columns) + " columns but " + std::to_string(sizeof...(Cols)) +
+                           " were expected!";
+                err = SQLITE_MISMATCH;
+                if (throw_errors)
+                    BLT_THROW(sql_error(msg));
+                else
+                    BLT_ERROR("%s", msg.c_str());
+            }
+            
+            bool next()
+            {
+                err = sqlite3_step(stmt);
+                return err == SQLITE_ROW;
+            }
+            
+            row_type row()
+            {
+                return row(std::index_sequence_for<Cols...>{});
+            }
+            
+            template<size_t... I>
+            row_type row(std::index_sequence<I...>)
+            {
+                return row_type{detail::column<Cols>(stmt, static_cast<int>(I))...};
+            }
+    };
+    
     inline void auto_statement(const database* db, const std::string& stmt, bool throw_errors = true){
         statement s(db, stmt, throw_errors);
         if (!s.execute() && throw_errors)
             BLT_THROW(sql_error("Unable to execute statement '" + stmt + "'. Error: " + std::to_string(s.error()) + sqlite3_errstr(s.error())));
     }
     
+    inline bool has_column(const database* db, const std::string& table, const std::string& column)
+    {
+        query<int32_t> q(db, "SELECT COUNT(*) FROM pragma_table_info(?) WHERE name=?;");
+        q.bind(0, table);
+        q.bind(1, column);
+        auto row = q.first();
+        return row && std::get<0>(*row) > 0;
+    }
+    
+    /**
+     * A single schema change. statements are executed in order, followed by apply if it is set.
+     * Versions must be unique and increasing, a migration is never changed once it has been shipped.
+     */
+    struct migration
+    {
+        int version;
+        std::string description;
+        std::vector<std::string> statements;
+        std::function<void(const database*)> apply = nullptr;
+    };
+    
+    /**
+     * Applies every migration newer than the database's PRAGMA user_version. Each migration runs inside its own transaction
+     * together with the user_version bump, so a failed migration leaves the database at the previous version.
+     * @throws sql_error if a migration fails
+     */
+    inline void migrate(const database* db, const std::string& name, std::vector<migration> migrations)
+    {
+        std::sort(
+                migrations.begin(), migrations.end(), [](const migration& m1, const migration& m2) -> bool {
+                    return m1.version < m2.version;
+                }
+        );
+        
+        query<int32_t> versionQuery(db, "PRAGMA user_version;");
+        auto current = std::get<0>(versionQuery.first().value_or(std::tuple<int32_t>{0}));
+        
+        for (const auto& m : migrations)
+        {
+            if (m.version <= current)
+                continue;
+            BLT_INFO("Migrating %s database to version %d: %s", name.c_str(), m.version, m.description.c_str());
+            auto_statement(db, "BEGIN IMMEDIATE;");
+            try
+            {
+                for (const auto& stmt : m.statements)
+                    auto_statement(db, stmt);
+                if (m.apply)
+                    m.apply(db);
+                // pragmas can't take bound parameters
+                auto_statement(db, "PRAGMA user_version = " + std::to_string(m.version) + ";");
+                auto_statement(db, "COMMIT;");
+            } catch (...)
+            {
+                auto_statement(db, "ROLLBACK;", false);
+                BLT_ERROR("Migration of %s database to version %d failed!", name.c_str(), m.version);
+                throw;
+            }
+            current = m.version;
+        }
+    }
+    
 }
 
 #endif //CROWSITE_SQL_HELPER_H
@@ -16,21 +16,24 @@
 
 #include <vector>
 #include <optional>
+#include <crowsite/crow_pch.h>
 #include <blt/std/hashmap.h>
 #include "crowsite/site/cache.h"
 #include "crowsite/util/crow_typedef.h"
 
 namespace cs
 {
-    query_string toQueryString(const std::vector<char*>& kv);
-    
+    /**
+     * Everything a page handler needs from the request. The URL and its parameters are referenced, not copied,
+     * so the crow::request has to outlive it.
+     */
     struct request_info
     {
-        std::string raw_url;     ///< The full URL containing the `?` and URL parameters.
+        const std::string& raw_url;     ///< The full URL containing the `?` and URL parameters.
         std::string clientID;
         std::string tokenID;
         std::string path;
-        query_string url_params; ///< The parameters associated with the request. (everything after the `?` in the URL)
+        const crow::query_string& url_params; ///< The parameters associated with the request. (everything after the `?` in the URL)
         CacheEngine& engine;
         std::optional<header_map> headers{};
     };
@@ -9,12 +9,46 @@
 #define CROWSITE_CROW_TYPEDEF_H
 
 #include <string>
+#include <string_view>
+#include <functional>
+#include <blt/std/hashmap.h>
+#include <crow/request_arena.h>
 
 namespace cs
 {
+    /**
+     * A string which takes its memory from the request's arena when constructed with req.arena, and from the heap otherwise.
+     */
+    typedef std::basic_string<char, std::char_traits<char>, crow::arena_allocator<char>> arena_string;
+
+    /**
+     * Hash and equality for any kind of string, so a context can be searched without building a key.
+     */
+    struct string_hash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view str) const
+        {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    struct string_equal
+    {
+        using is_transparent = void;
+
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            return a == b;
+        }
+    };
+
     typedef HASHMAP<std::string, std::string> header_map;
-    typedef HASHMAP<std::string, std::string> query_string;
-    typedef HASHMAP<std::string, std::string> context;
+    /**
+     * Constructed from req.arena the context lives as long as the request, the static context uses the heap.
+     */
+    typedef HASHMAP<arena_string, arena_string, string_hash, string_equal, crow::arena_allocator<std::pair<const arena_string, arena_string>>> context;
 }
 
 #endif //CROWSITE_CROW_TYPEDEF_H
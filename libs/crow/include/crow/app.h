@@ -23,6 +23,7 @@
 #ifdef CROW_ENABLE_COMPRESSION
 #include "crow/compression.h"
 #endif
+#include "crow/worker_pool.h"
 
 #ifdef CROW_MSVC_WORKAROUND
 #define CROW_ROUTE(app, url) app.route_dynamic(url)
@@ -85,9 +86,34 @@ namespace crow
         /// Process the fully parsed request and generate a response for it
         void handle(request& req, response& res, std::unique_ptr<routing_handle_result>& found)
         {
+            if (blocking_pool_ && router_.is_blocking(*found) && dispatch_blocking(req, res, *found))
+                return;
             router_.handle<self_t>(req, res, *found);
         }
 
+        /// Run a blocking route on the blocking workers, the response is completed back on the connection's io_service.
+        /// Returns false when the workers' queue is full, the route then runs on the calling thread.
+        bool dispatch_blocking(request& req, response& res, const routing_handle_result& found)
+        {
+            if (!req.io_service)
+                return false;
+
+            auto complete = res.complete_request_handler_;
+            auto& io_service = *req.io_service;
+            res.complete_request_handler_ = [&io_service, complete] {
+                asio::post(io_service, complete);
+            };
+
+            if (blocking_pool_->try_post([this, &req, &res, found] {
+                    router_.handle<self_t>(req, res, found);
+                }))
+                return true;
+
+            CROW_LOG_WARNING << "Blocking workers are saturated, running " << req.url << " on the IO thread";
+            res.complete_request_handler_ = std::move(complete);
+            return false;
+        }
+
         /// Process a fully parsed request from start to finish (primarily used for debugging)
         void handle_full(request& req, response& res)
         {
@@ -215,6 +241,70 @@ namespace crow
             return concurrency_;
         }
 
+        /// Set the number of threads running routes marked `.blocking()` (Default is 8)
+
+        ///
+        /// At most `max_pending` requests wait for a thread, past that blocking routes run on the IO threads.
+        /// Unless this is called the threads are only started if at least one route is blocking.
+        /// Coroutine handlers reach them through `co_await crow::blocking(app, req, f)`.
+        self_t& blocking_workers(std::uint16_t threads, size_t max_pending = 1024)
+        {
+            blocking_workers_ = threads;
+            blocking_max_pending_ = max_pending;
+            blocking_workers_set_ = true;
+            return *this;
+        }
+
+        /// The pool blocking routes run on, or nullptr while the app runs without one
+        detail::worker_pool* blocking_pool()
+        {
+            return blocking_pool_.get();
+        }
+
+        /// Give every IO thread its own `SO_REUSEPORT` listening socket and pin it to a CPU
+
+        ///
+        /// The kernel spreads new connections across the threads, so accepting scales with the cores instead of running on one thread.
+        /// Where `SO_REUSEPORT` isn't available connections are accepted as usual.
+        self_t& reuse_port(bool enabled = true)
+        {
+            reuse_port_ = enabled;
+            return *this;
+        }
+
+        bool reuse_port() const
+        {
+            return reuse_port_;
+        }
+
+        /// Set how many closed connections each IO thread keeps to reuse for new sockets (default 256), 0 disables pooling
+
+        ///
+        /// A reused connection keeps its buffers, so short lived connections don't allocate them all over again.
+        /// HTTPS connections are never pooled.
+        self_t& connection_pool(size_t max_idle)
+        {
+            max_idle_connections_ = max_idle;
+            return *this;
+        }
+
+        size_t connection_pool() const
+        {
+            return max_idle_connections_;
+        }
+
+        /// Occupancy of the connection pools of the running server
+        connection_pool_stats connection_stats()
+        {
+            if (server_)
+                return server_->connection_stats();
+#ifdef CROW_ENABLE_SSL
+            if (ssl_server_)
+                return ssl_server_->connection_stats();
+#endif
+            return {};
+        }
+
         /// Set the server's log level
 
         ///
@@ -262,22 +352,53 @@ namespace crow
         }
 
 #ifdef CROW_ENABLE_COMPRESSION
+        /// Compress responses with a single algorithm, using the default policy otherwise
         self_t& use_compression(compression::algorithm algorithm)
         {
-            comp_algorithm_ = algorithm;
-            compression_used_ = true;
+            compression::policy policy = comp_policy_;
+            policy.algorithms = {algorithm};
+            return use_compression(std::move(policy));
+        }
+
+        /// Compress responses as described by the policy, the client's Accept-Encoding picks among its algorithms
+        self_t& use_compression(compression::policy policy)
+        {
+            comp_policy_ = std::move(policy);
+            compression_used_ = !comp_policy_.algorithms.empty();
             return *this;
         }
 
         compression::algorithm compression_algorithm()
         {
-            return comp_algorithm_;
+            return comp_policy_.algorithms.front();
+        }
+
+        const compression::policy& compression_policy() const
+        {
+            return comp_policy_;
         }
 
         bool compression_used() const
         {
             return compression_used_;
         }
+
+        /// Compress bodies of at least the policy's `offload_size` on a pool of this many threads (Default is 0, compressing on the IO threads)
+
+        ///
+        /// At most `max_pending` bodies wait for a worker, past that a connection compresses its own response.
+        self_t& compression_workers(std::uint16_t threads, size_t max_pending = 256)
+        {
+            comp_workers_ = threads;
+            comp_max_pending_ = max_pending;
+            return *this;
+        }
+
+        /// The pool large bodies are compressed on, or nullptr while the app runs without one
+        detail::worker_pool* compression_pool()
+        {
+            return comp_pool_.get();
+        }
 #endif
         /// A wrapper for `validate()` in the router
 
@@ -337,11 +458,19 @@ namespace crow
 
             validate();
 
+            if ((router_.has_blocking_rules() || blocking_workers_set_) && blocking_workers_ > 0)
+                blocking_pool_.reset(new detail::worker_pool(blocking_workers_, blocking_max_pending_));
+#ifdef CROW_ENABLE_COMPRESSION
+            if (compression_used_ && comp_workers_ > 0)
+                comp_pool_.reset(new detail::worker_pool(comp_workers_, comp_max_pending_));
+#endif
+
 #ifdef CROW_ENABLE_SSL
             if (ssl_used_)
             {
-                ssl_server_ = std::move(std::unique_ptr<ssl_server_t>(new ssl_server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, &ssl_context_)));
+                ssl_server_ = std::move(std::unique_ptr<ssl_server_t>(new ssl_server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, &ssl_context_, reuse_port_)));
                 ssl_server_->set_tick_function(tick_interval_, tick_function_);
+                ssl_server_->set_max_idle_connections(max_idle_connections_);
                 ssl_server_->signal_clear();
                 for (auto snum : signals_)
                 {
@@ -353,8 +482,9 @@ namespace crow
             else
 #endif
             {
-                server_ = std::move(std::unique_ptr<server_t>(new server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, nullptr)));
+                server_ = std::move(std::unique_ptr<server_t>(new server_t(this, bindaddr_, port_, server_name_, &middlewares_, concurrency_, timeout_, nullptr, reuse_port_)));
                 server_->set_tick_function(tick_interval_, tick_function_);
+                server_->set_max_idle_connections(max_idle_connections_);
                 for (auto snum : signals_)
                 {
                     server_->signal_add(snum);
@@ -362,6 +492,12 @@ namespace crow
                 notify_server_start();
                 server_->run();
             }
+
+            // queued jobs still run here, their connections resume on io_services which no longer run
+            blocking_pool_.reset();
+#ifdef CROW_ENABLE_COMPRESSION
+            comp_pool_.reset();
+#endif
         }
 
         /// Non-blocking version of \ref run()
@@ -562,6 +698,11 @@ namespace crow
         std::uint8_t timeout_{5};
         uint16_t port_ = 80;
         uint16_t concurrency_ = 2;
+        bool reuse_port_ = false;
+        size_t max_idle_connections_ = 256;
+        std::uint16_t blocking_workers_ = 8;
+        size_t blocking_max_pending_ = 1024;
+        bool blocking_workers_set_ = false;
         uint64_t max_payload_{UINT64_MAX};
         bool validated_ = false;
         std::string server_name_ = std::string("Crow/") + VERSION;
@@ -570,8 +711,10 @@ namespace crow
         Router router_;
 
 #ifdef CROW_ENABLE_COMPRESSION
-        compression::algorithm comp_algorithm_;
+        compression::policy comp_policy_;
         bool compression_used_{false};
+        std::uint16_t comp_workers_ = 0;
+        size_t comp_max_pending_ = 256;
 #endif
 
         std::chrono::milliseconds tick_interval_;
@@ -587,6 +730,12 @@ namespace crow
 
         std::unique_ptr<server_t> server_;
 
+        // declared after the servers so pending jobs finish while their io_services still exist
+        std::unique_ptr<detail::worker_pool> blocking_pool_;
+#ifdef CROW_ENABLE_COMPRESSION
+        std::unique_ptr<detail::worker_pool> comp_pool_;
+#endif
+
         std::vector<int> signals_{SIGINT, SIGTERM};
 
         bool server_started_{false};
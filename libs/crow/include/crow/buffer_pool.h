@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace crow
+{
+    namespace detail
+    {
+        /// A fixed size buffer taken from a per thread pool, it goes back to the pool of the releasing thread when destroyed.
+        /// IO threads only ever touch their own pool, so acquiring and releasing needs no locking.
+        class pooled_buffer
+        {
+        public:
+            static constexpr std::size_t size = 64 * 1024;
+
+            pooled_buffer() = default;
+            pooled_buffer(pooled_buffer&&) = default;
+            pooled_buffer& operator=(pooled_buffer&& other)
+            {
+                release();
+                data_ = std::move(other.data_);
+                return *this;
+            }
+
+            ~pooled_buffer() { release(); }
+
+            static pooled_buffer acquire()
+            {
+                pooled_buffer b;
+                auto& free = free_list();
+                if (free.empty())
+                {
+                    b.data_.reset(new char[size]);
+                }
+                else
+                {
+                    b.data_ = std::move(free.back());
+                    free.pop_back();
+                }
+                return b;
+            }
+
+            /// Return the buffer to the pool early
+            void release()
+            {
+                if (!data_) return;
+                auto& free = free_list();
+                if (free.size() < max_free)
+                    free.push_back(std::move(data_));
+                data_.reset();
+            }
+
+            char* data() const { return data_.get(); }
+
+            explicit operator bool() const { return bool(data_); }
+
+        private:
+            // buffers past this are freed rather than kept
+            static constexpr std::size_t max_free = 16;
+
+            static std::vector<std::unique_ptr<char[]>>& free_list()
+            {
+                static thread_local std::vector<std::unique_ptr<char[]>> free;
+                return free;
+            }
+
+            std::unique_ptr<char[]> data_;
+        };
+    } // namespace detail
+} // namespace crow
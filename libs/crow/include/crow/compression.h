@@ -1,9 +1,18 @@
 #ifdef CROW_ENABLE_COMPRESSION
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <zlib.h>
 
+#include "crow/utility.h"
+#ifdef CROW_ENABLE_BROTLI
+#include <brotli/encode.h>
+#endif
+
 // http://zlib.net/manual.html
 namespace crow
 {
@@ -17,45 +26,234 @@ namespace crow
             // windowBits can also be greater than 15 for optional gzip encoding.
             // Add 16 to windowBits to write a simple gzip header and trailer around the compressed data instead of a zlib wrapper.
             GZIP = 15 | 16,
+#ifdef CROW_ENABLE_BROTLI
+            // not a zlib value, served by the brotli encoder
+            BROTLI = 1 << 8,
+#endif
         };
 
-        inline std::string compress_string(std::string const& str, algorithm algo)
+        /// The Content-Encoding token for an algorithm
+        inline const char* content_encoding(algorithm algo)
         {
-            std::string compressed_str;
-            z_stream stream{};
-            // Initialize with the default values
-            if (::deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, algo, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+            switch (algo)
             {
-                char buffer[8192];
+                case DEFLATE: return "deflate";
+                case GZIP: return "gzip";
+#ifdef CROW_ENABLE_BROTLI
+                case BROTLI: return "br";
+#endif
+            }
+            return "identity";
+        }
 
-                stream.avail_in = str.size();
+        /// Incremental compressor, lets large bodies be compressed and sent a slice at a time instead of in one full size buffer.
+        ///
+        /// The level is handed to the encoder as it is, 0-9 for zlib and 0-11 for brotli. -1 picks a default suited to dynamic content.
+        class encoder
+        {
+        public:
+            encoder(algorithm algo, int level = -1):
+              algo_(algo)
+            {
+#ifdef CROW_ENABLE_BROTLI
+                if (algo == BROTLI)
+                {
+                    brotli_ = ::BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+                    // brotli's own default of 11 is meant for static content and far too slow per request
+                    valid_ = brotli_ != nullptr &&
+                             ::BrotliEncoderSetParameter(brotli_, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(level < 0 ? 5 : level)) == BROTLI_TRUE;
+                    return;
+                }
+#endif
+                valid_ = ::deflateInit2(&zlib_, level < 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, algo, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+            }
+
+            encoder(const encoder&) = delete;
+            encoder& operator=(const encoder&) = delete;
+
+            ~encoder()
+            {
+#ifdef CROW_ENABLE_BROTLI
+                if (algo_ == BROTLI)
+                {
+                    if (brotli_) ::BrotliEncoderDestroyInstance(brotli_);
+                    return;
+                }
+#endif
+                if (valid_) ::deflateEnd(&zlib_);
+            }
+
+            bool valid() const { return valid_; }
+
+            /// Compress the input, appending whatever output is ready to `out`.
+            /// Pass `finish` with the last piece of input to flush everything and end the stream.
+            bool write(const char* data, size_t size, bool finish, std::string& out)
+            {
+                if (!valid_) return false;
+#ifdef CROW_ENABLE_BROTLI
+                if (algo_ == BROTLI)
+                    return write_brotli(data, size, finish, out);
+#endif
+                zlib_.avail_in = static_cast<uInt>(size);
                 // zlib does not take a const pointer. The data is not altered.
-                stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(str.c_str()));
+                zlib_.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(data));
 
-                int code = Z_OK;
+                int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+                int code;
                 do
                 {
-                    stream.avail_out = sizeof(buffer);
-                    stream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+                    // grow the output in place instead of copying out of a scratch buffer, guessing at a typical ratio
+                    // rather than reserving the worst case so large bodies don't need a second full size buffer
+                    size_t used = out.size();
+                    size_t guess = std::max<size_t>(zlib_.avail_in / 4, 16384);
+                    out.resize(used + std::min<size_t>(guess, ::deflateBound(&zlib_, zlib_.avail_in) + 64));
+                    zlib_.avail_out = static_cast<uInt>(out.size() - used);
+                    zlib_.next_out = reinterpret_cast<Bytef*>(&out[used]);
 
-                    code = ::deflate(&stream, Z_FINISH);
-                    // Successful and non-fatal error code returned by deflate when used with Z_FINISH flush
-                    if (code == Z_OK || code == Z_STREAM_END)
+                    code = ::deflate(&zlib_, flush);
+                    out.resize(out.size() - zlib_.avail_out);
+                    if (code != Z_OK && code != Z_STREAM_END && code != Z_BUF_ERROR)
                     {
-                        std::copy(&buffer[0], &buffer[sizeof(buffer) - stream.avail_out], std::back_inserter(compressed_str));
+                        valid_ = false;
+                        return false;
                     }
+                } while (finish ? code != Z_STREAM_END : zlib_.avail_in > 0);
+                return true;
+            }
 
-                } while (code == Z_OK);
-
-                if (code != Z_STREAM_END)
-                    compressed_str.clear();
-
-                ::deflateEnd(&stream);
+        private:
+#ifdef CROW_ENABLE_BROTLI
+            bool write_brotli(const char* data, size_t size, bool finish, std::string& out)
+            {
+                size_t available_in = size;
+                auto next_in = reinterpret_cast<const uint8_t*>(data);
+                auto op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+                do
+                {
+                    size_t available_out = 0;
+                    if (::BrotliEncoderCompressStream(brotli_, op, &available_in, &next_in, &available_out, nullptr, nullptr) != BROTLI_TRUE)
+                    {
+                        valid_ = false;
+                        return false;
+                    }
+                    // take the output straight from the encoder's own buffer
+                    size_t produced = 0;
+                    auto output = ::BrotliEncoderTakeOutput(brotli_, &produced);
+                    out.append(reinterpret_cast<const char*>(output), produced);
+                } while (available_in > 0 || ::BrotliEncoderHasMoreOutput(brotli_) || (finish && !::BrotliEncoderIsFinished(brotli_)));
+                return true;
             }
 
+            BrotliEncoderState* brotli_ = nullptr;
+#endif
+            algorithm algo_;
+            z_stream zlib_{};
+            bool valid_ = false;
+        };
+
+        inline std::string compress_string(std::string const& str, algorithm algo, int level = -1)
+        {
+            std::string compressed_str;
+            encoder enc(algo, level);
+            if (!enc.write(str.data(), str.size(), true, compressed_str))
+                compressed_str.clear();
             return compressed_str;
         }
 
+        /// Decides which responses are compressed, with what, and how hard.
+        struct policy
+        {
+            /// Bodies smaller than this are sent as they are, the CPU and headers would outweigh the savings
+            size_t min_size = 256;
+            /// Algorithms in order of preference, used when the client rates several of them equally
+            std::vector<algorithm> algorithms;
+            /// Level used for content types without their own entry in `levels`
+            int default_level = -1;
+            /// Levels for specific mime types (without parameters), e.g. a fast level for large JSON responses
+            std::unordered_map<std::string, int> levels;
+            /// Content type prefixes which are already compressed and never worth compressing again
+            std::vector<std::string> skip = {"image/", "video/", "audio/", "font/woff", "application/zip", "application/gzip", "application/x-brotli"};
+            /// Bodies at least this large are compressed on the app's compression workers (see `App::compression_workers`)
+            /// rather than on the IO thread, which would otherwise stall every other connection it serves
+            size_t offload_size = 64 * 1024;
+
+            policy() = default;
+
+            policy(std::initializer_list<algorithm> algorithms):
+              algorithms(algorithms)
+            {}
+
+            static std::string mime_type(const std::string& content_type)
+            {
+                auto end = content_type.find(';');
+                auto mime = content_type.substr(0, end);
+                while (!mime.empty() && mime.back() == ' ')
+                    mime.pop_back();
+                return mime;
+            }
+
+            int level_for(const std::string& content_type) const
+            {
+                auto found = levels.find(mime_type(content_type));
+                return found == levels.end() ? default_level : found->second;
+            }
+
+            bool should_compress(const std::string& content_type, size_t size) const
+            {
+                if (size < min_size)
+                    return false;
+                for (auto& prefix : skip)
+                {
+                    if (content_type.compare(0, prefix.size(), prefix) == 0)
+                        return false;
+                }
+                return true;
+            }
+
+            /// Pick the algorithm for an Accept-Encoding header by its q-values (RFC 9110 section 12.5.3).
+            /// Returns false when the client accepts none of the algorithms in this policy.
+            bool negotiate(const std::string& accept_encoding, algorithm& chosen) const
+            {
+                double best_q = 0;
+                size_t pos = 0;
+                while (pos < accept_encoding.size())
+                {
+                    size_t end = accept_encoding.find(',', pos);
+                    if (end == std::string::npos) end = accept_encoding.size();
+                    std::string item = accept_encoding.substr(pos, end - pos);
+                    pos = end + 1;
+
+                    double q = 1;
+                    size_t params = item.find(';');
+                    if (params != std::string::npos)
+                    {
+                        size_t q_pos = item.find("q=", params);
+                        if (q_pos != std::string::npos)
+                            q = std::strtod(item.c_str() + q_pos + 2, nullptr);
+                        item.resize(params);
+                    }
+                    item.erase(0, item.find_first_not_of(" \t"));
+                    item.erase(item.find_last_not_of(" \t") + 1);
+                    if (q <= 0 || item.empty())
+                        continue;
+
+                    for (auto algo : algorithms)
+                    {
+                        // '*' stands for anything not listed, only our first choice is worth considering
+                        bool matches = item == "*" ? algo == algorithms.front() : utility::string_equals(item, content_encoding(algo));
+                        if (!matches) continue;
+                        // on equal q-values the earlier algorithm in our own list wins
+                        if (q > best_q || (q == best_q && std::find(algorithms.begin(), algorithms.end(), algo) < std::find(algorithms.begin(), algorithms.end(), chosen)))
+                        {
+                            best_q = q;
+                            chosen = algo;
+                        }
+                    }
+                }
+                return best_q > 0;
+            }
+        };
+
         inline std::string decompress_string(std::string const& deflated_string)
         {
             std::string inflated_string;
@@ -93,6 +291,25 @@ namespace crow
 
             return inflated_string;
         }
+
+#ifdef CROW_ENABLE_BROTLI
+        /// Compress a string with brotli in one shot, returns an empty string on failure.
+        /// The highest qualities are slow and best kept for content that is compressed once and served many times.
+        inline std::string compress_brotli(std::string const& str, int quality = BROTLI_DEFAULT_QUALITY)
+        {
+            std::string compressed_str(::BrotliEncoderMaxCompressedSize(str.size()), '\0');
+            if (compressed_str.empty())
+                return compressed_str;
+
+            size_t size = compressed_str.size();
+            if (::BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                                        str.size(), reinterpret_cast<const uint8_t*>(str.data()),
+                                        &size, reinterpret_cast<uint8_t*>(&compressed_str[0])) != BROTLI_TRUE)
+                size = 0;
+            compressed_str.resize(size);
+            return compressed_str;
+        }
+#endif
     } // namespace compression
 } // namespace crow
 
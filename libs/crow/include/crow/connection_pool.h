@@ -0,0 +1,240 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace crow
+{
+    /// Occupancy of the connection pools of a server, summed over its IO threads.
+    struct connection_pool_stats
+    {
+        /// Connections currently serving a socket, including the ones waiting in accept for the next socket
+        std::size_t active = 0;
+        /// Closed connections waiting to be reused
+        std::size_t idle = 0;
+        /// Connections allocated since the server started
+        std::size_t created = 0;
+        /// Accepted sockets that were given a reused connection
+        std::size_t reused = 0;
+        /// shared_ptr control blocks of connections taken from the heap, the others reused blocks freed before
+        std::size_t control_blocks = 0;
+    };
+
+    namespace detail
+    {
+        /// The counters of a connection_pool, which is only instantiated once a server accepts connections
+        class connection_pool_counters
+        {
+        public:
+            void add_stats(connection_pool_stats& stats) const
+            {
+                stats.active += active_;
+                stats.idle += idle_;
+                stats.created += created_;
+                stats.reused += reused_;
+                stats.control_blocks += control_blocks_;
+            }
+
+        protected:
+            std::atomic<std::size_t> active_{0};
+            std::atomic<std::size_t> idle_{0};
+            std::atomic<std::size_t> created_{0};
+            std::atomic<std::size_t> reused_{0};
+            std::atomic<std::size_t> control_blocks_{0};
+        };
+
+        /// Freed shared_ptr control blocks of the connections of one pool, and the mutex the pool guards its idle connections with.
+
+        ///
+        /// Sockets may be accepted on one thread while their connections are released on others,
+        /// so the blocks are shared by all the threads using the pool rather than kept per thread.
+        class control_block_cache : public connection_pool_counters
+        {
+        public:
+            control_block_cache() = default;
+            control_block_cache(const control_block_cache&) = delete;
+            control_block_cache& operator=(const control_block_cache&) = delete;
+
+            ~control_block_cache()
+            {
+                for (void* block : free_blocks_)
+                    ::operator delete(block);
+            }
+
+            /// A freed block of `size` bytes, or a new one
+            void* take(std::size_t size)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (size == block_size_ && !free_blocks_.empty())
+                    {
+                        void* block = free_blocks_.back();
+                        free_blocks_.pop_back();
+                        return block;
+                    }
+                }
+                control_blocks_++;
+                return ::operator new(size);
+            }
+
+            /// Keep a block of `size` bytes for the next `take()`, past `max_free` blocks it is freed
+            void give(void* block, std::size_t size) noexcept
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (block_size_ == 0)
+                        block_size_ = size;
+                    if (size == block_size_ && free_blocks_.size() < max_free)
+                    {
+                        try
+                        {
+                            free_blocks_.push_back(block);
+                            return;
+                        }
+                        catch (...)
+                        {}
+                    }
+                }
+                ::operator delete(block);
+            }
+
+        protected:
+            std::mutex mutex_;
+
+        private:
+            static constexpr std::size_t max_free = 1024;
+
+            std::size_t block_size_ = 0; ///< All control blocks of a pool have the same type, so the same size
+            std::vector<void*> free_blocks_;
+        };
+
+        /// Takes the shared_ptr control blocks of pooled connections from their pool's control_block_cache.
+
+        ///
+        /// The cache is held weakly, a control block outliving its pool is simply freed.
+        template<typename T>
+        struct recycling_allocator
+        {
+            using value_type = T;
+
+            explicit recycling_allocator(std::weak_ptr<control_block_cache> cache) noexcept:
+              cache_(std::move(cache))
+            {}
+            template<typename U>
+            recycling_allocator(const recycling_allocator<U>& other) noexcept:
+              cache_(other.cache())
+            {}
+
+            T* allocate(std::size_t n)
+            {
+                auto cache = cache_.lock();
+                if (n == 1 && cache)
+                    return static_cast<T*>(cache->take(sizeof(T)));
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            }
+
+            void deallocate(T* p, std::size_t n) noexcept
+            {
+                auto cache = cache_.lock();
+                if (n == 1 && cache)
+                    cache->give(p, sizeof(T));
+                else
+                    ::operator delete(p);
+            }
+
+            const std::weak_ptr<control_block_cache>& cache() const noexcept
+            {
+                return cache_;
+            }
+
+            template<typename U>
+            bool operator==(const recycling_allocator<U>& other) const noexcept { return !cache_.owner_before(other.cache()) && !other.cache().owner_before(cache_); }
+            template<typename U>
+            bool operator!=(const recycling_allocator<U>& other) const noexcept { return !(*this == other); }
+
+        private:
+            std::weak_ptr<control_block_cache> cache_;
+        };
+
+        /// Closed connections of one io_service kept for the next accepted socket, together with their buffers.
+
+        ///
+        /// A connection is handed out in a shared_ptr whose deleter resets it and puts it back instead of freeing it,
+        /// whichever thread lets go of it last. Past `max_idle` connections are freed as usual.
+        /// A connection let go of after its pool was destroyed is simply freed.
+        template<typename Connection>
+        class connection_pool : public control_block_cache, public std::enable_shared_from_this<connection_pool<Connection>>
+        {
+        public:
+            explicit connection_pool(std::size_t max_idle):
+              max_idle_(max_idle)
+            {}
+
+            connection_pool(const connection_pool&) = delete;
+            connection_pool& operator=(const connection_pool&) = delete;
+
+            /// A closed connection from the pool, or a new one constructed from the arguments.
+            /// All connections of a pool have to be constructed with the same arguments.
+            template<typename... Args>
+            std::shared_ptr<Connection> acquire(Args&&... args)
+            {
+                std::unique_ptr<Connection> connection;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (!idle_connections_.empty())
+                    {
+                        connection = std::move(idle_connections_.back());
+                        idle_connections_.pop_back();
+                        idle_--;
+                    }
+                }
+                if (connection)
+                    reused_++;
+                else
+                {
+                    connection.reset(new Connection(std::forward<Args>(args)...));
+                    created_++;
+                }
+                active_++;
+
+                // weak, an idle connection's enable_shared_from_this keeps its last control block (and so this deleter) alive
+                std::shared_ptr<connection_pool> self = this->shared_from_this();
+                std::weak_ptr<connection_pool> pool = self;
+                return std::shared_ptr<Connection>(
+                  connection.release(),
+                  [pool](Connection* released) {
+                      if (auto alive = pool.lock())
+                          alive->recycle(released);
+                      else
+                          delete released;
+                  },
+                  recycling_allocator<Connection>(std::shared_ptr<control_block_cache>(std::move(self))));
+            }
+
+        private:
+            void recycle(Connection* released)
+            {
+                active_--;
+                std::unique_ptr<Connection> connection(released);
+                if (max_idle_ == 0)
+                    return;
+
+                connection->reset();
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (idle_connections_.size() < max_idle_)
+                {
+                    idle_connections_.push_back(std::move(connection));
+                    idle_++;
+                }
+            }
+
+            std::size_t max_idle_;
+            std::vector<std::unique_ptr<Connection>> idle_connections_;
+        };
+    } // namespace detail
+} // namespace crow
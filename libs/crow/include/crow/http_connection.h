@@ -7,6 +7,17 @@
 #include <chrono>
 #include <vector>
 #include <memory>
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
 
 #include "crow/http_parser_merged.h"
 #include "crow/common.h"
@@ -19,7 +30,15 @@
 #include "crow/middleware.h"
 #include "crow/socket_adaptors.h"
 #include "crow/compression.h"
+#include "crow/worker_pool.h"
 #include "crow/utility.h"
+#include "crow/buffer_pool.h"
+#include "crow/http_range.h"
+
+// with the io_uring backend asio reads files through the ring as well, the IO threads never block on the disk
+#if defined(CROW_ENABLE_IO_URING) && defined(ASIO_HAS_FILE)
+#define CROW_IO_URING_FILES
+#endif
 
 namespace crow
 {
@@ -51,6 +70,9 @@ namespace crow
           parser_(this),
           req_(parser_.req),
           server_name_(server_name),
+#ifdef CROW_IO_URING_FILES
+          static_file_(io_service),
+#endif
           middlewares_(middlewares),
           get_cached_date_str(get_cached_date_str_f),
           task_timer_(task_timer),
@@ -71,6 +93,61 @@ namespace crow
 #endif
         }
 
+        /// Connections over plain sockets can be reset and reused for the next accepted socket, see detail::connection_pool.
+        static constexpr bool recyclable()
+        {
+            return std::is_same<Adaptor, SocketAdaptor>::value;
+        }
+
+        /// Put a connection nobody holds on to anymore back into the state it was constructed in,
+        /// the strings and vectors keep their capacity for the next socket.
+        void reset()
+        {
+            adaptor_.close();
+            http_parser_init(&parser_);
+            parser_.clear();
+            routing_handle_result_.reset();
+            res = response();
+            close_connection_ = false;
+            buffers_.clear();
+            content_length_.clear();
+            date_str_.clear();
+            res_body_copy_.clear();
+            res_shared_body_.reset();
+#ifdef CROW_ENABLE_COMPRESSION
+            stream_encoder_.reset();
+            stream_offset_ = 0;
+            stream_out_.clear();
+#endif
+            compressing_ = false;
+
+            static_transfer_ = false;
+            static_segments_.clear();
+            static_segment_ = 0;
+            static_remaining_ = 0;
+            static_progress_ = 0;
+#ifdef CROW_IO_URING_FILES
+            asio::error_code ec;
+            static_file_.close(ec);
+#else
+            static_file_.close();
+            static_file_.clear();
+#endif
+            static_buffer_.release();
+#ifdef __linux__
+            if (static_fd_ >= 0)
+                ::close(static_fd_);
+            static_fd_ = -1;
+            static_offset_ = 0;
+#endif
+
+            need_to_call_after_handlers_ = false;
+            need_to_start_read_after_complete_ = false;
+            add_keep_alive_ = false;
+
+            ctx_ = detail::context<Middlewares...>();
+        }
+
         /// The TCP socket on top of which the connection is established.
         decltype(std::declval<Adaptor>().raw_socket())& socket()
         {
@@ -182,8 +259,6 @@ namespace crow
                     };
                     need_to_call_after_handlers_ = true;
                     handler_->handle(req_, res, routing_handle_result_);
-                    if (add_keep_alive_)
-                        res.set_header("connection", "Keep-Alive");
                 }
                 else
                 {
@@ -214,33 +289,79 @@ namespace crow
                   decltype(*middlewares_)>({}, *middlewares_, ctx_, req_, res);
             }
 #ifdef CROW_ENABLE_COMPRESSION
-            if (handler_->compression_used())
+            stream_encoder_.reset();
+            if (handler_->compression_used() && res.compressed && !res.shared_body)
             {
-                std::string accept_encoding = req_.get_header_value("Accept-Encoding");
-                if (!accept_encoding.empty() && res.compressed)
+                auto& policy = handler_->compression_policy();
+                std::string content_type = res.get_header_value("Content-Type");
+                compression::algorithm algorithm;
+                if (policy.should_compress(content_type, res.body.size()) &&
+                    policy.negotiate(req_.get_header_value("Accept-Encoding"), algorithm))
                 {
-                    switch (handler_->compression_algorithm())
+                    int level = policy.level_for(content_type);
+                    res.set_header("Content-Encoding", compression::content_encoding(algorithm));
+                    if (res.get_header_value("Vary").empty())
+                        res.set_header("Vary", "Accept-Encoding");
+
+                    // large bodies are compressed a slice at a time while being sent, which needs chunked encoding.
+                    // this comes first, compressing them whole on a worker would need a second buffer of their size
+                    if (res.body.size() >= res_stream_threshold_ && !res.skip_body &&
+                        (req_.http_ver_major > 1 || (req_.http_ver_major == 1 && req_.http_ver_minor >= 1)))
                     {
-                        case compression::DEFLATE:
-                            if (accept_encoding.find("deflate") != std::string::npos)
-                            {
-                                res.body = compression::compress_string(res.body, compression::algorithm::DEFLATE);
-                                res.set_header("Content-Encoding", "deflate");
-                            }
-                            break;
-                        case compression::GZIP:
-                            if (accept_encoding.find("gzip") != std::string::npos)
-                            {
-                                res.body = compression::compress_string(res.body, compression::algorithm::GZIP);
-                                res.set_header("Content-Encoding", "gzip");
-                            }
-                            break;
-                        default:
-                            break;
+                        stream_encoder_.reset(new compression::encoder(algorithm, level));
+                        res.headers.erase("Content-Length");
+                        res.set_header("Transfer-Encoding", "chunked");
+                        res.manual_length_header = true;
+                    }
+                    else
+                    {
+                        if (res.body.size() >= policy.offload_size && offload_compression(algorithm, level))
+                            return;
+                        res.body = compression::compress_string(res.body, algorithm, level);
                     }
                 }
             }
 #endif
+            send_response();
+        }
+
+    private:
+#ifdef CROW_ENABLE_COMPRESSION
+        /// Hand the body to the compression workers, the response is sent from the connection's own io_service once it's done.
+        /// Returns false when there is no pool or its queue is full, the body then has to be compressed here.
+        bool offload_compression(compression::algorithm algorithm, int level)
+        {
+            auto pool = handler_->compression_pool();
+            if (!pool)
+                return false;
+
+            auto self = this->shared_from_this();
+            auto& io_service = adaptor_.get_io_service();
+            auto body = std::make_shared<std::string>(std::move(res.body));
+            compressing_ = true;
+            bool posted = pool->try_post([self, &io_service, body, algorithm, level] {
+                *body = compression::compress_string(*body, algorithm, level);
+                asio::post(io_service, [self, body] {
+                    self->compressing_ = false;
+                    self->res.body = std::move(*body);
+                    self->send_response();
+                });
+            });
+
+            if (!posted)
+            {
+                compressing_ = false;
+                res.body = std::move(*body);
+                return false;
+            }
+            // the timeout covers waiting on the client, not on our own workers
+            cancel_deadline_timer();
+            return true;
+        }
+#endif
+
+        void send_response()
+        {
             //if there is a redirection with a partial URL, treat the URL as a route.
             std::string location = res.get_header_value("Location");
             if (!location.empty() && location.find("://", 0) == std::string::npos)
@@ -254,6 +375,11 @@ namespace crow
                 res.set_header("location", location);
             }
 
+            if (res.is_static_type())
+            {
+                prepare_static_segments();
+            }
+
             prepare_buffers();
 
             if (res.is_static_type())
@@ -266,7 +392,6 @@ namespace crow
             }
         }
 
-    private:
         void prepare_buffers()
         {
             res.complete_request_handler_ = nullptr;
@@ -327,7 +452,7 @@ namespace crow
             static const std::string seperator = ": ";
 
             buffers_.clear();
-            buffers_.reserve(4 * (res.headers.size() + 5) + 3);
+            buffers_.reserve(4 * res.headers.size() + 8);
 
             if (!statusCodes.count(res.code))
             {
@@ -340,9 +465,13 @@ namespace crow
             auto& status = statusCodes.find(res.code)->second;
             buffers_.emplace_back(status.data(), status.size());
 
-            if (res.code >= 400 && res.body.empty())
+            if (res.code >= 400 && res.body_size() == 0)
                 res.body = statusCodes[res.code].substr(9);
 
+            // a cached response's headers go out as a single buffer, only the ones added for this request are written one by one
+            if (res.header_block)
+                buffers_.emplace_back(res.header_block->data.data(), res.header_block->data.size());
+
             for (auto& kv : res.headers)
             {
                 buffers_.emplace_back(kv.first.data(), kv.first.size());
@@ -351,15 +480,15 @@ namespace crow
                 buffers_.emplace_back(crlf.data(), crlf.size());
             }
 
+            // the per response lines are built in reused strings so each one costs a single buffer
             if (!res.manual_length_header && !res.headers.count("content-length"))
             {
-                content_length_ = std::to_string(res.body.size());
-                static std::string content_length_tag = "Content-Length: ";
-                buffers_.emplace_back(content_length_tag.data(), content_length_tag.size());
+                content_length_.assign("Content-Length: ");
+                content_length_ += std::to_string(res.body_size());
+                content_length_ += crlf;
                 buffers_.emplace_back(content_length_.data(), content_length_.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
             }
-            if (!res.headers.count("server"))
+            if (!res.headers.count("server") && !(res.header_block && res.header_block->has_server))
             {
                 static std::string server_tag = "Server: ";
                 buffers_.emplace_back(server_tag.data(), server_tag.size());
@@ -368,53 +497,359 @@ namespace crow
             }
             if (!res.headers.count("date"))
             {
-                static std::string date_tag = "Date: ";
-                date_str_ = get_cached_date_str();
-                buffers_.emplace_back(date_tag.data(), date_tag.size());
+                date_str_.assign("Date: ");
+                date_str_ += get_cached_date_str();
+                date_str_ += crlf;
                 buffers_.emplace_back(date_str_.data(), date_str_.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
             }
             if (add_keep_alive_)
             {
-                static std::string keep_alive_tag = "Connection: Keep-Alive";
-                buffers_.emplace_back(keep_alive_tag.data(), keep_alive_tag.size());
-                buffers_.emplace_back(crlf.data(), crlf.size());
+                static std::string keep_alive_line = "Connection: Keep-Alive\r\n";
+                buffers_.emplace_back(keep_alive_line.data(), keep_alive_line.size());
             }
 
             buffers_.emplace_back(crlf.data(), crlf.size());
         }
 
+        void add_static_segment(std::string prefix, uint64_t offset, uint64_t length)
+        {
+            static_segments_.emplace_back();
+            static_segments_.back().prefix = std::move(prefix);
+            static_segments_.back().offset = offset;
+            static_segments_.back().length = length;
+        }
+
+        /// Work out which parts of the file are sent, narrowing the response down to the requested byte ranges (RFC 7233).
+        /// Several ranges become a multipart/byteranges body whose part headers are written between the file segments.
+        void prepare_static_segments()
+        {
+            static_segments_.clear();
+            if (res.skip_body)
+                return;
+
+            auto size = static_cast<uint64_t>(res.file_info.statbuf.st_size);
+            // readers can't seek, and only a plain successful GET may be answered partially
+            if (res.file_info.reader != nullptr || res.file_info.statResult != 0 || res.code != 200 || req_.method != HTTPMethod::Get)
+            {
+                add_static_segment({}, 0, size);
+                return;
+            }
+
+            std::string range = req_.get_header_value("Range");
+            std::string if_range = req_.get_header_value("If-Range");
+            // a validator which no longer matches means the client's copy is outdated and needs the whole file
+            if (range.empty() ||
+                (!if_range.empty() && if_range != res.get_header_value("ETag") && if_range != res.get_header_value("Last-Modified")))
+            {
+                add_static_segment({}, 0, size);
+                return;
+            }
+
+            std::vector<byte_range> ranges;
+            switch (detail::parse_range(range, size, ranges))
+            {
+                case detail::range_result::ignore:
+                    add_static_segment({}, 0, size);
+                    return;
+                case detail::range_result::unsatisfiable:
+                    res.code = status::RANGE_NOT_SATISFIABLE;
+                    res.file_info.path.clear();
+                    res.headers.erase("Content-Length");
+                    res.set_header("Content-Type", "text/plain");
+                    res.set_header("Content-Range", "bytes */" + std::to_string(size));
+                    return;
+                case detail::range_result::satisfiable:
+                    break;
+            }
+
+            res.code = status::PARTIAL_CONTENT;
+            if (ranges.size() == 1)
+            {
+                auto& r = ranges.front();
+                res.set_header("Content-Range", "bytes " + std::to_string(r.first) + '-' + std::to_string(r.last) + '/' + std::to_string(size));
+                res.set_header("Content-Length", std::to_string(r.length()));
+                add_static_segment({}, r.first, r.length());
+                return;
+            }
+
+            static thread_local std::mt19937_64 generator{std::random_device{}()};
+            char boundary[17];
+            snprintf(boundary, sizeof(boundary), "%016llx", static_cast<unsigned long long>(generator()));
+
+            std::string content_type = res.get_header_value("Content-Type");
+            uint64_t length = 0;
+            for (auto& r : ranges)
+            {
+                std::string part = "\r\n--";
+                part += boundary;
+                if (!content_type.empty())
+                    part += "\r\nContent-Type: " + content_type;
+                part += "\r\nContent-Range: bytes " + std::to_string(r.first) + '-' + std::to_string(r.last) + '/' + std::to_string(size) + "\r\n\r\n";
+                length += part.size() + r.length();
+                add_static_segment(std::move(part), r.first, r.length());
+            }
+            std::string end = "\r\n--";
+            end += boundary;
+            end += "--\r\n";
+            length += end.size();
+            add_static_segment(std::move(end), 0, 0);
+
+            res.set_header("Content-Type", std::string("multipart/byteranges; boundary=") + boundary);
+            res.set_header("Content-Length", std::to_string(length));
+        }
+
+        /// Send the headers followed by the file segments without blocking the IO thread on a slow client.
+        /// Plain TCP connections on linux hand the file to the kernel with sendfile(2), everything else goes through
+        /// pooled buffers one chunk at a time. Reading stops until the transfer is done, so responses can't interleave.
         void do_write_static()
         {
-            asio::write(adaptor_.socket(), buffers_);
-            
-            if (res.file_info.statResult == 0 && res.file_info.reader == nullptr)
+            static_transfer_ = true;
+            static_progress_ = 0;
+            static_remaining_ = 0;
+            static_segment_ = 0;
+
+            bool has_file_data = std::any_of(static_segments_.begin(), static_segments_.end(), [](const static_segment& segment) {
+                return segment.length > 0;
+            });
+            if (has_file_data && res.file_info.reader == nullptr)
             {
-                std::ifstream is(res.file_info.path.c_str(), std::ios::in | std::ios::binary);
-                std::vector<asio::const_buffer> buffers{1};
-                char buf[16384];
-                is.read(buf, sizeof(buf));
-                while (is.gcount() > 0)
+#ifdef __linux__
+                if (use_sendfile())
                 {
-                    buffers[0] = asio::buffer(buf, is.gcount());
-                    do_write_sync(buffers);
-                    is.read(buf, sizeof(buf));
+                    static_fd_ = ::open(res.file_info.path.c_str(), O_RDONLY | O_CLOEXEC);
+                }
+                else
+#endif
+                {
+#ifdef CROW_IO_URING_FILES
+                    asio::error_code ec;
+                    static_file_.open(res.file_info.path, asio::random_access_file::read_only, ec);
+#else
+                    static_file_.open(res.file_info.path.c_str(), std::ios::in | std::ios::binary);
+#endif
                 }
-            } else if (res.file_info.reader != nullptr)
+            }
+
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), buffers_,
+              [self](const asio::error_code& ec, std::size_t bytes_transferred) {
+                  if (ec)
+                  {
+                      CROW_LOG_DEBUG << self << " from write (static)(1)";
+                      self->finish_static(false);
+                      return;
+                  }
+                  self->static_progress_ += bytes_transferred;
+                  self->continue_static();
+              });
+        }
+
+        void continue_static()
+        {
+            if (static_remaining_ > 0)
             {
-                std::vector<asio::const_buffer> buffers{1};
-                char buf[16384];
-                res.file_info.reader->read(buf, sizeof(buf));
-                while (res.file_info.reader->gcount() > 0)
+#ifdef __linux__
+                if (static_fd_ >= 0)
                 {
-                    buffers[0] = asio::buffer(buf, res.file_info.reader->gcount());
-                    do_write_sync(buffers);
-                    res.file_info.reader->read(buf, sizeof(buf));
+                    do_sendfile();
+                    return;
                 }
+#endif
+                do_write_static_chunk();
+                return;
             }
-            if (close_connection_)
+
+            if (static_segment_ == static_segments_.size())
+            {
+                finish_static(true);
+                return;
+            }
+
+            auto& segment = static_segments_[static_segment_++];
+            static_remaining_ = segment.length;
+            if (segment.length > 0 && res.file_info.reader == nullptr)
+            {
+#ifdef __linux__
+                static_offset_ = static_cast<off_t>(segment.offset);
+#endif
+#ifndef CROW_IO_URING_FILES
+                if (static_file_.is_open())
+                    static_file_.seekg(static_cast<std::streamoff>(segment.offset));
+#endif
+            }
+
+            if (segment.prefix.empty())
+            {
+                continue_static();
+                return;
+            }
+
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), asio::buffer(segment.prefix),
+              [self](const asio::error_code& ec, std::size_t bytes_transferred) {
+                  if (ec)
+                  {
+                      CROW_LOG_DEBUG << self << " from write (static)(4)";
+                      self->finish_static(false);
+                      return;
+                  }
+                  self->static_progress_ += bytes_transferred;
+                  self->continue_static();
+              });
+        }
+
+        static constexpr bool use_sendfile()
+        {
+#if defined(__linux__) && !defined(CROW_DISABLE_SENDFILE)
+            return std::is_same<Adaptor, SocketAdaptor>::value;
+#else
+            return false;
+#endif
+        }
+
+#ifdef __linux__
+        void do_sendfile()
+        {
+            auto& socket = adaptor_.raw_socket();
+            asio::error_code ec;
+            socket.native_non_blocking(true, ec);
+            if (ec)
+            {
+                finish_static(false);
+                return;
+            }
+
+            // bounded so one fast client can't keep the IO thread to itself
+            uint64_t budget = 4 * 1024 * 1024;
+            while (static_remaining_ > 0 && budget > 0)
+            {
+                auto chunk = static_cast<size_t>(std::min<uint64_t>(static_remaining_, budget));
+                ssize_t sent = ::sendfile(socket.native_handle(), static_fd_, &static_offset_, chunk);
+                if (sent > 0)
+                {
+                    static_remaining_ -= sent;
+                    static_progress_ += sent;
+                    budget -= sent;
+                    continue;
+                }
+                if (sent < 0 && errno == EINTR) continue;
+
+                auto self = this->shared_from_this();
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    socket.async_wait(tcp::socket::wait_write, [self](const asio::error_code& ec) {
+                        if (ec)
+                            self->finish_static(false);
+                        else
+                            self->do_sendfile();
+                    });
+                    return;
+                }
+
+                // the file shrank or the socket failed, the promised Content-Length can't be kept
+                CROW_LOG_DEBUG << this << " from write (sendfile): " << (sent < 0 ? std::strerror(errno) : "unexpected end of file");
+                finish_static(false);
+                return;
+            }
+
+            if (static_remaining_ == 0)
+            {
+                continue_static();
+                return;
+            }
+            auto self = this->shared_from_this();
+            asio::post(adaptor_.get_io_service(), [self] {
+                self->do_sendfile();
+            });
+        }
+#endif
+
+        void do_write_static_chunk()
+        {
+            if (!static_buffer_) static_buffer_ = detail::pooled_buffer::acquire();
+
+            auto want = static_cast<size_t>(std::min<uint64_t>(static_remaining_, detail::pooled_buffer::size));
+            size_t got = 0;
+            if (res.file_info.reader != nullptr)
+            {
+                res.file_info.reader->read(static_buffer_.data(), want);
+                got = res.file_info.reader->gcount();
+            }
+            else
+            {
+#ifdef CROW_IO_URING_FILES
+                auto self = this->shared_from_this();
+                static_file_.async_read_some_at(
+                  static_cast<uint64_t>(static_offset_), asio::buffer(static_buffer_.data(), want),
+                  [self](const asio::error_code& ec, std::size_t bytes_read) {
+                      if (ec && ec != asio::error::eof)
+                      {
+                          CROW_LOG_DEBUG << self << " from read (static): " << ec.message();
+                          self->finish_static(false);
+                          return;
+                      }
+                      self->static_offset_ += static_cast<off_t>(bytes_read);
+                      self->write_static_chunk(bytes_read);
+                  });
+                return;
+#else
+                static_file_.read(static_buffer_.data(), want);
+                got = static_cast<size_t>(static_file_.gcount());
+#endif
+            }
+            write_static_chunk(got);
+        }
+
+        void write_static_chunk(size_t got)
+        {
+            if (got == 0)
+            {
+                CROW_LOG_DEBUG << this << " from write (static)(2): unexpected end of file";
+                finish_static(false);
+                return;
+            }
+            static_remaining_ -= std::min<uint64_t>(got, static_remaining_);
+
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), asio::buffer(static_buffer_.data(), got),
+              [self](const asio::error_code& ec, std::size_t bytes_transferred) {
+                  if (ec)
+                  {
+                      CROW_LOG_DEBUG << self << " from write (static)(3)";
+                      self->finish_static(false);
+                      return;
+                  }
+                  self->static_progress_ += bytes_transferred;
+                  self->continue_static();
+              });
+        }
+
+        void finish_static(bool success)
+        {
+#ifdef __linux__
+            if (static_fd_ >= 0)
+            {
+                ::close(static_fd_);
+                static_fd_ = -1;
+            }
+#endif
+#ifdef CROW_IO_URING_FILES
+            asio::error_code ec;
+            static_file_.close(ec);
+#else
+            static_file_.close();
+            static_file_.clear();
+#endif
+            static_buffer_.release();
+            static_segments_.clear();
+            static_remaining_ = 0;
+            static_transfer_ = false;
+
+            if (!success || close_connection_)
             {
-                std::cout << "closing connection!\n";
                 adaptor_.shutdown_readwrite();
                 adaptor_.close();
                 CROW_LOG_DEBUG << this << " from write (static)";
@@ -424,14 +859,30 @@ namespace crow
             res.clear();
             buffers_.clear();
             parser_.clear();
+
+            if (need_to_start_read_after_complete_ && adaptor_.is_open())
+            {
+                need_to_start_read_after_complete_ = false;
+                start_deadline();
+                do_read();
+            }
         }
 
         void do_write_general()
         {
-            if (res.body.length() < res_stream_threshold_)
+            // a shared body is kept alive by the connection until it is written, so it never needs to be streamed or copied
+            if (res.shared_body || res.body.length() < res_stream_threshold_)
             {
-                res_body_copy_.swap(res.body);
-                buffers_.emplace_back(res_body_copy_.data(), res_body_copy_.size());
+                if (res.shared_body)
+                {
+                    res_shared_body_ = std::move(res.shared_body);
+                    buffers_.emplace_back(res_shared_body_->data(), res_shared_body_->size());
+                }
+                else
+                {
+                    res_body_copy_.swap(res.body);
+                    buffers_.emplace_back(res_body_copy_.data(), res_body_copy_.size());
+                }
 
                 do_write();
 
@@ -442,33 +893,28 @@ namespace crow
                     do_read();
                 }
             }
+#ifdef CROW_ENABLE_COMPRESSION
+            else if (stream_encoder_)
+            {
+                // the headers go out with the first chunk
+                compressing_ = true;
+                stream_offset_ = 0;
+                write_compressed_chunk();
+            }
+#endif
             else
             {
                 asio::write(adaptor_.socket(), buffers_); // Write the response start / headers
                 cancel_deadline_timer();
-                if (res.body.length() > 0)
+                // written straight out of the body, 16KB at a time
+                std::vector<asio::const_buffer> buffers;
+                for (size_t offset = 0; offset < res.body.size(); offset += 16384)
                 {
-                    std::string buf;
-                    std::vector<asio::const_buffer> buffers;
-
-                    while (res.body.length() > 16384)
-                    {
-                        //buf.reserve(16385);
-                        buf = res.body.substr(0, 16384);
-                        res.body = res.body.substr(16384);
-                        buffers.clear();
-                        buffers.push_back(asio::buffer(buf));
-                        do_write_sync(buffers);
-                    }
-                    // Collect whatever is left (less than 16KB) and send it down the socket
-                    // buf.reserve(is.length());
-                    buf = res.body;
-                    res.body.clear();
-
                     buffers.clear();
-                    buffers.push_back(asio::buffer(buf));
+                    buffers.emplace_back(res.body.data() + offset, std::min<size_t>(16384, res.body.size() - offset));
                     do_write_sync(buffers);
                 }
+                res.body.clear();
                 if (close_connection_)
                 {
                     adaptor_.shutdown_readwrite();
@@ -483,6 +929,89 @@ namespace crow
             }
         }
 
+#ifdef CROW_ENABLE_COMPRESSION
+        /// Compress the body a slice at a time until there is output, then send it as a chunk after whatever is already in `buffers_`.
+        /// The next slice is compressed once the socket took this chunk, so memory stays bounded by the slice
+        /// instead of the compressed size of the whole body and the IO thread never waits on a slow client.
+        void write_compressed_chunk()
+        {
+            static const std::string last_chunk = "0\r\n\r\n";
+
+            bool finished = false;
+            stream_out_.clear();
+            while (stream_out_.empty() && !finished)
+            {
+                size_t size = std::min<size_t>(64 * 1024, res.body.size() - stream_offset_);
+                finished = stream_offset_ + size == res.body.size();
+                if (!stream_encoder_->write(res.body.data() + stream_offset_, size, finished, stream_out_))
+                {
+                    // the length was never promised, cutting the connection is the only way to signal a broken body
+                    CROW_LOG_ERROR << this << " compression failed while streaming the response";
+                    finish_compressed_stream(false);
+                    return;
+                }
+                stream_offset_ += size;
+            }
+
+            if (!stream_out_.empty())
+            {
+                int line = snprintf(stream_size_line_, sizeof(stream_size_line_), "%zx\r\n", stream_out_.size());
+                buffers_.emplace_back(stream_size_line_, static_cast<size_t>(line));
+                buffers_.emplace_back(stream_out_.data(), stream_out_.size());
+                buffers_.emplace_back(crlf.data(), crlf.size());
+            }
+            if (finished)
+                buffers_.emplace_back(last_chunk.data(), last_chunk.size());
+
+            // every chunk gets the full timeout, only a client that stops reading is cut off
+            schedule_deadline();
+            auto self = this->shared_from_this();
+            asio::async_write(
+              adaptor_.socket(), buffers_,
+              [self, finished](const asio::error_code& ec, std::size_t /*bytes_transferred*/) {
+                  self->buffers_.clear();
+                  if (ec)
+                  {
+                      CROW_LOG_DEBUG << self << " from write (compressed stream)";
+                      self->finish_compressed_stream(false);
+                  }
+                  else if (finished)
+                      self->finish_compressed_stream(true);
+                  else
+                      self->write_compressed_chunk();
+              });
+        }
+
+        void finish_compressed_stream(bool success)
+        {
+            stream_encoder_.reset();
+            stream_offset_ = 0;
+            stream_out_.clear();
+            compressing_ = false;
+
+            if (!success || close_connection_)
+            {
+                adaptor_.shutdown_readwrite();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (res_stream)";
+            }
+
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+
+            if (need_to_start_read_after_complete_ && adaptor_.is_open())
+            {
+                need_to_start_read_after_complete_ = false;
+                start_deadline();
+                do_read();
+            }
+            else
+                cancel_deadline_timer();
+        }
+#endif
+
         void do_read()
         {
             auto self = this->shared_from_this();
@@ -513,14 +1042,14 @@ namespace crow
                       self->parser_.done();
                       // adaptor will close after write
                   }
-                  else if (!self->need_to_call_after_handlers_)
+                  else if (!self->need_to_call_after_handlers_ && !self->static_transfer_ && !self->compressing_)
                   {
                       self->start_deadline();
                       self->do_read();
                   }
                   else
                   {
-                      // res will be completed later by user
+                      // res will be completed later by user, or a static file is still being sent, or the body is still being compressed
                       self->need_to_start_read_after_complete_ = true;
                   }
               });
@@ -534,6 +1063,7 @@ namespace crow
               [self](const asio::error_code& ec, std::size_t /*bytes_transferred*/) {
                   self->res.clear();
                   self->res_body_copy_.clear();
+                  self->res_shared_body_.reset();
                   self->parser_.clear();
                   if (!ec)
                   {
@@ -569,24 +1099,41 @@ namespace crow
 
         void cancel_deadline_timer()
         {
-            CROW_LOG_DEBUG << this << " timer cancelled: " << &task_timer_ << ' ' << task_id_;
-            task_timer_.cancel(task_id_);
+            CROW_LOG_DEBUG << this << " timer cancelled: " << &task_timer_;
+            task_timer_.cancel(deadline_);
+            deadline_.owner.reset();
         }
 
         void start_deadline(/*int timeout = 5*/)
         {
-            cancel_deadline_timer();
+            // scheduling moves the deadline if it is already set
+            schedule_deadline();
+        }
 
-            auto self = this->shared_from_this();
-            task_id_ = task_timer_.schedule([self] {
-                if (!self->adaptor_.is_open())
-                {
-                    return;
-                }
-                self->adaptor_.shutdown_readwrite();
-                self->adaptor_.close();
-            });
-            CROW_LOG_DEBUG << this << " timer added: " << &task_timer_ << ' ' << task_id_;
+        void schedule_deadline()
+        {
+            deadline_.owner = this->shared_from_this();
+            deadline_.callback = &Connection::on_deadline;
+            task_timer_.schedule(deadline_);
+            CROW_LOG_DEBUG << this << " timer added: " << &task_timer_;
+        }
+
+        static void on_deadline(detail::timer_node& node, bool expired)
+        {
+            auto self = std::move(static_cast<deadline_node&>(node).owner);
+            if (!expired || !self->adaptor_.is_open())
+            {
+                return;
+            }
+            // a static file transfer that is still moving isn't idle, only a stalled one times out
+            if (self->static_transfer_ && self->static_progress_ > 0)
+            {
+                self->static_progress_ = 0;
+                self->schedule_deadline();
+                return;
+            }
+            self->adaptor_.shutdown_readwrite();
+            self->adaptor_.close();
         }
 
     private:
@@ -608,8 +1155,49 @@ namespace crow
         std::string content_length_;
         std::string date_str_;
         std::string res_body_copy_;
+        std::shared_ptr<const std::string> res_shared_body_;
+#ifdef CROW_ENABLE_COMPRESSION
+        std::unique_ptr<compression::encoder> stream_encoder_;
+        // state of the compressed body being sent in chunks
+        size_t stream_offset_{};
+        std::string stream_out_;
+        char stream_size_line_[24];
+#endif
+        // the body is with the compression workers, or being compressed chunk by chunk while it is sent
+        bool compressing_{};
+
+        // state of the static file response being sent
+        struct static_segment
+        {
+            // written ahead of the file data, holds the part headers of multipart/byteranges responses
+            std::string prefix;
+            uint64_t offset;
+            uint64_t length;
+        };
+        bool static_transfer_{};
+        std::vector<static_segment> static_segments_;
+        size_t static_segment_{};
+        // file bytes left in the current segment
+        uint64_t static_remaining_{};
+        // bytes written since the deadline last checked in
+        uint64_t static_progress_{};
+#ifdef CROW_IO_URING_FILES
+        asio::random_access_file static_file_;
+#else
+        std::ifstream static_file_;
+#endif
+        detail::pooled_buffer static_buffer_;
+#ifdef __linux__
+        int static_fd_ = -1;
+        off_t static_offset_{};
+#endif
 
-        detail::task_timer::identifier_type task_id_{};
+        // the keep-alive / idle timeout, holds on to the connection while it's scheduled
+        struct deadline_node : detail::timer_node
+        {
+            std::shared_ptr<Connection> owner;
+        };
+        deadline_node deadline_;
 
         bool need_to_call_after_handlers_{};
         bool need_to_start_read_after_complete_{};
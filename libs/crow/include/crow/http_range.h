@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace crow
+{
+    /// An inclusive range of bytes in a representation, as used by the Range and Content-Range headers.
+    struct byte_range
+    {
+        uint64_t first;
+        uint64_t last;
+
+        uint64_t length() const { return last - first + 1; }
+    };
+
+    namespace detail
+    {
+        enum class range_result
+        {
+            /// No usable Range header, the full representation should be sent
+            ignore,
+            /// At least one range can be served
+            satisfiable,
+            /// The header is valid but none of its ranges overlap the representation (416)
+            unsatisfiable,
+        };
+
+        // more ranges than this (after merging) can't come from a reasonable client and are answered with the full file
+        constexpr size_t max_byte_ranges = 32;
+
+        inline bool parse_range_number(const std::string& s, size_t begin, size_t end, uint64_t& out)
+        {
+            if (begin >= end) return false;
+            out = 0;
+            for (size_t i = begin; i < end; i++)
+            {
+                if (s[i] < '0' || s[i] > '9') return false;
+                uint64_t digit = static_cast<uint64_t>(s[i] - '0');
+                if (out > (UINT64_MAX - digit) / 10) return false;
+                out = out * 10 + digit;
+            }
+            return true;
+        }
+
+        /// Parse a `bytes=` Range header against a representation of `size` bytes (RFC 7233 section 2.1).
+        /// Satisfiable ranges are clamped to the representation, sorted, and overlapping or adjacent ones are merged.
+        inline range_result parse_range(const std::string& header, uint64_t size, std::vector<byte_range>& ranges)
+        {
+            ranges.clear();
+
+            static const std::string unit = "bytes=";
+            if (header.size() <= unit.size() ||
+                !std::equal(unit.begin(), unit.end(), header.begin(), [](char a, char b) {
+                    return a == std::tolower(static_cast<unsigned char>(b));
+                }))
+                return range_result::ignore;
+
+            bool any_spec = false;
+            size_t pos = unit.size();
+            while (pos <= header.size())
+            {
+                size_t end = header.find(',', pos);
+                if (end == std::string::npos) end = header.size();
+
+                size_t begin = pos;
+                size_t stop = end;
+                while (begin < stop && (header[begin] == ' ' || header[begin] == '\t'))
+                    begin++;
+                while (stop > begin && (header[stop - 1] == ' ' || header[stop - 1] == '\t'))
+                    stop--;
+                pos = end + 1;
+
+                // empty list elements are allowed by the grammar
+                if (begin == stop) continue;
+                any_spec = true;
+
+                size_t dash = header.find('-', begin);
+                if (dash == std::string::npos || dash >= stop) return range_result::ignore;
+
+                uint64_t first = 0, last = 0;
+                if (dash == begin)
+                {
+                    // suffix range, the last n bytes
+                    if (!parse_range_number(header, dash + 1, stop, last)) return range_result::ignore;
+                    if (last == 0 || size == 0) continue;
+                    ranges.push_back({size - std::min(last, size), size - 1});
+                    continue;
+                }
+
+                if (!parse_range_number(header, begin, dash, first)) return range_result::ignore;
+                if (dash + 1 == stop)
+                    last = UINT64_MAX;
+                else if (!parse_range_number(header, dash + 1, stop, last) || last < first)
+                    return range_result::ignore;
+
+                if (first >= size) continue;
+                ranges.push_back({first, std::min(last, size - 1)});
+            }
+
+            if (!any_spec)
+                return range_result::ignore;
+            if (ranges.empty())
+                return range_result::unsatisfiable;
+
+            std::sort(ranges.begin(), ranges.end(), [](const byte_range& a, const byte_range& b) {
+                return a.first < b.first;
+            });
+            size_t merged = 0;
+            for (size_t i = 1; i < ranges.size(); i++)
+            {
+                if (ranges[i].first <= ranges[merged].last + 1)
+                    ranges[merged].last = std::max(ranges[merged].last, ranges[i].last);
+                else
+                    ranges[++merged] = ranges[i];
+            }
+            ranges.resize(merged + 1);
+
+            if (ranges.size() > max_byte_ranges)
+            {
+                ranges.clear();
+                return range_result::ignore;
+            }
+            return range_result::satisfiable;
+        }
+    } // namespace detail
+} // namespace crow
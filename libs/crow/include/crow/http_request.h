@@ -8,6 +8,8 @@
 #include "crow/common.h"
 #include "crow/ci_map.h"
 #include "crow/query_string.h"
+#include "crow/request_arena.h"
+#include "crow/request_headers.h"
 
 namespace crow
 {
@@ -30,7 +32,7 @@ namespace crow
         std::string raw_url;     ///< The full URL containing the `?` and URL parameters.
         std::string url;         ///< The endpoint without any parameters.
         query_string url_params; ///< The parameters associated with the request. (everything after the `?` in the URL)
-        ci_map headers;
+        request_headers headers;
         std::string body;
         std::string remote_ip_address; ///< The IP address from which the request was sent.
         unsigned char http_ver_major, http_ver_minor;
@@ -41,6 +43,7 @@ namespace crow
         void* middleware_context{};
         void* middleware_container{};
         asio::io_service* io_service{};
+        mutable request_arena arena; ///< Memory for the handler's own data, released together once the response is sent. (see `crow::arena_allocator`)
 
         /// Construct an empty request. (sets the method to `GET`)
         request():
@@ -49,7 +52,7 @@ namespace crow
 
         /// Construct a request with all values assigned.
         request(HTTPMethod method, std::string raw_url, std::string url, query_string url_params, ci_map headers, std::string body, unsigned char http_major, unsigned char http_minor, bool has_keep_alive, bool has_close_connection, bool is_upgrade):
-          method(method), raw_url(std::move(raw_url)), url(std::move(url)), url_params(std::move(url_params)), headers(std::move(headers)), body(std::move(body)), http_ver_major(http_major), http_ver_minor(http_minor), keep_alive(has_keep_alive), close_connection(has_close_connection), upgrade(is_upgrade)
+          method(method), raw_url(std::move(raw_url)), url(std::move(url)), url_params(std::move(url_params)), headers(headers), body(std::move(body)), http_ver_major(http_major), http_ver_minor(http_minor), keep_alive(has_keep_alive), close_connection(has_close_connection), upgrade(is_upgrade)
         {}
 
         void add_header(std::string key, std::string value)
@@ -62,6 +65,36 @@ namespace crow
             return crow::get_header_value(headers, key);
         }
 
+        const std::string& get_header_value(const char* key) const
+        {
+            auto found = headers.find(key);
+            if (found != headers.end())
+                return found->second;
+            static std::string empty;
+            return empty;
+        }
+
+        /// Forget everything about the request, the strings and the arena keep their memory for the next request on the connection.
+        void clear()
+        {
+            method = HTTPMethod::Get;
+            raw_url.clear();
+            url.clear();
+            url_params.clear();
+            headers.clear();
+            body.clear();
+            // an upload shouldn't stay allocated for as long as the connection
+            if (body.capacity() > 64 * 1024)
+                std::string().swap(body);
+            remote_ip_address.clear();
+            http_ver_major = http_ver_minor = 0;
+            keep_alive = close_connection = upgrade = false;
+            middleware_context = nullptr;
+            middleware_container = nullptr;
+            io_service = nullptr;
+            arena.reset();
+        }
+
         bool check_version(unsigned char major, unsigned char minor) const
         {
             return http_ver_major == major && http_ver_minor == minor;
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <memory>
 #include <unordered_map>
 #include <ios>
 #include <fstream>
@@ -30,6 +31,20 @@ namespace crow
 
     class Router;
 
+    template<typename... Middlewares>
+    class Crow;
+
+    /// Header lines serialized once ("Name: value\r\n" each), for responses which are sent over and over with the same headers.
+    ///
+    /// Content-Length and Date are left out since they're written for every response anyway.
+    struct serialized_headers
+    {
+        std::string data;
+        bool has_server = false;
+
+        explicit serialized_headers(const ci_map& headers);
+    };
+
     /// HTTP response
     struct response
     {
@@ -38,9 +53,18 @@ namespace crow
 
         friend class Router;
 
+        template<typename... Middlewares>
+        friend class Crow;
+
         int code{200};    ///< The Status code for the response.
         std::string body; ///< The actual payload containing the response data.
         ci_map headers;   ///< HTTP headers.
+        /// Pre-serialized headers written ahead of `headers`, share one between every copy of a cached response.
+        /// The headers in it are not visible through get_header_value.
+        std::shared_ptr<const serialized_headers> header_block;
+        /// A body that is never modified, sent in place of `body` without being copied. Share one between every copy of a cached response.
+        /// It is sent as it is, never compressed, so set Content-Encoding yourself for a precompressed body.
+        std::shared_ptr<const std::string> shared_body;
 
 #ifdef CROW_ENABLE_COMPRESSION
         bool compressed = true; ///< If compression is enabled and this is false, the individual response will not be compressed.
@@ -126,6 +150,8 @@ namespace crow
             body = std::move(r.body);
             code = r.code;
             headers = std::move(r.headers);
+            header_block = std::move(r.header_block);
+            shared_body = std::move(r.shared_body);
             completed_ = r.completed_;
             file_info = std::move(r.file_info);
             return *this;
@@ -139,6 +165,12 @@ namespace crow
 
         void clear();
 
+        /// The size of the body that is sent, `shared_body` if there is one
+        size_t body_size() const
+        {
+            return shared_body ? shared_body->size() : body.size();
+        }
+
         /// Return a "Temporary Redirect" response.
 
         ///
@@ -234,6 +266,9 @@ namespace crow
         /// Return a static file as the response body without sanitizing the path (use set_static_file_info instead)
         void set_static_file_info_unsafe(std::string path);
 
+        /// The entity tag static files are sent with, derived from the modification time and size.
+        static std::string static_file_etag(const struct stat& statbuf);
+
     private:
         bool completed_{};
         std::function<void()> complete_request_handler_;
@@ -14,10 +14,16 @@
 #include <vector>
 #include <memory>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "crow/version.h"
 #include "crow/http_connection.h"
 #include "crow/logging.h"
 #include "crow/task_timer.h"
+#include "crow/connection_pool.h"
 
 namespace crow
 {
@@ -26,9 +32,11 @@ namespace crow
     template<typename Handler, typename Adaptor = SocketAdaptor, typename... Middlewares>
     class Server
     {
+        using connection_type = Connection<Adaptor, Handler, Middlewares...>;
+
     public:
-        Server(Handler* handler, std::string bindaddr, uint16_t port, std::string server_name = std::string("Crow/") + VERSION, std::tuple<Middlewares...>* middlewares = nullptr, uint16_t concurrency = 1, uint8_t timeout = 5, typename Adaptor::context* adaptor_ctx = nullptr):
-          acceptor_(io_service_, tcp::endpoint(asio::ip::address::from_string(bindaddr), port)),
+        Server(Handler* handler, std::string bindaddr, uint16_t port, std::string server_name = std::string("Crow/") + VERSION, std::tuple<Middlewares...>* middlewares = nullptr, uint16_t concurrency = 1, uint8_t timeout = 5, typename Adaptor::context* adaptor_ctx = nullptr, bool reuse_port = false):
+          acceptor_(io_service_),
           signals_(io_service_),
           tick_timer_(io_service_),
           handler_(handler),
@@ -40,7 +48,25 @@ namespace crow
           task_queue_length_pool_(concurrency_ - 1),
           middlewares_(middlewares),
           adaptor_ctx_(adaptor_ctx)
-        {}
+        {
+#ifdef SO_REUSEPORT
+            reuse_port_ = reuse_port;
+#else
+            if (reuse_port)
+                CROW_LOG_WARNING << "SO_REUSEPORT is not supported on this platform, connections are accepted on a single thread";
+#endif
+            tcp::endpoint endpoint(asio::ip::address::from_string(bindaddr), port);
+            acceptor_.open(endpoint.protocol());
+            acceptor_.set_option(tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+            // the main acceptor only holds the port (and resolves port 0), the IO threads listen on their own sockets
+            if (reuse_port_)
+                acceptor_.set_option(reuse_port_option(true));
+#endif
+            acceptor_.bind(endpoint);
+            if (!reuse_port_)
+                acceptor_.listen();
+        }
 
         void set_tick_function(std::chrono::milliseconds d, std::function<void()> f)
         {
@@ -48,6 +74,22 @@ namespace crow
             tick_function_ = f;
         }
 
+        /// How many closed connections each IO thread keeps for reuse, 0 disables pooling. Takes effect on the next run().
+        void set_max_idle_connections(std::size_t max_idle)
+        {
+            max_idle_connections_ = max_idle;
+        }
+
+        /// Occupancy of the connection pools, can be called from any thread while the server runs
+        connection_pool_stats connection_stats()
+        {
+            connection_pool_stats stats;
+            std::lock_guard<std::mutex> lock(start_mutex_);
+            for (auto& pool : connection_pools_)
+                pool->add_stats(stats);
+            return stats;
+        }
+
         void on_tick()
         {
             tick_function_();
@@ -66,6 +108,14 @@ namespace crow
                 io_service_pool_.emplace_back(new asio::io_service());
             get_cached_date_str_pool_.resize(worker_thread_count);
             task_timer_pool_.resize(worker_thread_count);
+            {
+                std::lock_guard<std::mutex> lock(start_mutex_);
+                connection_pools_.clear();
+                if (connection_type::recyclable())
+                    for (uint16_t i = 0; i < worker_thread_count; i++)
+                        connection_pools_.push_back(std::make_shared<detail::connection_pool<connection_type>>(max_idle_connections_));
+            }
+            open_worker_acceptors(worker_thread_count);
 
             std::vector<std::future<void>> v;
             std::atomic<int> init_count(0);
@@ -73,6 +123,9 @@ namespace crow
                 v.push_back(
                   std::async(
                     std::launch::async, [this, i, &init_count] {
+                        if (reuse_port_)
+                            pin_to_cpu(i);
+
                         // thread local date string get function
                         auto last = std::chrono::steady_clock::now();
 
@@ -106,6 +159,9 @@ namespace crow
                         task_timer_pool_[i] = &task_timer;
                         task_queue_length_pool_[i] = 0;
 
+                        // the task timer goes quiet without connections, this keeps the thread waiting for new ones until stop()
+                        auto work = asio::make_work_guard(*io_service_pool_[i]);
+
                         init_count++;
                         while (1)
                         {
@@ -140,6 +196,9 @@ namespace crow
 
 
             CROW_LOG_INFO << server_name_ << " server is running at " << (handler_->ssl_used() ? "https://" : "http://") << bindaddr_ << ":" << acceptor_.local_endpoint().port() << " using " << concurrency_ << " threads";
+#ifdef CROW_ENABLE_IO_URING
+            CROW_LOG_INFO << "Sockets and static files are served through io_uring";
+#endif
             CROW_LOG_INFO << "Call `app.loglevel(crow::LogLevel::Warning)` to hide Info level logs.";
 
             signals_.async_wait(
@@ -150,7 +209,17 @@ namespace crow
             while (worker_thread_count != init_count)
                 std::this_thread::yield();
 
-            do_accept();
+            if (reuse_port_)
+            {
+                for (uint16_t i = 0; i < worker_thread_count; i++)
+                    asio::post(*io_service_pool_[i], [this, i] {
+                        do_accept_on(i);
+                    });
+            }
+            else
+            {
+                do_accept();
+            }
 
             std::thread(
               [this] {
@@ -196,6 +265,60 @@ namespace crow
         }
 
     private:
+#ifdef SO_REUSEPORT
+        using reuse_port_option = asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+#endif
+
+        /// In reuse port mode give every IO thread a listening socket of its own on the server's port,
+        /// the kernel then spreads new connections across them.
+        void open_worker_acceptors(uint16_t count)
+        {
+#ifdef SO_REUSEPORT
+            if (!reuse_port_)
+                return;
+            auto endpoint = acceptor_.local_endpoint();
+            for (uint16_t i = 0; i < count; i++)
+            {
+                std::unique_ptr<tcp::acceptor> acceptor(new tcp::acceptor(*io_service_pool_[i]));
+                acceptor->open(endpoint.protocol());
+                acceptor->set_option(tcp::acceptor::reuse_address(true));
+                acceptor->set_option(reuse_port_option(true));
+                acceptor->bind(endpoint);
+                acceptor->listen();
+                worker_acceptors_.push_back(std::move(acceptor));
+            }
+#else
+            (void)count;
+#endif
+        }
+
+        /// Pin an IO thread to one of the CPUs this process may run on, so its connections stay in that core's caches.
+        void pin_to_cpu(uint16_t thread_idx)
+        {
+#ifdef __linux__
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+                return;
+
+            // the n-th allowed CPU, wrapping around when there are more threads than CPUs
+            int target = thread_idx % CPU_COUNT(&allowed);
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (!CPU_ISSET(cpu, &allowed) || target-- > 0)
+                    continue;
+                cpu_set_t pinned;
+                CPU_ZERO(&pinned);
+                CPU_SET(cpu, &pinned);
+                if (pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) != 0)
+                    CROW_LOG_WARNING << "Could not pin IO thread " << thread_idx << " to CPU " << cpu;
+                return;
+            }
+#else
+            (void)thread_idx;
+#endif
+        }
+
         uint16_t pick_io_service_idx()
         {
             uint16_t min_queue_idx = 0;
@@ -221,9 +344,7 @@ namespace crow
                 task_queue_length_pool_[service_idx]++;
                 CROW_LOG_DEBUG << &is << " {" << service_idx << "} queue length: " << task_queue_length_pool_[service_idx];
 
-                auto p = std::make_shared<Connection<Adaptor, Handler, Middlewares...>>(
-                  is, handler_, server_name_, middlewares_,
-                  get_cached_date_str_pool_[service_idx], *task_timer_pool_[service_idx], adaptor_ctx_, task_queue_length_pool_[service_idx]);
+                auto p = make_connection(service_idx);
 
                 acceptor_.async_accept(
                   p->socket(),
@@ -245,6 +366,36 @@ namespace crow
             }
         }
 
+        /// Accept loop of a single IO thread on its own listening socket, used in reuse port mode
+        void do_accept_on(uint16_t service_idx)
+        {
+            if (shutting_down_)
+                return;
+
+            auto p = make_connection(service_idx);
+
+            worker_acceptors_[service_idx]->async_accept(
+              p->socket(),
+              [this, p, service_idx](asio::error_code ec) {
+                  // the connection already lives on this thread, no need to post it anywhere
+                  if (!ec)
+                      p->start();
+                  do_accept_on(service_idx);
+              });
+        }
+
+        /// A connection bound to the given IO thread, taken from its pool where possible
+        std::shared_ptr<connection_type> make_connection(uint16_t service_idx)
+        {
+            if (service_idx < connection_pools_.size())
+                return static_cast<detail::connection_pool<connection_type>&>(*connection_pools_[service_idx]).acquire(
+                  *io_service_pool_[service_idx], handler_, server_name_, middlewares_,
+                  get_cached_date_str_pool_[service_idx], *task_timer_pool_[service_idx], adaptor_ctx_, task_queue_length_pool_[service_idx]);
+            return std::make_shared<connection_type>(
+              *io_service_pool_[service_idx], handler_, server_name_, middlewares_,
+              get_cached_date_str_pool_[service_idx], *task_timer_pool_[service_idx], adaptor_ctx_, task_queue_length_pool_[service_idx]);
+        }
+
         /// Notify anything using `wait_for_start()` to proceed
         void notify_start()
         {
@@ -257,9 +408,15 @@ namespace crow
         asio::io_service io_service_;
         std::vector<std::unique_ptr<asio::io_service>> io_service_pool_;
         std::vector<detail::task_timer*> task_timer_pool_;
+        // only the counters are named here, naming the pool itself would instantiate Connection with the server
+        std::vector<std::shared_ptr<detail::connection_pool_counters>> connection_pools_;
+        std::size_t max_idle_connections_ = 256;
         std::vector<std::function<std::string()>> get_cached_date_str_pool_;
         tcp::acceptor acceptor_;
-        bool shutting_down_ = false;
+        // one listening socket per IO thread in reuse port mode
+        std::vector<std::unique_ptr<tcp::acceptor>> worker_acceptors_;
+        bool reuse_port_ = false;
+        std::atomic<bool> shutting_down_{false};
         bool server_started_{false};
         std::condition_variable cv_started_;
         std::mutex start_mutex_;
@@ -3,6 +3,7 @@
 #include "crow/http_request.h"
 #include "crow/http_response.h"
 #include "crow/utility.h"
+#include "crow/task.h"
 
 #include <tuple>
 #include <type_traits>
@@ -216,8 +217,7 @@ namespace crow
             static_assert(!std::is_same<void, decltype(f(std::declval<Args>()...))>::value,
                           "Handler function cannot have void return type; valid return types: string, int, crow::response, crow::returnable");
 
-            res = crow::response(f(std::forward<Args>(args)...));
-            res.end();
+            complete_with(res, f(std::forward<Args>(args)...));
         }
 
         template<typename F, typename... Args>
@@ -230,8 +230,7 @@ namespace crow
             static_assert(!std::is_same<void, decltype(f(std::declval<crow::request>(), std::declval<Args>()...))>::value,
                           "Handler function cannot have void return type; valid return types: string, int, crow::response, crow::returnable");
 
-            res = crow::response(f(req, std::forward<Args>(args)...));
-            res.end();
+            complete_with(res, f(req, std::forward<Args>(args)...));
         }
 
         template<typename F, typename... Args>
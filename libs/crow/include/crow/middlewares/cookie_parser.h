@@ -241,7 +241,7 @@ namespace crow
                 res.end();
                 return;
             }
-            std::string cookies = req.get_header_value("Cookie");
+            const std::string& cookies = req.get_header_value("Cookie");
             size_t pos = 0;
             while (pos < cookies.size())
             {
@@ -14,7 +14,11 @@
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 
 #include <fstream>
 #include <sstream>
@@ -22,6 +26,7 @@
 #include <type_traits>
 #include <functional>
 #include <chrono>
+#include <algorithm>
 
 #ifdef CROW_CAN_USE_CPP17
 #include <variant>
@@ -151,56 +156,387 @@ namespace crow
         }
 #endif
 
-        /// Expiration tracker keeps track of soonest-to-expire keys
-        struct ExpirationTracker
+        /// Stores persist session entries as an encoding tag followed by the encoded entries.
+        /// The binary encoding is <count>, then <key size><key><u8 type><value> per entry. Counts, sizes and integers are
+        /// varints (integers zigzag encoded), bools take one byte, doubles eight in host byte order and strings are <size><bytes>.
+        /// JSON remains as the encoding for C++11/14 builds and for reading sessions written before the binary encoding existed.
+        namespace codec
         {
-            using DataPair = std::pair<uint64_t /*time*/, std::string /*key*/>;
+            using entries_t = std::unordered_map<std::string, multi_value>;
 
-            /// Add key with time to tracker.
+            constexpr char json_tag = 'J';
+            constexpr char binary_tag = 'B';
+
+            template<typename T>
+            inline void write(std::string& out, T value)
+            {
+                out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+            }
+
+            template<typename T>
+            inline bool read(const char*& data, const char* end, T& value)
+            {
+                if (size_t(end - data) < sizeof(T)) return false;
+                std::memcpy(&value, data, sizeof(T));
+                data += sizeof(T);
+                return true;
+            }
+
+            inline void encode_json(const entries_t& entries, std::string& out)
+            {
+                json::wvalue jw;
+                for (const auto& p : entries)
+                    jw[p.first] = p.second.json();
+                out += jw.dump();
+            }
+
+            inline bool decode_json(const char* data, size_t size, entries_t& entries)
+            {
+                auto rv = json::load(data, size);
+                if (!rv || rv.t() != json::type::Object) return false;
+
+                for (const auto& p : rv)
+                    entries[p.key()] = multi_value::from_json(p);
+                return true;
+            }
+
+            inline void write_varint(std::string& out, uint64_t value)
+            {
+                while (value >= 0x80)
+                {
+                    out += char(value | 0x80);
+                    value >>= 7;
+                }
+                out += char(value);
+            }
+
+            inline bool read_varint(const char*& data, const char* end, uint64_t& value)
+            {
+                value = 0;
+                for (unsigned shift = 0; data != end && shift < 64; shift += 7)
+                {
+                    auto byte = uint8_t(*data++);
+                    value |= uint64_t(byte & 0x7f) << shift;
+                    if (!(byte & 0x80)) return true;
+                }
+                return false;
+            }
+
+            inline bool read_string(const char*& data, const char* end, std::string& value)
+            {
+                uint64_t size;
+                if (!read_varint(data, end, size) || uint64_t(end - data) < size) return false;
+                value.assign(data, size);
+                data += size;
+                return true;
+            }
+
+#ifdef CROW_CAN_USE_CPP17
+            inline void encode_binary(const entries_t& entries, std::string& out)
+            {
+                write_varint(out, entries.size());
+                for (const auto& p : entries)
+                {
+                    write_varint(out, p.first.size());
+                    out += p.first;
+                    write(out, uint8_t(p.second.v_.index()));
+                    // clang-format off
+                    std::visit([&out](const auto& value) {
+                        using T = std::decay_t<decltype(value)>;
+                        if constexpr (std::is_same_v<T, std::string>)
+                        {
+                            write_varint(out, value.size());
+                            out += value;
+                        }
+                        else if constexpr (std::is_same_v<T, bool>)
+                            write(out, uint8_t(value));
+                        else if constexpr (std::is_same_v<T, int64_t>)
+                            write_varint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+                        else
+                            write(out, value);
+                    }, p.second.v_);
+                    // clang-format on
+                }
+            }
+
+            inline bool decode_binary(const char* data, size_t size, entries_t& entries)
+            {
+                const char* end = data + size;
+                uint64_t count;
+                // every entry takes at least three bytes, which bounds the reservation for damaged data
+                if (!read_varint(data, end, count) || count > size) return false;
+                entries.reserve(count);
+
+                for (uint64_t i = 0; i < count; i++)
+                {
+                    std::string key;
+                    uint8_t type;
+                    if (!read_string(data, end, key) || !read(data, end, type)) return false;
+
+                    auto& value = entries[std::move(key)];
+                    switch (type)
+                    {
+                        case 0:
+                        {
+                            uint8_t v;
+                            if (!read(data, end, v)) return false;
+                            value.v_ = bool(v);
+                            break;
+                        }
+                        case 1:
+                        {
+                            uint64_t v;
+                            if (!read_varint(data, end, v)) return false;
+                            value.v_ = int64_t(v >> 1) ^ -int64_t(v & 1);
+                            break;
+                        }
+                        case 2:
+                        {
+                            double v;
+                            if (!read(data, end, v)) return false;
+                            value.v_ = v;
+                            break;
+                        }
+                        case 3:
+                        {
+                            std::string v;
+                            if (!read_string(data, end, v)) return false;
+                            value.v_ = std::move(v);
+                            break;
+                        }
+                        default: return false;
+                    }
+                }
+                return data == end;
+            }
+#endif
+
+            /// Append the tagged entries in the most compact encoding available
+            inline void encode(const entries_t& entries, std::string& out)
+            {
+#ifdef CROW_CAN_USE_CPP17
+                out += binary_tag;
+                encode_binary(entries, out);
+#else
+                out += json_tag;
+                encode_json(entries, out);
+#endif
+            }
+
+            /// Decode tagged entries in any known encoding, returns false if the data is damaged
+            inline bool decode(const char* data, size_t size, entries_t& entries)
+            {
+                if (size == 0) return false;
+                switch (data[0])
+                {
+                    case json_tag: return decode_json(data + 1, size - 1, entries);
+#ifdef CROW_CAN_USE_CPP17
+                    case binary_tag: return decode_binary(data + 1, size - 1, entries);
+#endif
+                    default: return false;
+                }
+            }
+        } // namespace codec
+
+        /// Expiration wheel keeps track of when keys expire, with one second resolution.
+        /// It is a hierarchical timing wheel: adding, updating and removing a key is O(1),
+        /// and advancing only touches the slots that come due, so expiring keys costs O(1) amortized.
+        /// The wheel isn't synchronized, stores guard it themselves.
+        struct ExpirationWheel
+        {
+            explicit ExpirationWheel(uint64_t now = 0):
+              current_(now)
+            {}
+
+            ExpirationWheel(const ExpirationWheel&) = delete;
+            ExpirationWheel& operator=(const ExpirationWheel&) = delete;
+
+            /// Add key with time to the wheel.
             /// If the key is already present, it will be updated
-            void add(std::string key, uint64_t time)
+            void add(const std::string& key, uint64_t time)
             {
-                auto it = times_.find(key);
-                if (it != times_.end()) remove(key);
-                times_[key] = time;
-                queue_.insert({time, std::move(key)});
+                auto& n = nodes_[key];
+                if (n.key)
+                    unlink(n);
+                else
+                    n.key = &nodes_.find(key)->first;
+                n.time = time;
+                // the current slot was already expired, due keys go in the next one
+                link(n, current_ + 1);
             }
 
             void remove(const std::string& key)
             {
-                auto it = times_.find(key);
-                if (it != times_.end())
+                auto it = nodes_.find(key);
+                if (it == nodes_.end()) return;
+                unlink(it->second);
+                nodes_.erase(it);
+            }
+
+            /// Get the expiration time of a key, 0 if it isn't tracked
+            uint64_t expiration(const std::string& key) const
+            {
+                auto it = nodes_.find(key);
+                return it == nodes_.end() ? 0 : it->second.time;
+            }
+
+            size_t size() const { return nodes_.size(); }
+
+            /// Move the wheel forward to now and return every key that expired on the way.
+            /// Expired keys are no longer tracked
+            std::vector<std::string> advance(uint64_t now)
+            {
+                std::vector<std::string> expired;
+                while (current_ < now)
                 {
-                    queue_.erase({it->second, key});
-                    times_.erase(it);
+                    current_++;
+
+                    // refill the lower levels from the highest level that wrapped around
+                    if ((current_ & ((uint64_t(1) << (slot_bits * levels)) - 1)) == 0) cascade(overflow_);
+                    for (size_t level = levels - 1; level > 0; level--)
+                    {
+                        if ((current_ & ((uint64_t(1) << (slot_bits * level)) - 1)) == 0)
+                            cascade(slots_[level][(current_ >> (slot_bits * level)) & slot_mask]);
+                    }
+
+                    auto& slot = slots_[0][current_ & slot_mask];
+                    while (slot)
+                    {
+                        auto* n = slot;
+                        unlink(*n);
+                        expired.push_back(*n->key);
+                        nodes_.erase(expired.back());
+                    }
                 }
+                return expired;
             }
 
-            /// Get expiration time of soonest-to-expire entry
-            uint64_t peek_first() const
+            /// Visit every key with its expiration time
+            template<typename F>
+            void for_each(F&& f) const
             {
-                if (queue_.empty()) return std::numeric_limits<uint64_t>::max();
-                return queue_.begin()->first;
+                for (const auto& p : nodes_)
+                    f(p.first, p.second.time);
             }
 
-            std::string pop_first()
+        private:
+            static constexpr size_t slot_bits = 6;
+            static constexpr size_t slot_count = 1 << slot_bits;
+            static constexpr uint64_t slot_mask = slot_count - 1;
+            // 64^4 seconds is a little over 194 days, anything later waits in the overflow list
+            static constexpr size_t levels = 4;
+
+            struct node
             {
-                auto it = times_.find(queue_.begin()->second);
-                auto key = it->first;
-                times_.erase(it);
-                queue_.erase(queue_.begin());
-                return key;
+                uint64_t time = 0;
+                const std::string* key = nullptr;
+                node** head = nullptr;
+                node* prev = nullptr;
+                node* next = nullptr;
+            };
+
+            void link(node& n, uint64_t earliest)
+            {
+                uint64_t time = std::max(n.time, earliest);
+
+                node** head = &overflow_;
+                for (size_t level = 0; level < levels; level++)
+                {
+                    // the key belongs to the lowest level where the only digit that differs from now is its own
+                    if ((time >> (slot_bits * (level + 1))) == (current_ >> (slot_bits * (level + 1))))
+                    {
+                        head = &slots_[level][(time >> (slot_bits * level)) & slot_mask];
+                        break;
+                    }
+                }
+
+                n.head = head;
+                n.prev = nullptr;
+                n.next = *head;
+                if (*head) (*head)->prev = &n;
+                *head = &n;
             }
 
-            using iterator = typename std::set<DataPair>::const_iterator;
+            void unlink(node& n)
+            {
+                if (n.prev)
+                    n.prev->next = n.next;
+                else
+                    *n.head = n.next;
+                if (n.next) n.next->prev = n.prev;
+                n.head = nullptr;
+                n.prev = n.next = nullptr;
+            }
 
-            iterator begin() const { return queue_.cbegin(); }
+            void cascade(node*& head)
+            {
+                auto* n = head;
+                head = nullptr;
+                while (n)
+                {
+                    auto* next = n->next;
+                    link(*n, current_);
+                    n = next;
+                }
+            }
 
-            iterator end() const { return queue_.cend(); }
+            uint64_t current_;
+            node* slots_[levels][slot_count] = {};
+            node* overflow_ = nullptr;
+            std::unordered_map<std::string, node> nodes_;
+        };
+
+        /// Runs a task on its own thread at a fixed interval until destroyed
+        struct PeriodicTask
+        {
+            PeriodicTask(std::chrono::milliseconds interval, std::function<void()> task):
+              interval_(interval), task_(std::move(task))
+            {
+                thread_ = std::thread([this] {
+                    run();
+                });
+            }
+
+            PeriodicTask(const PeriodicTask&) = delete;
+            PeriodicTask& operator=(const PeriodicTask&) = delete;
+
+            ~PeriodicTask()
+            {
+                {
+                    std::lock_guard<std::mutex> l(mutex_);
+                    stopping_ = true;
+                }
+                cv_.notify_all();
+                thread_.join();
+            }
 
         private:
-            std::set<DataPair> queue_;
-            std::unordered_map<std::string, uint64_t> times_;
+            void run()
+            {
+                std::unique_lock<std::mutex> l(mutex_);
+                while (!cv_.wait_for(l, interval_, [this] {
+                    return stopping_;
+                }))
+                {
+                    l.unlock();
+                    try
+                    {
+                        task_();
+                    }
+                    catch (...)
+                    {
+                        CROW_LOG_ERROR << "Exception occurred in session maintenance";
+                    }
+                    l.lock();
+                }
+            }
+
+            std::chrono::milliseconds interval_;
+            std::function<void()> task_;
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            bool stopping_ = false;
+            std::thread thread_;
         };
 
         /// CachedSessions are shared across requests
@@ -212,14 +548,33 @@ namespace crow
             std::unordered_map<std::string, multi_value> entries;
             std::unordered_set<std::string> dirty; // values that were changed after last load
 
-            void* store_data;
-            bool requested_refresh;
+            void* store_data = nullptr;
+            bool requested_refresh = false;
 
             // number of references held - used for correctly destroying the cache.
             // No need to be atomic, all SessionMiddleware accesses are synchronized
-            int referrers;
+            int referrers = 0;
             std::recursive_mutex mutex;
         };
+
+        /// Detects stores that can drop a session id, used to forget sessions that were emptied
+        template<typename T, typename = void>
+        struct has_evict : std::false_type
+        {};
+
+        template<typename T>
+        struct has_evict<T, decltype(std::declval<T&>().evict(std::declval<const std::string&>()), void())> : std::true_type
+        {};
+
+        /// Detects stores that declare `static constexpr bool concurrent = true`.
+        /// Their methods may be called for different sessions at once, so the session cache is sharded for them
+        template<typename T, typename = void>
+        struct is_concurrent_store : std::false_type
+        {};
+
+        template<typename T>
+        struct is_concurrent_store<T, typename std::enable_if<T::concurrent>::type> : std::true_type
+        {};
     } // namespace session
 
     // SessionMiddleware allows storing securely and easily small snippets of user information
@@ -244,6 +599,7 @@ namespace crow
             }
 
             // Check whether this session is already present
+            // Sessions are only created once a value is set, reading from an absent session is free
             bool exists() { return bool(node); }
 
             // Get a value by key or fallback if it doesn't exist or is of another type
@@ -278,6 +634,7 @@ namespace crow
             bool contains(const std::string& key)
             {
                 if (!node) return false;
+                rc_lock l(node->mutex);
                 return node->entries.find(key) != node->entries.end();
             }
 
@@ -352,7 +709,7 @@ namespace crow
           Ts... ts):
           id_length_(id_length),
           cookie_(cookie),
-          store_(std::forward<Ts>(ts)...), mutex_(new std::mutex{})
+          store_(std::forward<Ts>(ts)...), shards_(new shard[shard_count])
         {}
 
         template<typename... Ts>
@@ -366,15 +723,16 @@ namespace crow
         template<typename AllContext>
         void before_handle(request& /*req*/, response& /*res*/, context& ctx, AllContext& all_ctx)
         {
-            lock l(*mutex_);
-
             auto& cookies = all_ctx.template get<CookieParser>();
             auto session_id = load_id(cookies);
             if (session_id == "") return;
 
+            auto& sh = shard_for(session_id);
+            lock l(sh.mutex);
+
             // search entry in cache
-            auto it = cache_.find(session_id);
-            if (it != cache_.end())
+            auto it = sh.cache.find(session_id);
+            if (it != sh.cache.end())
             {
                 it->second->referrers++;
                 ctx.node = it->second;
@@ -399,29 +757,47 @@ namespace crow
             }
 
             ctx.node = node;
-            cache_[session_id] = node;
+            sh.cache[session_id] = node;
         }
 
         template<typename AllContext>
         void after_handle(request& /*req*/, response& /*res*/, context& ctx, AllContext& all_ctx)
         {
-            lock l(*mutex_);
-            if (!ctx.node || --ctx.node->referrers > 0) return;
-            ctx.node->requested_refresh |= ctx.node->session_id == "";
+            if (!ctx.node) return;
 
-            // generate new id
-            if (ctx.node->session_id == "")
+            // nodes created during this request aren't in the cache and can't be shared yet
+            bool created = ctx.node->session_id == "";
+            if (created)
             {
+                // sessions without values are never persisted
+                if (ctx.node->entries.empty()) return;
+
                 // check for requested id
                 ctx.node->session_id = std::move(ctx.node->requested_session_id);
                 if (ctx.node->session_id == "")
                 {
                     ctx.node->session_id = utility::random_alphanum(id_length_);
                 }
+                ctx.node->requested_refresh = true;
             }
-            else
+
+            auto& sh = shard_for(ctx.node->session_id);
+            lock l(sh.mutex);
+            if (!created)
             {
-                cache_.erase(ctx.node->session_id);
+                if (--ctx.node->referrers > 0) return;
+                sh.cache.erase(ctx.node->session_id);
+
+                // a session emptied by this request is forgotten
+                if (ctx.node->entries.empty())
+                {
+                    evict_id(ctx.node->session_id);
+
+                    auto& cookies = all_ctx.template get<CookieParser>();
+                    auto cookie = cookie_;
+                    cookies.set_cookie(cookie.value("").max_age(0));
+                    return;
+                }
             }
 
             if (ctx.node->requested_refresh)
@@ -459,10 +835,42 @@ namespace crow
 
         void store_id(CookieParser::context& cookies, const std::string& session_id)
         {
-            cookie_.value(session_id);
-            cookies.set_cookie(cookie_);
+            // the prototype is shared between shards, so it is copied rather than modified
+            auto cookie = cookie_;
+            cookies.set_cookie(cookie.value(session_id));
+        }
+
+        struct shard
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, std::shared_ptr<session::CachedSession>> cache;
+        };
+
+        // stores that aren't thread safe are only ever called under a single lock
+        static constexpr size_t shard_count = session::is_concurrent_store<Store>::value ? 16 : 1;
+
+        shard& shard_for(const std::string& session_id)
+        {
+            return shards_[shard_count == 1 ? 0 : std::hash<std::string>{}(session_id) % shard_count];
         }
 
+        template<typename S = Store>
+        typename std::enable_if<session::has_evict<S>::value>::type evict_id(const std::string& session_id)
+        {
+            try
+            {
+                store_.evict(session_id);
+            }
+            catch (...)
+            {
+                CROW_LOG_ERROR << "Exception occurred during session evict";
+            }
+        }
+
+        template<typename S = Store>
+        typename std::enable_if<!session::has_evict<S>::value>::type evict_id(const std::string&)
+        {}
+
     private:
         int id_length_;
 
@@ -472,8 +880,7 @@ namespace crow
         Store store_;
 
         // mutexes are immovable
-        std::unique_ptr<std::mutex> mutex_;
-        std::unordered_map<std::string, std::shared_ptr<session::CachedSession>> cache_;
+        std::unique_ptr<shard[]> shards_;
     };
 
     /// InMemoryStore stores all entries in memory
@@ -499,17 +906,25 @@ namespace crow
             return entries.count(key) > 0;
         }
 
+        void evict(const std::string& key)
+        {
+            entries.erase(key);
+        }
+
         std::unordered_map<std::string, std::unordered_map<std::string, session::multi_value>> entries;
     };
 
-    // FileStore stores all data as json files in a folder.
-    // Files are deleted after expiration. Expiration refreshes are automatically picked up.
+    // FileStore stores every session as a file in a folder, see session::codec for the encoding.
+    // Sessions left in the json files of older versions are still read and converted on their next load.
+    // Files are deleted after expiration by a background tick, expiration refreshes are automatically picked up.
+    // Expiration times are checkpointed to the folder regularly and on destruction.
     struct FileStore
     {
-        FileStore(const std::string& folder, uint64_t expiration_seconds = /*month*/ 30 * 24 * 60 * 60):
-          path_(folder), expiration_seconds_(expiration_seconds)
+        FileStore(const std::string& folder, uint64_t expiration_seconds = /*month*/ 30 * 24 * 60 * 60,
+                  std::chrono::seconds checkpoint_interval = std::chrono::seconds(60)):
+          path_(folder), expiration_seconds_(expiration_seconds), expirations_(new expiration_state(folder, checkpoint_interval))
         {
-            std::ifstream ifs(get_filename(".expirations", false));
+            std::ifstream ifs(get_filename(".expirations", ""));
 
             auto current_ts = chrono_time();
             std::string key;
@@ -522,83 +937,585 @@ namespace crow
                 }
                 else if (contains(key))
                 {
-                    expirations_.add(key, time);
+                    expirations_->wheel.add(key, time);
                 }
             }
+
+            auto* expirations = expirations_.get();
+            ticker_.reset(new session::PeriodicTask(std::chrono::seconds(1), [expirations] {
+                expirations->tick(chrono_time());
+            }));
         }
 
+        FileStore(FileStore&&) = default;
+
         ~FileStore()
         {
-            std::ofstream ofs(get_filename(".expirations", false), std::ios::trunc);
-            for (const auto& p : expirations_)
-                ofs << p.second << " " << p.first << "\n";
+            if (!expirations_) return;
+            ticker_.reset();
+            std::lock_guard<std::mutex> l(expirations_->mutex);
+            expirations_->checkpoint();
         }
 
-        // Delete expired entries
-        // At most 3 to prevent freezes
-        void handle_expired()
+        void load(session::CachedSession& cn)
         {
-            int deleted = 0;
-            auto current_ts = chrono_time();
-            while (current_ts > expirations_.peek_first() && deleted < 3)
+            std::string data;
+            if (read_file(get_filename(cn.session_id), data))
             {
-                evict(expirations_.pop_first());
-                deleted++;
+                if (!session::codec::decode(data.data(), data.size(), cn.entries))
+                {
+                    CROW_LOG_ERROR << "Session " << cn.session_id << " is damaged";
+                    cn.entries.clear();
+                }
+                return;
             }
-        }
 
-        void load(session::CachedSession& cn)
-        {
-            handle_expired();
+            auto legacy = get_filename(cn.session_id, legacy_extension);
+            if (!read_file(legacy, data)) return;
+            session::codec::decode_json(data.data(), data.size(), cn.entries);
 
-            std::ifstream file(get_filename(cn.session_id));
-
-            std::stringstream buffer;
-            buffer << file.rdbuf() << std::endl;
-
-            for (const auto& p : json::load(buffer.str()))
-                cn.entries[p.key()] = session::multi_value::from_json(p);
+            // convert right away, so the legacy file is only ever read once
+            if (write_file(get_filename(cn.session_id), cn.entries))
+                std::remove(legacy.c_str());
         }
 
         void save(session::CachedSession& cn)
         {
+            // held while writing so the tick can't delete a session that is being refreshed
+            std::lock_guard<std::mutex> l(expirations_->mutex);
             if (cn.requested_refresh)
-                expirations_.add(cn.session_id, chrono_time() + expiration_seconds_);
+                expirations_->wheel.add(cn.session_id, chrono_time() + expiration_seconds_);
             if (cn.dirty.empty()) return;
 
-            std::ofstream file(get_filename(cn.session_id));
-            json::wvalue jw;
-            for (const auto& p : cn.entries)
-                jw[p.first] = p.second.json();
-            file << jw.dump() << std::flush;
+            if (!write_file(get_filename(cn.session_id), cn.entries))
+                CROW_LOG_ERROR << "Failed writing session " << cn.session_id;
         }
 
-        std::string get_filename(const std::string& key, bool suffix = true)
+        std::string get_filename(const std::string& key, const std::string& extension = session_extension)
         {
-            return utility::join_path(path_, key + (suffix ? ".json" : ""));
+            return filename(path_, key, extension);
         }
 
         bool contains(const std::string& key)
         {
-            std::ifstream file(get_filename(key));
-            return file.good();
+            return std::ifstream(get_filename(key)).good() || std::ifstream(get_filename(key, legacy_extension)).good();
         }
 
         void evict(const std::string& key)
         {
-            std::remove(get_filename(key).c_str());
+            std::lock_guard<std::mutex> l(expirations_->mutex);
+            expirations_->wheel.remove(key);
+            remove_files(path_, key);
         }
 
-        uint64_t chrono_time() const
+        static uint64_t chrono_time()
         {
             return std::chrono::duration_cast<std::chrono::seconds>(
                      std::chrono::system_clock::now().time_since_epoch())
               .count();
         }
 
+        static std::string filename(const std::string& folder, const std::string& key, const std::string& extension = session_extension)
+        {
+            return utility::join_path(folder, key + extension);
+        }
+
+        static constexpr const char* session_extension = ".session";
+        static constexpr const char* legacy_extension = ".json";
+
         std::string path_;
         uint64_t expiration_seconds_;
-        session::ExpirationTracker expirations_;
+
+    private:
+        static bool read_file(const std::string& path, std::string& data)
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) return false;
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        static bool write_file(const std::string& path, const session::codec::entries_t& entries)
+        {
+            std::string data;
+            session::codec::encode(entries, data);
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            return bool(file.write(data.data(), data.size()).flush());
+        }
+
+        static void remove_files(const std::string& folder, const std::string& key)
+        {
+            std::remove(filename(folder, key).c_str());
+            std::remove(filename(folder, key, legacy_extension).c_str());
+        }
+
+        // shared with the tick thread, so it stays in place when the store is moved
+        struct expiration_state
+        {
+            expiration_state(const std::string& folder, std::chrono::seconds checkpoint_interval):
+              folder(folder), checkpoint_interval(checkpoint_interval), wheel(chrono_time()),
+              next_checkpoint(chrono_time() + checkpoint_interval.count())
+            {}
+
+            void tick(uint64_t now)
+            {
+                std::lock_guard<std::mutex> l(mutex);
+                for (const auto& key : wheel.advance(now))
+                    remove_files(folder, key);
+
+                if (now < next_checkpoint) return;
+                next_checkpoint = now + checkpoint_interval.count();
+                checkpoint();
+            }
+
+            // requires mutex
+            void checkpoint()
+            {
+                auto path = filename(folder, ".expirations", "");
+                auto temp_path = path + ".tmp";
+                {
+                    std::ofstream ofs(temp_path, std::ios::trunc);
+                    wheel.for_each([&](const std::string& key, uint64_t time) {
+                        ofs << key << " " << time << "\n";
+                    });
+                    if (!ofs.flush())
+                    {
+                        CROW_LOG_ERROR << "Failed writing session expirations to " << temp_path;
+                        return;
+                    }
+                }
+#ifdef _WIN32
+                std::remove(path.c_str());
+#endif
+                if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+                    CROW_LOG_ERROR << "Unable to replace session expirations " << path;
+            }
+
+            std::string folder;
+            std::chrono::seconds checkpoint_interval;
+            std::mutex mutex;
+            session::ExpirationWheel wheel;
+            uint64_t next_checkpoint;
+        };
+
+        std::unique_ptr<expiration_state> expirations_;
+        std::unique_ptr<session::PeriodicTask> ticker_;
+    };
+
+    // LogStore keeps all sessions in a sharded in-memory map and persists every change as a record in an append-only log.
+    // Appends are buffered and written out by a background thread, which also drops expired sessions from an expiration wheel
+    // and compacts the log once most of it is stale. Request threads do no expiry work. The log is replayed on construction, a torn record at the end of it is discarded.
+    // The store is safe to use from multiple threads, so SessionMiddleware shards its session cache for it.
+    struct LogStore
+    {
+        static constexpr bool concurrent = true;
+
+        LogStore(const std::string& path, uint64_t expiration_seconds = /*month*/ 30 * 24 * 60 * 60,
+                 std::chrono::milliseconds flush_interval = std::chrono::seconds(1)):
+          state_(new state(path, expiration_seconds, flush_interval))
+        {}
+
+        void load(session::CachedSession& cn)
+        {
+            auto& sh = state_->shard_for(cn.session_id);
+            std::lock_guard<std::mutex> l(sh.mutex);
+
+            auto it = sh.sessions.find(cn.session_id);
+            if (it != sh.sessions.end()) cn.entries = it->second.entries;
+        }
+
+        void save(session::CachedSession& cn)
+        {
+            if (cn.dirty.empty() && !cn.requested_refresh) return;
+
+            std::string record;
+            {
+                auto& sh = state_->shard_for(cn.session_id);
+                std::lock_guard<std::mutex> l(sh.mutex);
+
+                auto& s = sh.sessions[cn.session_id];
+                if (cn.requested_refresh || s.expires == 0)
+                {
+                    s.expires = chrono_time() + state_->expiration_seconds;
+                    std::lock_guard<std::mutex> el(state_->expiry_mutex);
+                    state_->wheel.add(cn.session_id, s.expires);
+                }
+                // the node is dropped from the middleware cache before it is saved
+                s.entries = std::move(cn.entries);
+
+                record = encode_record(op_save, cn.session_id, s.expires, s.entries);
+                state_->live_bytes += record.size();
+                state_->live_bytes -= s.bytes;
+                s.bytes = record.size();
+            }
+            state_->append(record);
+        }
+
+        bool contains(const std::string& key)
+        {
+            auto& sh = state_->shard_for(key);
+            std::lock_guard<std::mutex> l(sh.mutex);
+
+            auto it = sh.sessions.find(key);
+            return it != sh.sessions.end() && it->second.expires > chrono_time();
+        }
+
+        void evict(const std::string& key)
+        {
+            {
+                auto& sh = state_->shard_for(key);
+                std::lock_guard<std::mutex> l(sh.mutex);
+
+                auto it = sh.sessions.find(key);
+                if (it == sh.sessions.end()) return;
+                state_->live_bytes -= it->second.bytes;
+                sh.sessions.erase(it);
+
+                std::lock_guard<std::mutex> el(state_->expiry_mutex);
+                state_->wheel.remove(key);
+            }
+            state_->append(encode_record(op_evict, key, 0, {}));
+        }
+
+        // Write all buffered records to the log
+        void flush()
+        {
+            state_->write_pending();
+        }
+
+        // Rewrite the log so it only holds the current state of live sessions
+        void compact()
+        {
+            state_->compact();
+        }
+
+    private:
+        using entries_t = session::codec::entries_t;
+
+        // a record is <u32 size><u8 op><u16 id size><id><u64 expiration><tagged entries>, in host byte order.
+        // see session::codec for the entry encodings
+        static constexpr char op_save = 'S';
+        static constexpr char op_evict = 'E';
+        static constexpr const char* magic = "CROWSLG1";
+        static constexpr size_t magic_size = 8;
+
+        struct stored_session
+        {
+            entries_t entries;
+            uint64_t expires = 0;
+            // size of the record holding the current state, used to estimate how much of the log is live
+            size_t bytes = 0;
+        };
+
+        struct shard
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, stored_session> sessions;
+        };
+
+        // owned through a pointer so the store stays movable while the background thread runs
+        struct state
+        {
+            static constexpr size_t shard_count = 16;
+            // logs smaller than this are never compacted
+            static constexpr size_t compact_threshold = 1 << 20;
+
+            state(const std::string& path, uint64_t expiration_seconds, std::chrono::milliseconds flush_interval):
+              path(path), expiration_seconds(expiration_seconds), wheel(chrono_time())
+            {
+                if (!replay())
+                    compact();
+                else if (!(log = std::fopen(path.c_str(), "ab")))
+                    CROW_LOG_ERROR << "Unable to open session log " << path;
+
+                maintenance.reset(new session::PeriodicTask(flush_interval, [this] {
+                    maintain();
+                }));
+            }
+
+            ~state()
+            {
+                maintenance.reset();
+
+                write_pending();
+                if (log) std::fclose(log);
+            }
+
+            shard& shard_for(const std::string& key)
+            {
+                return shards[std::hash<std::string>{}(key) % shard_count];
+            }
+
+            // Only buffers the record, the maintenance thread writes it. Request threads never wait on the disk
+            void append(const std::string& record)
+            {
+                std::lock_guard<std::mutex> l(log_mutex);
+                pending += record;
+                if (compacting) compacted_tail += record;
+                log_bytes += record.size();
+            }
+
+            // Write the buffered records, appending threads only wait while the buffer is handed over
+            void write_pending()
+            {
+                std::lock_guard<std::mutex> fl(file_mutex);
+                if (!log) return;
+                {
+                    std::lock_guard<std::mutex> l(log_mutex);
+                    writing.swap(pending);
+                }
+                if (writing.empty()) return;
+                if (std::fwrite(writing.data(), 1, writing.size(), log) != writing.size() || std::fflush(log) != 0)
+                    CROW_LOG_ERROR << "Failed writing to session log " << path;
+                writing.clear();
+            }
+
+            // Load the log into memory, returns false if the log is missing, damaged or should be compacted
+            bool replay()
+            {
+                std::ifstream file(path, std::ios::binary);
+                if (!file) return false;
+
+                std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+                if (data.size() < magic_size || data.compare(0, magic_size, magic) != 0)
+                {
+                    CROW_LOG_WARNING << "Session log " << path << " has an unknown format, starting empty";
+                    return false;
+                }
+
+                auto current_ts = chrono_time();
+                size_t pos = magic_size;
+                while (data.size() - pos >= sizeof(uint32_t))
+                {
+                    uint32_t size;
+                    std::memcpy(&size, data.data() + pos, sizeof(size));
+                    if (data.size() - pos - sizeof(size) < size) break;
+
+                    if (!replay_record(data.data() + pos + sizeof(size), size, current_ts)) break;
+                    pos += sizeof(size) + size;
+                }
+
+                log_bytes = pos;
+                if (pos != data.size())
+                {
+                    CROW_LOG_WARNING << "Discarding " << data.size() - pos << " damaged bytes at the end of session log " << path;
+                    return false;
+                }
+                return !should_compact();
+            }
+
+            bool replay_record(const char* data, size_t size, uint64_t current_ts)
+            {
+                const char* end = data + size;
+                char op;
+                uint16_t id_size;
+                if (!read(data, end, op) || !read(data, end, id_size) || size_t(end - data) < id_size) return false;
+                std::string id(data, id_size);
+                data += id_size;
+
+                auto& sh = shard_for(id);
+                auto it = sh.sessions.find(id);
+                if (it != sh.sessions.end())
+                {
+                    live_bytes -= it->second.bytes;
+                    sh.sessions.erase(it);
+                    wheel.remove(id);
+                }
+                if (op == op_evict) return true;
+
+                uint64_t expires;
+                if (op != op_save || !read(data, end, expires)) return false;
+                if (expires <= current_ts) return true;
+
+                entries_t entries;
+                if (!session::codec::decode(data, end - data, entries)) return false;
+
+                auto& s = sh.sessions[id];
+                s.entries = std::move(entries);
+                s.expires = expires;
+                s.bytes = sizeof(uint32_t) + size;
+                live_bytes += s.bytes;
+                wheel.add(id, expires);
+                return true;
+            }
+
+            bool should_compact() const
+            {
+                return log_bytes > compact_threshold && log_bytes > 2 * live_bytes;
+            }
+
+            // Rewrite the log from a snapshot of the shards, taken and written while requests keep appending.
+            // What they append meanwhile is written after the snapshot, before the new log replaces the old one
+            void compact()
+            {
+                std::lock_guard<std::mutex> fl(file_mutex);
+
+                auto temp_path = path + ".tmp";
+                FILE* out = std::fopen(temp_path.c_str(), "wb");
+                if (!out)
+                {
+                    CROW_LOG_ERROR << "Unable to compact session log " << path;
+                    return;
+                }
+
+                // a change to a shard after it was copied is appended after this, so the tail brings the snapshot up to date.
+                // records of changes the snapshot already holds are replayed to the same state
+                {
+                    std::lock_guard<std::mutex> l(log_mutex);
+                    compacting = true;
+                }
+
+                std::string buffer(magic, magic_size);
+                size_t written = 0;
+                bool failed = false;
+                for (auto& sh : shards)
+                {
+                    {
+                        std::lock_guard<std::mutex> sl(sh.mutex);
+                        for (auto& p : sh.sessions)
+                        {
+                            auto record = encode_record(op_save, p.first, p.second.expires, p.second.entries);
+                            live_bytes += record.size();
+                            live_bytes -= p.second.bytes;
+                            p.second.bytes = record.size();
+                            buffer += record;
+                        }
+                    }
+                    failed |= std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size();
+                    written += buffer.size();
+                    buffer.clear();
+                }
+                failed |= std::fflush(out) != 0;
+
+                std::lock_guard<std::mutex> l(log_mutex);
+                compacting = false;
+                if (!failed)
+                    failed |= std::fwrite(compacted_tail.data(), 1, compacted_tail.size(), out) != compacted_tail.size();
+                written += compacted_tail.size();
+                compacted_tail.clear();
+                failed |= std::fclose(out) != 0;
+
+                if (failed)
+                {
+                    // everything is still pending for the old log
+                    CROW_LOG_ERROR << "Failed writing compacted session log " << temp_path;
+                    std::remove(temp_path.c_str());
+                    return;
+                }
+
+                if (log) std::fclose(log);
+#ifdef _WIN32
+                std::remove(path.c_str());
+#endif
+                if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+                    CROW_LOG_ERROR << "Unable to replace session log " << path;
+                if (!(log = std::fopen(path.c_str(), "ab")))
+                    CROW_LOG_ERROR << "Unable to open session log " << path;
+
+                // what was pending is either in the snapshot or in the tail
+                pending.clear();
+                log_bytes = written;
+            }
+
+            // Drop expired sessions, they're left out of the log at the next compaction
+            void expire()
+            {
+                auto current_ts = chrono_time();
+                std::vector<std::string> expired;
+                {
+                    std::lock_guard<std::mutex> l(expiry_mutex);
+                    expired = wheel.advance(current_ts);
+                }
+
+                for (const auto& key : expired)
+                {
+                    auto& sh = shard_for(key);
+                    std::lock_guard<std::mutex> l(sh.mutex);
+
+                    // the session may have been refreshed after the wheel let go of it
+                    auto it = sh.sessions.find(key);
+                    if (it == sh.sessions.end() || it->second.expires > current_ts) continue;
+                    live_bytes -= it->second.bytes;
+                    sh.sessions.erase(it);
+                }
+            }
+
+            void maintain()
+            {
+                expire();
+                write_pending();
+                bool compact_now;
+                {
+                    std::lock_guard<std::mutex> l(log_mutex);
+                    compact_now = should_compact();
+                }
+                if (compact_now) compact();
+            }
+
+            std::string path;
+            uint64_t expiration_seconds;
+
+            shard shards[shard_count];
+            std::atomic<size_t> live_bytes{0};
+
+            // held by whatever writes to the log file, request threads never take it
+            std::mutex file_mutex;
+            FILE* log = nullptr;
+            std::string writing;
+
+            // guards the buffered records, the only lock appending threads share
+            std::mutex log_mutex;
+            std::string pending;
+            size_t log_bytes = 0;
+            // while compacting, the records appended since the snapshot began
+            bool compacting = false;
+            std::string compacted_tail;
+
+            // lock order is shard, then expiry
+            std::mutex expiry_mutex;
+            session::ExpirationWheel wheel;
+
+            std::unique_ptr<session::PeriodicTask> maintenance;
+        };
+
+        template<typename T>
+        static void write(std::string& out, T value)
+        {
+            session::codec::write(out, value);
+        }
+
+        template<typename T>
+        static bool read(const char*& data, const char* end, T& value)
+        {
+            return session::codec::read(data, end, value);
+        }
+
+        static std::string encode_record(char op, const std::string& id, uint64_t expires, const entries_t& entries)
+        {
+            std::string record;
+            write(record, uint32_t(0));
+            write(record, op);
+            write(record, uint16_t(id.size()));
+            record += id;
+            if (op == op_save)
+            {
+                write(record, expires);
+                session::codec::encode(entries, record);
+            }
+
+            uint32_t size = record.size() - sizeof(uint32_t);
+            std::memcpy(&record[0], &size, sizeof(size));
+            return record;
+        }
+
+        static uint64_t chrono_time()
+        {
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+              .count();
+        }
+
+        std::unique_ptr<state> state_;
     };
 
 } // namespace crow
@@ -143,7 +143,7 @@ namespace crow
             /// Create a multipart message from a request data
             message(const request& req):
               returnable("multipart/form-data; boundary=CROW-BOUNDARY"),
-              headers(req.headers),
+              headers(req.headers.begin(), req.headers.end()),
               boundary(get_boundary(get_header_value("Content-Type")))
             {
                 if (!boundary.empty())
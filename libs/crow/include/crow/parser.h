@@ -6,6 +6,7 @@
 
 #include "crow/http_request.h"
 #include "crow/http_parser_merged.h"
+#include "crow/request_scanner.h"
 
 namespace crow
 {
@@ -30,9 +31,8 @@ namespace crow
         static int on_url(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            self->req.raw_url.insert(self->req.raw_url.end(), at, at + length);
-            self->req.url_params = query_string(self->req.raw_url);
-            self->req.url = self->req.raw_url.substr(0, self->qs_point != 0 ? self->qs_point : std::string::npos);
+            self->req.raw_url.append(at, length);
+            self->split_url();
 
             self->process_url();
 
@@ -41,18 +41,15 @@ namespace crow
         static int on_header_field(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
+            // a header arrives in as many pieces as it was split across reads
             switch (self->header_building_state)
             {
                 case 0:
-                    if (!self->header_value.empty())
-                    {
-                        self->req.headers.emplace(std::move(self->header_field), std::move(self->header_value));
-                    }
-                    self->header_field.assign(at, at + length);
+                    self->req.headers.add().first.assign(at, length);
                     self->header_building_state = 1;
                     break;
                 case 1:
-                    self->header_field.insert(self->header_field.end(), at, at + length);
+                    self->req.headers.back().first.append(at, length);
                     break;
             }
             return 0;
@@ -60,26 +57,13 @@ namespace crow
         static int on_header_value(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            switch (self->header_building_state)
-            {
-                case 0:
-                    self->header_value.insert(self->header_value.end(), at, at + length);
-                    break;
-                case 1:
-                    self->header_building_state = 0;
-                    self->header_value.assign(at, at + length);
-                    break;
-            }
+            self->header_building_state = 0;
+            self->req.headers.back().second.append(at, length);
             return 0;
         }
         static int on_headers_complete(http_parser* self_)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            if (!self->header_field.empty())
-            {
-                self->req.headers.emplace(std::move(self->header_field), std::move(self->header_value));
-            }
-
             self->set_connection_parameters();
 
             self->process_header();
@@ -88,7 +72,7 @@ namespace crow
         static int on_body(http_parser* self_, const char* at, size_t length)
         {
             HTTPParser* self = static_cast<HTTPParser*>(self_);
-            self->req.body.insert(self->req.body.end(), at, at + length);
+            self->req.body.append(at, length);
             return 0;
         }
         static int on_message_complete(http_parser* self_)
@@ -112,6 +96,11 @@ namespace crow
             if (message_complete)
                 return true;
 
+            // the usual request arrives whole in a single read and skips the state machine
+            bool scanned_ok;
+            if (state == CROW_start_state && length > 0 && feed_whole(buffer, static_cast<size_t>(length), scanned_ok))
+                return scanned_ok;
+
             const static http_parser_settings settings_{
               on_message_begin,
               on_method,
@@ -138,15 +127,66 @@ namespace crow
 
         void clear()
         {
-            req = crow::request();
-            header_field.clear();
-            header_value.clear();
+            req.clear();
             header_building_state = 0;
             qs_point = 0;
             message_complete = false;
             state = CROW_NEW_MESSAGE();
         }
 
+        /// Fill in the url and parameters from the raw url, in place since a connection's request keeps the memory of the previous one
+        void split_url()
+        {
+            req.url_params.assign(req.raw_url.data(), req.raw_url.size());
+            // qs_point is relative to the piece of the URL in the last read, so look for the '?' in all of it
+            req.url.assign(req.raw_url, 0, req.raw_url.find('?'));
+        }
+
+        /// Parse a complete request (head and body) in one pass with detail::scan_request_head.
+
+        ///
+        /// Returns false without having touched anything if the request has to go through the state machine,
+        /// otherwise `ok` is what feed() returns.
+        bool feed_whole(const char* buffer, size_t length, bool& ok)
+        {
+            detail::request_head head;
+            if (!detail::scan_request_head(buffer, length, head, req.headers) || length - head.size != head.content_length)
+            {
+                req.headers.clear();
+                return false;
+            }
+
+            method = static_cast<unsigned>(head.method);
+            http_major = 1;
+            http_minor = head.http_minor;
+            flags = (head.keep_alive ? F_CONNECTION_KEEP_ALIVE : 0) | (head.close ? F_CONNECTION_CLOSE : 0) | (head.content_length ? F_CONTENTLENGTH : 0);
+            upgrade = 0;
+            content_length = head.content_length;
+
+            req.method = head.method;
+            req.raw_url.assign(head.url, head.url_size);
+            split_url();
+            // where the state machine would be when it hands out the url,
+            // so a handler ending the request from handle_url() through done() gets the same result
+            state = s_req_http_start;
+            process_url();
+            if (http_errno != CHPE_OK)
+            {
+                ok = false;
+                return true;
+            }
+
+            set_connection_parameters();
+            process_header();
+
+            req.body.assign(buffer + head.size, head.content_length);
+            state = s_message_done;
+            message_complete = true;
+            process_message();
+            ok = true;
+            return true;
+        }
+
         inline void process_url()
         {
             handler_->handle_url();
@@ -189,8 +229,6 @@ namespace crow
     private:
         int header_building_state = 0;
         bool message_complete = false;
-        std::string header_field;
-        std::string header_value;
 
         Handler* handler_; ///< This is currently an HTTP connection object (\ref crow.Connection).
     };
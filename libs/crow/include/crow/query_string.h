@@ -7,6 +7,7 @@
 #include <unordered_map>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 
 namespace crow
 {
@@ -344,6 +345,29 @@ namespace crow
             key_value_pairs_.resize(count);
         }
 
+        /// Parse the parameters of another URL, reusing the memory of the previous ones.
+        /// A URL without a `?` or `#` is not copied at all.
+        void assign(const char* data, size_t size, bool url = true)
+        {
+            key_value_pairs_.clear();
+            if (url && std::find_if(data, data + size, [](char c) {
+                           return c == '?' || c == '#';
+                       }) == data + size)
+            {
+                url_.clear();
+                return;
+            }
+
+            url_.assign(data, size);
+            if (url_.empty())
+                return;
+
+            key_value_pairs_.resize(MAX_KEY_VALUE_PAIRS_COUNT);
+
+            size_t count = qs_parse(&url_[0], &key_value_pairs_[0], MAX_KEY_VALUE_PAIRS_COUNT, url);
+            key_value_pairs_.resize(count);
+        }
+
         void clear()
         {
             key_value_pairs_.clear();
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace crow
+{
+    /// Memory for whatever a handler builds while answering a request, released all at once when the connection moves on to the next request.
+
+    ///
+    /// Allocating only moves a pointer forward in the current block and nothing is freed on its own, so the
+    /// threads serving requests don't contend on the global allocator for short lived strings and maps.
+    /// `reset()` keeps a single block, sized for what the last request used, for the next one.
+    class request_arena
+    {
+    public:
+        request_arena() = default;
+
+        /// A copy starts empty, what was allocated belongs to the original
+        request_arena(const request_arena&) {}
+        request_arena& operator=(const request_arena&) { return *this; }
+
+        request_arena(request_arena&& other) noexcept:
+          blocks_(std::move(other.blocks_)), used_(other.used_)
+        {
+            other.blocks_.clear();
+            other.used_ = 0;
+        }
+
+        request_arena& operator=(request_arena&& other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                blocks_ = std::move(other.blocks_);
+                used_ = other.used_;
+                other.blocks_.clear();
+                other.used_ = 0;
+            }
+            return *this;
+        }
+
+        ~request_arena()
+        {
+            release();
+        }
+
+        /// `size` bytes aligned to `alignment` (a power of 2), valid until the next `reset()`
+        void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+        {
+            if (!blocks_.empty())
+            {
+                std::size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+                if (offset + size <= blocks_.back().size)
+                {
+                    used_ = offset + size;
+                    return blocks_.back().data + offset;
+                }
+            }
+
+            std::size_t block_size = first_block_size;
+            if (!blocks_.empty())
+                block_size = blocks_.back().size * 2;
+            if (block_size < size + alignment)
+                block_size = size + alignment;
+            add_block(block_size);
+
+            auto address = reinterpret_cast<std::uintptr_t>(blocks_.back().data);
+            std::size_t offset = static_cast<std::size_t>(((address + alignment - 1) & ~(alignment - 1)) - address);
+            used_ = offset + size;
+            return blocks_.back().data + offset;
+        }
+
+        /// Make all the memory available again, everything allocated before is invalid afterwards
+        void reset()
+        {
+            if (blocks_.size() > 1 || (blocks_.size() == 1 && blocks_[0].size > max_retained))
+            {
+                std::size_t retained = capacity();
+                if (retained > max_retained)
+                    retained = max_retained;
+                release();
+                add_block(retained);
+            }
+            used_ = 0;
+        }
+
+        /// The memory held, allocated or not
+        std::size_t capacity() const
+        {
+            std::size_t total = 0;
+            for (const auto& block : blocks_)
+                total += block.size;
+            return total;
+        }
+
+        /// The number of blocks memory was taken from since the last `reset()`
+        std::size_t block_count() const
+        {
+            return blocks_.size();
+        }
+
+        static constexpr std::size_t first_block_size = 4 * 1024;
+        static constexpr std::size_t max_retained = 64 * 1024; ///< More than this is returned to the system on `reset()`
+
+    private:
+        struct block
+        {
+            char* data;
+            std::size_t size;
+        };
+
+        void add_block(std::size_t size)
+        {
+            blocks_.reserve(blocks_.size() + 1);
+            blocks_.push_back(block{static_cast<char*>(::operator new(size)), size});
+            used_ = 0;
+        }
+
+        void release()
+        {
+            for (auto& block : blocks_)
+                ::operator delete(block.data);
+            blocks_.clear();
+            used_ = 0;
+        }
+
+        std::vector<block> blocks_;
+        std::size_t used_ = 0; ///< Bytes taken from the last block
+    };
+
+    /// A standard allocator taking its memory from a request_arena, for containers built while handling a request.
+
+    ///
+    /// Constructed from `req.arena`, deallocating does nothing and the memory comes back with the request.
+    /// A default constructed allocator uses the heap, so the same container type also works outside of a request.
+    template<typename T>
+    class arena_allocator
+    {
+    public:
+        using value_type = T;
+
+        arena_allocator() = default;
+
+        arena_allocator(request_arena& arena) noexcept:
+          arena_(&arena)
+        {}
+
+        template<typename U>
+        arena_allocator(const arena_allocator<U>& other) noexcept:
+          arena_(other.arena())
+        {}
+
+        T* allocate(std::size_t n)
+        {
+            if (arena_)
+                return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t) noexcept
+        {
+            if (!arena_)
+                ::operator delete(p);
+        }
+
+        request_arena* arena() const noexcept
+        {
+            return arena_;
+        }
+
+    private:
+        request_arena* arena_ = nullptr;
+    };
+
+    template<typename T, typename U>
+    bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept
+    {
+        return a.arena() == b.arena();
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept
+    {
+        return a.arena() != b.arena();
+    }
+} // namespace crow
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crow/ci_map.h"
+
+namespace crow
+{
+    /// The headers of a request in the order they arrived, looked up case insensitively.
+
+    ///
+    /// A request carries a few dozen headers at most, so comparing the names one after the other is cheaper than hashing them.
+    /// `clear()` only forgets the headers, the next request on the connection is parsed into the memory of their strings.
+    class request_headers
+    {
+    public:
+        using value_type = std::pair<std::string, std::string>;
+        using iterator = std::vector<value_type>::iterator;
+        using const_iterator = std::vector<value_type>::const_iterator;
+
+        request_headers() = default;
+
+        /// Copy the headers out of a ci_map
+        explicit request_headers(const ci_map& headers)
+        {
+            for (auto& header : headers)
+                emplace(header.first, header.second);
+        }
+
+        iterator begin() { return entries_.begin(); }
+        iterator end() { return entries_.begin() + size_; }
+        const_iterator begin() const { return entries_.begin(); }
+        const_iterator end() const { return entries_.begin() + size_; }
+
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        iterator emplace(std::string key, std::string value)
+        {
+            value_type& header = add();
+            header.first = std::move(key);
+            header.second = std::move(value);
+            return end() - 1;
+        }
+
+        /// Add an empty header, for the parser to append the name and value to as they arrive
+        value_type& add()
+        {
+            if (size_ == entries_.size())
+                entries_.emplace_back();
+            value_type& header = entries_[size_++];
+            header.first.clear();
+            header.second.clear();
+            return header;
+        }
+
+        /// The header added last
+        value_type& back() { return entries_[size_ - 1]; }
+
+        /// The first header with the given name
+        iterator find(const std::string& key) { return begin() + index_of(key.data(), key.size()); }
+        iterator find(const char* key) { return begin() + index_of(key, std::strlen(key)); }
+        const_iterator find(const std::string& key) const { return begin() + index_of(key.data(), key.size()); }
+        const_iterator find(const char* key) const { return begin() + index_of(key, std::strlen(key)); }
+
+        std::size_t count(const std::string& key) const { return count(key.data(), key.size()); }
+        std::size_t count(const char* key) const { return count(key, std::strlen(key)); }
+
+        /// Forget the headers while keeping their memory
+        void clear()
+        {
+            size_ = 0;
+            // don't keep holding on to an unusually large request
+            if (entries_.size() > max_kept)
+                entries_.resize(max_kept);
+        }
+
+    private:
+        static constexpr std::size_t max_kept = 64;
+
+        static bool name_equals(const std::string& name, const char* key, std::size_t length)
+        {
+            if (name.size() != length)
+                return false;
+            for (std::size_t i = 0; i < length; i++)
+            {
+                if (std::tolower(static_cast<unsigned char>(name[i])) != std::tolower(static_cast<unsigned char>(key[i])))
+                    return false;
+            }
+            return true;
+        }
+
+        std::size_t index_of(const char* key, std::size_t length) const
+        {
+            for (std::size_t i = 0; i < size_; i++)
+            {
+                if (name_equals(entries_[i].first, key, length))
+                    return i;
+            }
+            return size_;
+        }
+
+        std::size_t count(const char* key, std::size_t length) const
+        {
+            std::size_t found = 0;
+            for (std::size_t i = 0; i < size_; i++)
+            {
+                if (name_equals(entries_[i].first, key, length))
+                    found++;
+            }
+            return found;
+        }
+
+        std::vector<value_type> entries_;
+        std::size_t size_ = 0;
+    };
+} // namespace crow
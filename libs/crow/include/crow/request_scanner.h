@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include "crow/common.h"
+#include "crow/request_headers.h"
+
+namespace crow
+{
+    namespace detail
+    {
+        /// What scan_request_head found besides the headers
+        struct request_head
+        {
+            HTTPMethod method;
+            const char* url;
+            std::size_t url_size;
+            unsigned char http_minor;
+            bool keep_alive; ///< `Connection: keep-alive`
+            bool close;      ///< `Connection: close`
+            std::uint64_t content_length;
+            std::size_t size; ///< The request line and headers, including the empty line after them
+        };
+
+        /// Byte ranges (pairs of inclusive bounds) the scanner stops at, padded to the 16 bytes SSE4.2 compares against
+        struct stop_ranges
+        {
+            char bounds[16];
+            int size;
+        };
+
+        // controls, space and everything past ASCII end a URL, a '#' is left to the state machine which refuses fragments
+        static const stop_ranges url_stops = {{'\x00', ' ', '#', '#', '\x7f', '\xff'}, 6};
+        // controls other than tab end a header value, CR being the one that should
+        static const stop_ranges value_stops = {{'\x00', '\x08', '\x0a', '\x1f', '\x7f', '\x7f'}, 6};
+        // everything that isn't a token character, plus '|' and '~' which are (only 8 ranges fit)
+        static const stop_ranges name_stops = {{'\x00', ' ', '"', '"', '(', ')', ',', ',', '/', '/', ':', '@', '[', ']', '{', '\xff'}, 16};
+
+        // the same sets one byte at a time, for the end of the buffer and builds without SSE4.2
+        inline bool is_url_stop(unsigned char c) { return c <= ' ' || c == '#' || c >= 0x7f; }
+        inline bool is_value_stop(unsigned char c) { return (c < ' ' && c != '\t') || c == 0x7f; }
+        inline bool is_name_stop(unsigned char c)
+        {
+            // bit per byte, set for ALPHA, DIGIT and !#$%&'*+-.^_`|~
+            static const std::uint64_t tokens[4] = {0x03ff6cfa00000000, 0x57ffffffc7fffffe, 0, 0};
+            return !((tokens[c >> 6] >> (c & 63)) & 1);
+        }
+
+        /// The first byte in [p, end) that `stop` is true for, or end.
+        /// Built with SSE4.2 it compares 16 bytes at a time against `ranges`, which may include bytes `stop` is false for.
+        template<typename Stop>
+        inline const char* find_stop(const char* p, const char* end, const stop_ranges& ranges, Stop stop)
+        {
+#ifdef __SSE4_2__
+            const __m128i bounds = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ranges.bounds));
+            for (; end - p >= 16; p += 16)
+            {
+                const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+                int found = _mm_cmpestri(bounds, ranges.size, block, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+                if (found != 16)
+                    return p + found;
+            }
+#else
+            (void)ranges;
+#endif
+            for (; p != end; p++)
+            {
+                if (stop(static_cast<unsigned char>(*p)))
+                    return p;
+            }
+            return end;
+        }
+
+        inline bool equals_lowercase(const char* data, std::size_t size, const char* lowercase, std::size_t lowercase_size)
+        {
+            if (size != lowercase_size)
+                return false;
+            for (std::size_t i = 0; i < size; i++)
+            {
+                char c = data[i];
+                if (c >= 'A' && c <= 'Z')
+                    c = static_cast<char>(c - 'A' + 'a');
+                if (c != lowercase[i])
+                    return false;
+            }
+            return true;
+        }
+
+        inline bool match_method(const char* data, std::size_t size, HTTPMethod& method)
+        {
+            for (unsigned i = 0; i < static_cast<unsigned>(HTTPMethod::InternalMethodCount); i++)
+            {
+                if (std::strlen(method_strings[i]) == size && std::memcmp(method_strings[i], data, size) == 0)
+                {
+                    method = static_cast<HTTPMethod>(i);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Sets the keep-alive and close flags from a Connection header, false if it asks for an upgrade
+        inline bool scan_connection(const char* value, std::size_t size, request_head& head)
+        {
+            const char* end = value + size;
+            while (value != end)
+            {
+                while (value != end && (*value == ' ' || *value == '\t' || *value == ','))
+                    value++;
+                const char* token = value;
+                while (value != end && *value != ',' && *value != ' ' && *value != '\t')
+                    value++;
+                std::size_t token_size = value - token;
+                if (equals_lowercase(token, token_size, "keep-alive", 10))
+                    head.keep_alive = true;
+                else if (equals_lowercase(token, token_size, "close", 5))
+                    head.close = true;
+                else if (equals_lowercase(token, token_size, "upgrade", 7))
+                    return false;
+            }
+            return true;
+        }
+
+        /// Tokenize a request line and headers that arrived whole, adding the headers to `headers`.
+
+        ///
+        /// Replaces the byte at a time state machine for the usual request: every delimiter is found by scanning
+        /// (SSE4.2 range compares where available) instead of a state transition, and each header is copied once.
+        /// Anything out of the ordinary (a header block cut off by the end of the read, chunked bodies, upgrades,
+        /// obsolete line folding, absolute URLs, characters the state machine might treat differently)
+        /// makes it return false, the state machine then parses the request from the start and reports any error.
+        inline bool scan_request_head(const char* data, std::size_t size, request_head& head, request_headers& headers)
+        {
+            const char* p = data;
+            const char* end = data + size;
+
+            const char* method_end = static_cast<const char*>(std::memchr(p, ' ', size));
+            if (!method_end || !match_method(p, method_end - p, head.method) || head.method == HTTPMethod::Connect)
+                return false;
+
+            p = method_end + 1;
+            if (p == end || *p != '/')
+                return false;
+            head.url = p;
+            p = find_stop(p, end, url_stops, is_url_stop);
+            if (p == end || *p != ' ')
+                return false;
+            head.url_size = p - head.url;
+            p++;
+
+            if (end - p < 10 || std::memcmp(p, "HTTP/1.", 7) != 0 || (p[7] != '0' && p[7] != '1') || p[8] != '\r' || p[9] != '\n')
+                return false;
+            head.http_minor = static_cast<unsigned char>(p[7] - '0');
+            p += 10;
+
+            head.keep_alive = false;
+            head.close = false;
+            head.content_length = 0;
+            bool has_content_length = false;
+            while (true)
+            {
+                if (end - p < 2)
+                    return false;
+                if (p[0] == '\r')
+                {
+                    if (p[1] != '\n')
+                        return false;
+                    p += 2;
+                    break;
+                }
+
+                const char* name = p;
+                while (true)
+                {
+                    p = find_stop(p, end, name_stops, is_name_stop);
+                    if (p == end)
+                        return false;
+                    if (*p == '|' || *p == '~')
+                        p++;
+                    else
+                        break;
+                }
+                if (*p != ':' || p == name)
+                    return false;
+                std::size_t name_size = p - name;
+                p++;
+
+                while (p != end && (*p == ' ' || *p == '\t'))
+                    p++;
+                const char* value = p;
+                p = find_stop(p, end, value_stops, is_value_stop);
+                if (end - p < 3 || p[0] != '\r' || p[1] != '\n' || p[2] == ' ' || p[2] == '\t')
+                    return false;
+                std::size_t value_size = p - value;
+                p += 2;
+
+                switch (name_size)
+                {
+                    case 7:
+                        if (equals_lowercase(name, name_size, "upgrade", 7))
+                            return false;
+                        break;
+                    case 10:
+                        if (equals_lowercase(name, name_size, "connection", 10) && !scan_connection(value, value_size, head))
+                            return false;
+                        break;
+                    case 14:
+                        if (equals_lowercase(name, name_size, "content-length", 14))
+                        {
+                            if (has_content_length || value_size == 0 || value_size > 18)
+                                return false;
+                            for (std::size_t i = 0; i < value_size; i++)
+                            {
+                                if (value[i] < '0' || value[i] > '9')
+                                    return false;
+                                head.content_length = head.content_length * 10 + static_cast<std::uint64_t>(value[i] - '0');
+                            }
+                            has_content_length = true;
+                        }
+                        break;
+                    case 16:
+                        if (equals_lowercase(name, name_size, "proxy-connection", 16))
+                            return false;
+                        break;
+                    case 17:
+                        if (equals_lowercase(name, name_size, "transfer-encoding", 17))
+                            return false;
+                        break;
+                }
+
+                auto& header = headers.add();
+                header.first.assign(name, name_size);
+                header.second.assign(value, value_size);
+            }
+
+            head.size = p - data;
+            return true;
+        }
+    } // namespace detail
+} // namespace crow
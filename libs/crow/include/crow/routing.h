@@ -17,6 +17,7 @@
 #include "crow/websocket.h"
 #include "crow/mustache.h"
 #include "crow/middleware.h"
+#include "crow/static_routes.h"
 
 namespace crow
 {
@@ -136,8 +137,11 @@ namespace crow
 
         const std::string& rule() { return rule_; }
 
+        bool is_blocking() const { return blocking_; }
+
     protected:
         uint32_t methods_{1 << static_cast<int>(HTTPMethod::Get)};
+        bool blocking_{false};
 
         std::string rule_;
         std::string name_;
@@ -242,8 +246,7 @@ namespace crow
                       [f]
 #endif
                       (const request&, response& res, Args... args) {
-                          res = response(f(args...));
-                          res.end();
+                          detail::complete_with(res, f(args...));
                       });
                 }
 
@@ -257,8 +260,7 @@ namespace crow
 
                     void operator()(const request& req, response& res, Args... args)
                     {
-                        res = response(f(req, args...));
-                        res.end();
+                        detail::complete_with(res, f(req, args...));
                     }
 
                     Func f;
@@ -348,8 +350,7 @@ namespace crow
               [f]
 #endif
               (const request&, response& res) {
-                  res = response(f());
-                  res.end();
+                  detail::complete_with(res, f());
               });
         }
 
@@ -370,8 +371,7 @@ namespace crow
               [f]
 #endif
               (const crow::request& req, crow::response& res) {
-                  res = response(f(req));
-                  res.end();
+                  detail::complete_with(res, f(req));
               });
         }
 
@@ -558,6 +558,14 @@ namespace crow
             static_cast<self_t*>(this)->mw_indices_.template push<App, Middlewares...>();
             return static_cast<self_t&>(*this);
         }
+
+        /// Run this handler on the app's blocking workers instead of the IO thread,
+        /// for handlers that wait on disk, databases or other servers
+        self_t& blocking()
+        {
+            static_cast<self_t*>(this)->blocking_ = true;
+            return static_cast<self_t&>(*this);
+        }
     };
 
     /// A rule that can change its parameters during runtime.
@@ -702,6 +710,10 @@ namespace crow
 
 
     /// A search tree.
+
+    ///
+    /// Once validated, the URLs it can match without parameters are also kept in a perfect hash table,
+    /// only the other requests walk the tree.
     class Trie
     {
     public:
@@ -822,6 +834,7 @@ namespace crow
             CROW_LOG_DEBUG << "└➙ ROOT";
             for (const auto& child : head_.children)
                 debug_node_print(child, 1);
+            CROW_LOG_DEBUG << static_routes_.size() << " static URLs";
         }
 
         void validate()
@@ -829,6 +842,7 @@ namespace crow
             if (!head_.IsSimpleNode())
                 throw std::runtime_error("Internal error: Trie header should be simple!");
             optimize();
+            build_static_routes();
         }
 
         //Rule_index, Blueprint_index, routing_params
@@ -992,6 +1006,8 @@ namespace crow
 
         routing_handle_result find(const std::string& req_url) const
         {
+            if (auto static_route = static_routes_.find(req_url))
+                return *static_route;
             return find(req_url, head_);
         }
 
@@ -999,6 +1015,9 @@ namespace crow
         void add(const std::string& url, uint16_t rule_index, unsigned bp_prefix_length = 0, uint16_t blueprint_index = INVALID_BP_ID)
         {
             auto idx = &head_;
+            static_routes_.clear();
+            if (url.find('<') == std::string::npos)
+                static_urls_.push_back(url);
 
             bool has_blueprint = bp_prefix_length != 0 && blueprint_index != INVALID_BP_ID;
 
@@ -1082,7 +1101,23 @@ namespace crow
         }
 
     private:
+        // a URL without parameters always walks the tree the same way, so the table keeps what the walk returned,
+        // including a parameter rule that takes precedence over the static one
+        void build_static_routes()
+        {
+            std::sort(static_urls_.begin(), static_urls_.end());
+            static_urls_.erase(std::unique(static_urls_.begin(), static_urls_.end()), static_urls_.end());
+
+            std::vector<detail::static_route_table::route> routes;
+            routes.reserve(static_urls_.size());
+            for (const auto& url : static_urls_)
+                routes.emplace_back(url, find(url, head_));
+            static_routes_.build(std::move(routes));
+        }
+
         Node head_;
+        std::vector<std::string> static_urls_;
+        detail::static_route_table static_routes_;
     };
 
     /// A blueprint can be considered a smaller section of a Crow app, specifically where the router is conecerned.
@@ -1361,6 +1396,7 @@ namespace crow
             detail::middleware_indices blueprint_mw;
             validate_bp(blueprints_, blueprint_mw);
 
+            has_blocking_rules_ = false;
             for (auto& rule : all_rules_)
             {
                 if (rule)
@@ -1370,6 +1406,7 @@ namespace crow
                         rule = std::move(upgraded);
                     rule->validate();
                     internal_add_rule_object(rule->rule(), rule.get(), INVALID_BP_ID, blueprints_);
+                    has_blocking_rules_ |= rule->is_blocking();
                 }
             }
             for (auto& per_method : per_methods_)
@@ -1644,6 +1681,22 @@ namespace crow
             }
         }
 
+        bool has_blocking_rules() const
+        {
+            return has_blocking_rules_;
+        }
+
+        /// Whether the matched rule asked to be run away from the IO threads
+        bool is_blocking(const routing_handle_result& found) const
+        {
+            if (found.method >= HTTPMethod::InternalMethodCount)
+                return false;
+            auto& rules = per_methods_[static_cast<int>(found.method)].rules;
+            if (found.rule_index == RULE_SPECIAL_REDIRECT_SLASH || found.rule_index >= rules.size())
+                return false;
+            return rules[found.rule_index] && rules[found.rule_index]->is_blocking();
+        }
+
         template<typename App>
         void handle(request& req, response& res, routing_handle_result found)
         {
@@ -1770,6 +1823,7 @@ namespace crow
               rules(2) {}
         };
         std::array<PerMethod, static_cast<int>(HTTPMethod::InternalMethodCount)> per_methods_;
+        bool has_blocking_rules_{false};
         std::vector<std::unique_ptr<BaseRule>> all_rules_;
         std::vector<Blueprint*> blueprints_;
     };
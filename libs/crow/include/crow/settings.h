@@ -50,6 +50,13 @@
 #endif
 #endif
 
+// handlers may be coroutines returning crow::task<T> (C++20)
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CROW_CAN_USE_COROUTINES
+#endif
+#endif
+
 #if defined(_MSC_VER)
 #if _MSC_VER < 1900
 #define CROW_MSVC_WORKAROUND
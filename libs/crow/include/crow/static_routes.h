@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "crow/common.h"
+
+namespace crow
+{
+    namespace detail
+    {
+        /// Exact lookup of the URLs a Trie can match without parameters, built once the Trie is complete.
+
+        ///
+        /// A perfect hash (hash and displace): the URLs are grouped in buckets by one half of their hash, then each bucket
+        /// is given a seed that sends all of its URLs to free slots. A lookup hashes the URL once and compares it with a single key.
+        class static_route_table
+        {
+        public:
+            using route = std::pair<std::string, routing_handle_result>;
+
+            void clear()
+            {
+                seeds_.clear();
+                slots_.clear();
+            }
+
+            bool empty() const { return slots_.empty(); }
+
+            /// The number of URLs in the table
+            std::size_t size() const
+            {
+                return std::count_if(slots_.begin(), slots_.end(), [](const slot& s) {
+                    return s.used;
+                });
+            }
+
+            /// Place every route (the URLs must be unique), the table stays empty in the unlikely case no seeds are found
+            void build(std::vector<route> routes)
+            {
+                clear();
+                if (routes.empty())
+                    return;
+
+                std::size_t count = routes.size();
+                std::vector<std::uint64_t> hashes(count);
+                for (unsigned attempt = 0; attempt < 8; attempt++)
+                {
+                    salt_ = 0x9e3779b97f4a7c15ull * (attempt + 1);
+                    std::size_t bucket_count = (count + 3) / 4;
+                    std::size_t slot_count = count + count / 4 + 1 + attempt * count / 2;
+
+                    std::vector<std::vector<std::size_t>> buckets(bucket_count);
+                    for (std::size_t i = 0; i < count; i++)
+                    {
+                        hashes[i] = hash(routes[i].first.data(), routes[i].first.size(), salt_);
+                        buckets[(hashes[i] >> 32) % bucket_count].push_back(i);
+                    }
+
+                    std::vector<std::size_t> order(bucket_count);
+                    for (std::size_t b = 0; b < bucket_count; b++)
+                        order[b] = b;
+                    std::sort(order.begin(), order.end(), [&buckets](std::size_t a, std::size_t b) {
+                        return buckets[a].size() > buckets[b].size();
+                    });
+
+                    std::vector<std::uint32_t> seeds(bucket_count);
+                    std::vector<std::size_t> owner(slot_count, count); // the route in each slot, count for a free one
+                    if (!place(buckets, order, hashes, seeds, owner))
+                        continue;
+
+                    seeds_ = std::move(seeds);
+                    slots_.resize(slot_count);
+                    for (std::size_t s = 0; s < slot_count; s++)
+                    {
+                        if (owner[s] == count)
+                            continue;
+                        slots_[s].used = true;
+                        slots_[s].url = std::move(routes[owner[s]].first);
+                        slots_[s].result = std::move(routes[owner[s]].second);
+                    }
+                    return;
+                }
+            }
+
+            /// The result stored for `url`, nullptr if it isn't in the table
+            const routing_handle_result* find(const std::string& url) const
+            {
+                if (slots_.empty())
+                    return nullptr;
+                std::uint64_t h = hash(url.data(), url.size(), salt_);
+                const slot& s = slots_[mix(h, seeds_[(h >> 32) % seeds_.size()]) % slots_.size()];
+                if (s.used && s.url == url)
+                    return &s.result;
+                return nullptr;
+            }
+
+        private:
+            struct slot
+            {
+                std::string url;
+                routing_handle_result result;
+                bool used = false;
+            };
+
+            // FNV-1a, started from the salt
+            static std::uint64_t hash(const char* data, std::size_t size, std::uint64_t salt)
+            {
+                std::uint64_t h = 0xcbf29ce484222325ull ^ salt;
+                for (std::size_t i = 0; i < size; i++)
+                {
+                    h ^= static_cast<unsigned char>(data[i]);
+                    h *= 0x100000001b3ull;
+                }
+                return h;
+            }
+
+            // the finalizer of MurmurHash3, so every seed scatters the URLs differently
+            static std::uint64_t mix(std::uint64_t h, std::uint32_t seed)
+            {
+                h ^= seed * 0x9e3779b97f4a7c15ull;
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccdull;
+                h ^= h >> 33;
+                h *= 0xc4ceb9fe1a85ec53ull;
+                h ^= h >> 33;
+                return h;
+            }
+
+            // find a seed for each bucket, largest first, that places its routes in free slots
+            static bool place(const std::vector<std::vector<std::size_t>>& buckets, const std::vector<std::size_t>& order,
+                              const std::vector<std::uint64_t>& hashes, std::vector<std::uint32_t>& seeds, std::vector<std::size_t>& owner)
+            {
+                std::size_t free_slot = hashes.size();
+                std::vector<std::size_t> placed;
+                for (std::size_t b : order)
+                {
+                    const auto& bucket = buckets[b];
+                    if (bucket.empty())
+                        break;
+
+                    bool found = false;
+                    for (std::uint32_t seed = 1; seed < (1u << 16) && !found; seed++)
+                    {
+                        placed.clear();
+                        for (std::size_t i : bucket)
+                        {
+                            std::size_t s = mix(hashes[i], seed) % owner.size();
+                            if (owner[s] != free_slot || std::find(placed.begin(), placed.end(), s) != placed.end())
+                                break;
+                            placed.push_back(s);
+                        }
+                        if (placed.size() != bucket.size())
+                            continue;
+
+                        for (std::size_t i = 0; i < bucket.size(); i++)
+                            owner[placed[i]] = bucket[i];
+                        seeds[b] = seed;
+                        found = true;
+                    }
+                    if (!found)
+                        return false;
+                }
+                return true;
+            }
+
+            std::uint64_t salt_ = 0;
+            std::vector<std::uint32_t> seeds_;
+            std::vector<slot> slots_;
+        };
+    } // namespace detail
+} // namespace crow
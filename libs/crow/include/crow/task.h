@@ -0,0 +1,346 @@
+#pragma once
+
+#ifndef ASIO_STANDALONE
+#define ASIO_STANDALONE
+#endif
+#include <asio.hpp>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "crow/settings.h"
+#include "crow/http_request.h"
+#include "crow/http_response.h"
+#include "crow/logging.h"
+#include "crow/worker_pool.h"
+
+#ifdef CROW_CAN_USE_COROUTINES
+#include <coroutine>
+#include <optional>
+#endif
+
+namespace crow
+{
+    namespace detail
+    {
+        /// Turn whatever a handler returned into the response and end it
+        template<typename T>
+        void complete_with(response& res, T&& value)
+        {
+            res = response(std::forward<T>(value));
+            res.end();
+        }
+    } // namespace detail
+
+#ifdef CROW_CAN_USE_COROUTINES
+    template<typename T = void>
+    class task;
+
+    namespace detail
+    {
+        struct task_promise_base
+        {
+            // resumed when the task finishes, whoever awaited it
+            std::coroutine_handle<> continuation = std::noop_coroutine();
+            std::exception_ptr exception;
+
+            struct final_awaiter
+            {
+                bool await_ready() noexcept { return false; }
+
+                template<typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+                {
+                    return handle.promise().continuation;
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            final_awaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() noexcept { exception = std::current_exception(); }
+        };
+
+        template<typename T>
+        struct task_promise : task_promise_base
+        {
+            std::optional<T> value;
+
+            task<T> get_return_object() noexcept;
+
+            template<typename U>
+            void return_value(U&& result)
+            {
+                value.emplace(std::forward<U>(result));
+            }
+
+            T take()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+                return std::move(*value);
+            }
+        };
+
+        template<>
+        struct task_promise<void> : task_promise_base
+        {
+            task<void> get_return_object() noexcept;
+
+            void return_void() noexcept {}
+
+            void take()
+            {
+                if (exception)
+                    std::rethrow_exception(exception);
+            }
+        };
+    } // namespace detail
+
+    /// The return type of coroutines, including route handlers (`crow::task<crow::response>`).
+
+    ///
+    /// A task starts running when it's awaited, or for a handler when Crow calls it,
+    /// and resumes whoever awaited it once it `co_return`s. Exceptions travel to the awaiting coroutine.
+    template<typename T>
+    class task
+    {
+    public:
+        using promise_type = detail::task_promise<T>;
+        using value_type = T;
+
+        explicit task(std::coroutine_handle<promise_type> handle) noexcept:
+          handle_(handle)
+        {}
+
+        task(task&& other) noexcept:
+          handle_(std::exchange(other.handle_, nullptr))
+        {}
+
+        task& operator=(task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task()
+        {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        auto operator co_await() && noexcept
+        {
+            struct awaiter
+            {
+                std::coroutine_handle<promise_type> handle;
+
+                bool await_ready() noexcept { return !handle || handle.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+
+                T await_resume() { return handle.promise().take(); }
+            };
+            return awaiter{handle_};
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    namespace detail
+    {
+        template<typename T>
+        task<T> task_promise<T>::get_return_object() noexcept
+        {
+            return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+        }
+
+        inline task<void> task_promise<void>::get_return_object() noexcept
+        {
+            return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+        }
+
+        /// A coroutine nobody waits for, its frame frees itself when it finishes
+        struct detached
+        {
+            struct promise_type
+            {
+                detached get_return_object() noexcept { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() noexcept {}
+                void unhandled_exception() noexcept { std::terminate(); }
+            };
+        };
+
+        template<typename T, typename Done, typename Fail>
+        detached spawn(task<T> work, Done done, Fail fail)
+        {
+            std::optional<T> value;
+            std::exception_ptr error;
+            try
+            {
+                value.emplace(co_await std::move(work));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            if (error)
+                fail(error);
+            else
+                done(std::move(*value));
+        }
+
+        /// A handler returned a task, the response ends whenever the task finishes.
+        /// The connection stays alive until then since it waits on the response.
+        template<typename T>
+        void complete_with(response& res, task<T>&& work)
+        {
+            spawn(
+              std::move(work),
+              [&res](T&& value) {
+                  res = response(std::move(value));
+                  res.end();
+              },
+              [&res](std::exception_ptr error) {
+                  try
+                  {
+                      std::rethrow_exception(error);
+                  }
+                  catch (const std::exception& e)
+                  {
+                      CROW_LOG_ERROR << "An uncaught exception occurred in a coroutine handler: " << e.what();
+                  }
+                  catch (...)
+                  {
+                      CROW_LOG_ERROR << "An uncaught exception occurred in a coroutine handler. The type was unknown so no information was available.";
+                  }
+                  res = response(500);
+                  res.end();
+              });
+        }
+    } // namespace detail
+
+    /// Continue the coroutine on the given io_service, e.g. `co_await crow::resume_on(*req.io_service)`
+    inline auto resume_on(asio::io_service& io_service)
+    {
+        struct awaiter
+        {
+            asio::io_service& io_service;
+
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                asio::post(io_service, [handle] {
+                    handle.resume();
+                });
+            }
+
+            void await_resume() noexcept {}
+        };
+        return awaiter{io_service};
+    }
+
+    namespace detail
+    {
+        template<typename T>
+        struct blocking_result
+        {
+            std::optional<T> value;
+
+            template<typename F>
+            void run(F& f) { value.emplace(f()); }
+
+            T take() { return std::move(*value); }
+        };
+
+        template<>
+        struct blocking_result<void>
+        {
+            template<typename F>
+            void run(F& f) { f(); }
+
+            void take() {}
+        };
+    } // namespace detail
+
+    /// Run `f` on a worker pool and continue with its result on the io_service, for work that can only block
+    /// (SQLite, reading files). Without a pool or io_service, or with the pool's queue full, `f` runs right away on the current thread.
+    template<typename F>
+    auto blocking(detail::worker_pool* pool, asio::io_service* io_service, F f)
+    {
+        using result_t = decltype(f());
+
+        struct awaiter
+        {
+            detail::worker_pool* pool;
+            asio::io_service* io_service;
+            F f;
+            detail::blocking_result<result_t> result;
+            std::exception_ptr error;
+            bool ran = false;
+
+            bool await_ready() noexcept { return !pool || !io_service; }
+
+            bool await_suspend(std::coroutine_handle<> handle)
+            {
+                // the awaiter lives in the suspended coroutine's frame until it's resumed
+                return pool->try_post([this, handle] {
+                    run();
+                    asio::post(*io_service, [handle] {
+                        handle.resume();
+                    });
+                });
+            }
+
+            result_t await_resume()
+            {
+                if (!ran)
+                    run();
+                if (error)
+                    std::rethrow_exception(error);
+                return result.take();
+            }
+
+            void run()
+            {
+                ran = true;
+                try
+                {
+                    result.run(f);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+            }
+        };
+        return awaiter{pool, io_service, std::move(f), {}, nullptr};
+    }
+
+    /// `blocking` on the app's blocking workers, continuing on the request's io_service
+    template<typename App, typename F>
+    auto blocking(App& app, const request& req, F f)
+    {
+        return blocking(app.blocking_pool(), req.io_service, std::move(f));
+    }
+#endif
+} // namespace crow
@@ -7,9 +7,10 @@
 #include <asio/basic_waitable_timer.hpp>
 
 #include <chrono>
+#include <cstdint>
 #include <functional>
-#include <map>
-#include <vector>
+#include <memory>
+#include <unordered_map>
 
 #include "crow/logging.h"
 
@@ -18,64 +19,165 @@ namespace crow
     namespace detail
     {
 
-        /// A class for scheduling functions to be called after a specific amount of ticks. A tick is equal to 1 second.
+        /// An intrusive entry of a task_timer, embedded in whatever owns the timeout so scheduling never allocates.
+        struct timer_node
+        {
+            /// Called with `expired` true once the timeout passes, or false when the task_timer is destroyed while the node is still scheduled.
+            /// The node is no longer scheduled when this runs and may be scheduled again from inside of it.
+            void (*callback)(timer_node& node, bool expired) = nullptr;
+
+            bool scheduled() const { return prev != nullptr; }
+
+        private:
+            friend class task_timer;
+
+            timer_node* prev = nullptr;
+            timer_node* next = nullptr;
+            std::uint64_t expires = 0;
+        };
+
+        /// A hierarchical timing wheel calling functions after a timeout, with a resolution of one tick (100ms).
+
+        ///
+        /// Scheduling and cancelling are O(1), a tick only touches the tasks that are due (and every 64 ticks the ones moving down a level),
+        /// so the cost stays the same no matter how many idle connections are waiting on their keep-alive timeout.
+        /// The asio timer only runs while something is scheduled. Not thread safe, use it from the io_service's thread.
         class task_timer
         {
         public:
             using task_type = std::function<void()>;
             using identifier_type = size_t;
+            using duration_type = std::chrono::milliseconds;
+
+            /// The resolution of the timer
+            static duration_type tick() { return duration_type(100); }
 
         private:
             using clock_type = std::chrono::steady_clock;
             using time_type = clock_type::time_point;
 
+            static constexpr unsigned level_bits = 6;
+            static constexpr unsigned level_count = 4;
+            static constexpr std::uint64_t slot_count = 1 << level_bits;
+            static constexpr std::uint64_t slot_mask = slot_count - 1;
+            // ~19 days, longer timeouts are clamped
+            static constexpr std::uint64_t max_ticks = (std::uint64_t(1) << (level_bits * level_count)) - 1;
+
+            /// A node owning a std::function, for the identifier based interface
+            struct function_task : timer_node
+            {
+                task_timer* owner;
+                task_type task;
+                identifier_type id;
+            };
+
         public:
             task_timer(asio::io_service& io_service):
-              io_service_(io_service), timer_(io_service_)
+              io_service_(io_service), timer_(io_service_), start_(clock_type::now())
             {
-                timer_.expires_after(std::chrono::seconds(1));
-                timer_.async_wait(
-                  std::bind(&task_timer::tick_handler, this, std::placeholders::_1));
+                for (auto& level : wheel_)
+                    for (auto& slot : level)
+                        slot.prev = slot.next = &slot;
+            }
+
+            task_timer(const task_timer&) = delete;
+            task_timer& operator=(const task_timer&) = delete;
+
+            ~task_timer()
+            {
+                timer_.cancel();
+                for (auto& level : wheel_)
+                    for (auto& slot : level)
+                        while (slot.next != &slot)
+                        {
+                            timer_node& node = *slot.next;
+                            unlink(node);
+                            node.callback(node, false);
+                        }
             }
 
-            ~task_timer() { timer_.cancel(); }
+            /// Schedule the node to be called back after the timeout, rescheduling it if it already is.
+            void schedule(timer_node& node, duration_type timeout)
+            {
+                if (node.scheduled())
+                    unlink(node);
+
+                std::uint64_t now = elapsed_ticks();
+                if (scheduled_ == 0)
+                    // nothing can be skipped over when the wheel is empty
+                    current_ = now;
+
+                // rounded up, a timeout never fires early
+                auto ticks = static_cast<std::uint64_t>((timeout.count() + tick().count() - 1) / tick().count());
+                if (ticks == 0) ticks = 1;
+                if (ticks > max_ticks) ticks = max_ticks;
+                node.expires = now + ticks;
+                insert(node);
+
+                if (!armed_)
+                    arm();
+            }
+
+            /// Schedule the node to be called back after the default timeout.
+            void schedule(timer_node& node)
+            {
+                schedule(node, std::chrono::seconds(default_timeout_));
+            }
+
+            /// Cancel a scheduled node without calling it back, does nothing if it isn't scheduled.
+            void cancel(timer_node& node)
+            {
+                if (node.scheduled())
+                    unlink(node);
+            }
 
             void cancel(identifier_type id)
             {
-                tasks_.erase(id);
+                auto found = function_tasks_.find(id);
+                if (found == function_tasks_.end())
+                    return;
+                unlink(*found->second);
+                function_tasks_.erase(found);
                 CROW_LOG_DEBUG << "task_timer cancelled: " << this << ' ' << id;
             }
 
-            /// Schedule the given task to be executed after the default amount of ticks.
+            /// Schedule the given task to be executed after the default amount of seconds.
 
             ///
-            /// \return identifier_type Used to cancel the thread.
-            /// It is not bound to this task_timer instance and in some cases could lead to
-            /// undefined behavior if used with other task_timer objects or after the task
-            /// has been successfully executed.
+            /// \return identifier_type Used to cancel the task.
+            /// It is not bound to this task_timer instance and cancelling it on another task_timer does nothing.
             identifier_type schedule(const task_type& task)
             {
-                tasks_.insert(
-                  {++highest_id_,
-                   {clock_type::now() + std::chrono::seconds(get_default_timeout()),
-                    task}});
-                CROW_LOG_DEBUG << "task_timer scheduled: " << this << ' ' << highest_id_;
-                return highest_id_;
+                return schedule(task, default_timeout_);
             }
 
             /// Schedule the given task to be executed after the given time.
 
             ///
-            /// \param timeout The amount of ticks (seconds) to wait before execution.
+            /// \param timeout The amount of seconds to wait before execution.
             ///
-            /// \return identifier_type Used to cancel the thread.
-            /// It is not bound to this task_timer instance and in some cases could lead to
-            /// undefined behavior if used with other task_timer objects or after the task
-            /// has been successfully executed.
+            /// \return identifier_type Used to cancel the task.
+            /// It is not bound to this task_timer instance and cancelling it on another task_timer does nothing.
             identifier_type schedule(const task_type& task, std::uint8_t timeout)
             {
-                tasks_.insert({++highest_id_,
-                               {clock_type::now() + std::chrono::seconds(timeout), task}});
+                std::unique_ptr<function_task> entry(new function_task);
+                entry->owner = this;
+                entry->task = task;
+                entry->id = ++highest_id_;
+                entry->callback = [](timer_node& node, bool expired) {
+                    auto& tasks = static_cast<function_task&>(node).owner->function_tasks_;
+                    auto found = tasks.find(static_cast<function_task&>(node).id);
+                    // owned here until the task returns, it may schedule or cancel other tasks
+                    std::unique_ptr<function_task> entry = std::move(found->second);
+                    tasks.erase(found);
+                    if (expired)
+                    {
+                        CROW_LOG_DEBUG << "task_timer called: " << entry->owner << ' ' << entry->id;
+                        entry->task();
+                    }
+                };
+                schedule(*entry, std::chrono::seconds(timeout));
+                function_tasks_.emplace(highest_id_, std::move(entry));
                 CROW_LOG_DEBUG << "task_timer scheduled: " << this << ' ' << highest_id_;
                 return highest_id_;
             }
@@ -83,54 +185,124 @@ namespace crow
             /// Set the default timeout for this task_timer instance. (Default: 5)
 
             ///
-            /// \param timeout The amount of ticks (seconds) to wait before execution.
+            /// \param timeout The amount of seconds to wait before execution.
             void set_default_timeout(std::uint8_t timeout) { default_timeout_ = timeout; }
 
             /// Get the default timeout. (Default: 5)
             std::uint8_t get_default_timeout() const { return default_timeout_; }
 
+            /// The amount of nodes currently scheduled
+            size_t scheduled() const { return scheduled_; }
+
         private:
-            void process_tasks()
+            std::uint64_t elapsed_ticks() const
             {
-                time_type current_time = clock_type::now();
-                std::vector<identifier_type> finished_tasks;
+                return static_cast<std::uint64_t>(std::chrono::duration_cast<duration_type>(clock_type::now() - start_).count() / tick().count());
+            }
 
-                for (const auto& task : tasks_)
+            void insert(timer_node& node)
+            {
+                // expires is never before current_, nodes cascading down are due at the latest this tick
+                std::uint64_t delta = node.expires - current_;
+                if (delta > max_ticks)
                 {
-                    if (task.second.first < current_time)
-                    {
-                        (task.second.second)();
-                        finished_tasks.push_back(task.first);
-                        CROW_LOG_DEBUG << "task_timer called: " << this << ' ' << task.first;
-                    }
+                    delta = max_ticks;
+                    node.expires = current_ + max_ticks;
                 }
+                unsigned level = 0;
+                while (level + 1 < level_count && delta >= (std::uint64_t(1) << (level_bits * (level + 1))))
+                    level++;
+                timer_node& slot = wheel_[level][(node.expires >> (level_bits * level)) & slot_mask];
 
-                for (const auto& task : finished_tasks)
-                    tasks_.erase(task);
+                node.prev = slot.prev;
+                node.next = &slot;
+                slot.prev->next = &node;
+                slot.prev = &node;
+                scheduled_++;
+            }
 
-                // If no task is currently scheduled, reset the issued ids back to 0.
-                if (tasks_.empty()) highest_id_ = 0;
+            void unlink(timer_node& node)
+            {
+                node.prev->next = node.next;
+                node.next->prev = node.prev;
+                node.prev = node.next = nullptr;
+                scheduled_--;
             }
 
-            void tick_handler(const asio::error_code& ec)
+            /// Moves the nodes of a higher level slot down now that the wheel below it went around once
+            void cascade(unsigned level)
             {
-                if (ec) return;
+                timer_node& slot = wheel_[level][(current_ >> (level_bits * level)) & slot_mask];
+                if (level + 1 < level_count && ((current_ >> (level_bits * level)) & slot_mask) == 0)
+                    cascade(level + 1);
+                while (slot.next != &slot)
+                {
+                    timer_node& node = *slot.next;
+                    unlink(node);
+                    insert(node);
+                }
+            }
 
-                process_tasks();
+            void advance()
+            {
+                current_++;
+                if ((current_ & slot_mask) == 0)
+                    cascade(1);
+
+                // detach the due nodes first, callbacks may schedule or cancel anything including each other
+                timer_node& slot = wheel_[0][current_ & slot_mask];
+                timer_node due;
+                if (slot.next == &slot)
+                    return;
+                due.next = slot.next;
+                due.prev = slot.prev;
+                due.next->prev = &due;
+                due.prev->next = &due;
+                slot.prev = slot.next = &slot;
 
-                timer_.expires_after(std::chrono::seconds(1));
+                while (due.next != &due)
+                {
+                    timer_node& node = *due.next;
+                    unlink(node);
+                    node.callback(node, true);
+                }
+            }
+
+            void arm()
+            {
+                armed_ = true;
+                timer_.expires_at(start_ + tick() * static_cast<duration_type::rep>(current_ + 1));
                 timer_.async_wait(
                   std::bind(&task_timer::tick_handler, this, std::placeholders::_1));
             }
 
+            void tick_handler(const asio::error_code& ec)
+            {
+                armed_ = false;
+                if (ec) return;
+
+                std::uint64_t now = elapsed_ticks();
+                while (current_ < now && scheduled_ > 0)
+                    advance();
+
+                if (scheduled_ > 0)
+                    arm();
+            }
+
         private:
             std::uint8_t default_timeout_{5};
             asio::io_service& io_service_;
             asio::basic_waitable_timer<clock_type> timer_;
-            std::map<identifier_type, std::pair<time_type, task_type>> tasks_;
+            time_type start_;
+            // the last tick that was processed
+            std::uint64_t current_{0};
+            size_t scheduled_{0};
+            bool armed_{false};
+            // each slot is the sentinel of a circular list
+            timer_node wheel_[level_count][slot_count];
 
-            // A continuosly increasing number to be issued to threads to identify them.
-            // If no tasks are scheduled, it will be reset to 0.
+            std::unordered_map<identifier_type, std::unique_ptr<function_task>> function_tasks_;
+            // A continuously increasing number identifying the tasks scheduled with a std::function.
             identifier_type highest_id_{0};
         };
     } // namespace detail
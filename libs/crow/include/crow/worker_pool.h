@@ -0,0 +1,113 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "crow/logging.h"
+
+namespace crow
+{
+    namespace detail
+    {
+        /// A fixed number of threads running CPU heavy jobs away from the IO threads.
+        /// The queue is bounded, when it is full `try_post` refuses the job and the caller is expected to run it itself,
+        /// so a burst of work slows down the connections producing it instead of growing without limit.
+        class worker_pool
+        {
+        public:
+            worker_pool(std::size_t threads, std::size_t max_pending):
+              max_pending_(max_pending)
+            {
+                for (std::size_t i = 0; i < threads; i++)
+                    threads_.emplace_back([this] {
+                        run();
+                    });
+            }
+
+            worker_pool(const worker_pool&) = delete;
+            worker_pool& operator=(const worker_pool&) = delete;
+
+            ~worker_pool() { stop(); }
+
+            /// Queue a job, returns false if the queue is full or the pool is stopping
+            bool try_post(std::function<void()> job)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (stopping_ || jobs_.size() >= max_pending_)
+                        return false;
+                    jobs_.push_back(std::move(job));
+                }
+                cv_.notify_one();
+                return true;
+            }
+
+            /// Run the jobs still queued and join the threads
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stopping_ = true;
+                }
+                cv_.notify_all();
+                for (auto& thread : threads_)
+                {
+                    if (thread.joinable())
+                        thread.join();
+                }
+                threads_.clear();
+            }
+
+            std::size_t pending()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return jobs_.size();
+            }
+
+        private:
+            void run()
+            {
+                while (true)
+                {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        cv_.wait(lock, [this] {
+                            return stopping_ || !jobs_.empty();
+                        });
+                        if (jobs_.empty())
+                            return;
+                        job = std::move(jobs_.front());
+                        jobs_.pop_front();
+                    }
+
+                    try
+                    {
+                        job();
+                    }
+                    catch (const std::exception& e)
+                    {
+                        CROW_LOG_ERROR << "Worker job threw: " << e.what();
+                    }
+                    catch (...)
+                    {
+                        CROW_LOG_ERROR << "Worker job threw an unknown exception";
+                    }
+                }
+            }
+
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            std::deque<std::function<void()>> jobs_;
+            std::vector<std::thread> threads_;
+            std::size_t max_pending_;
+            bool stopping_{false};
+        };
+    } // namespace detail
+} // namespace crow
@@ -1,7 +1,43 @@
 #include <crow/http_response.h>
+#include <cstdio>
+#include <ctime>
 
 namespace crow
 {
+    static std::string format_http_date(time_t time)
+    {
+        tm my_tm;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+        gmtime_s(&my_tm, &time);
+#else
+        gmtime_r(&time, &my_tm);
+#endif
+        char date[64];
+        size_t size = strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &my_tm);
+        return std::string(date, size);
+    }
+    
+    std::string response::static_file_etag(const struct stat& statbuf)
+    {
+        // the same validator nginx uses, it changes whenever the file is rewritten without reading the file
+        char tag[48];
+        snprintf(tag, sizeof(tag), "\"%llx-%llx\"", static_cast<unsigned long long>(statbuf.st_mtime),
+                 static_cast<unsigned long long>(statbuf.st_size));
+        return tag;
+    }
+    
+
+    serialized_headers::serialized_headers(const ci_map& headers)
+    {
+        for (auto& kv : headers)
+        {
+            if (utility::string_equals(kv.first, "content-length") || utility::string_equals(kv.first, "date"))
+                continue;
+            if (utility::string_equals(kv.first, "server"))
+                has_server = true;
+            data.append(kv.first).append(": ").append(kv.second).append("\r\n");
+        }
+    }
     
     void response::set_static_file_info_unsafe(std::string path)
     {
@@ -16,6 +52,9 @@ namespace crow
             std::string extension = path.substr(last_dot + 1);
             code = 200;
             this->add_header("Content-Length", std::to_string(file_info.statbuf.st_size));
+            this->add_header("Accept-Ranges", "bytes");
+            this->add_header("ETag", static_file_etag(file_info.statbuf));
+            this->add_header("Last-Modified", format_http_date(file_info.statbuf.st_mtime));
             
             if (!extension.empty())
             {
@@ -41,13 +80,18 @@ namespace crow
             completed_ = true;
             if (skip_body)
             {
-                set_header("Content-Length", std::to_string(body.size()));
+                set_header("Content-Length", std::to_string(body_size()));
                 body = "";
+                shared_body.reset();
                 manual_length_header = true;
             }
             if (complete_request_handler_)
             {
-                complete_request_handler_();
+                // the handler may hold the last reference to the connection owning this response,
+                // keep it alive on the stack while it runs instead of in the member it clears
+                auto complete = std::move(complete_request_handler_);
+                complete_request_handler_ = nullptr;
+                complete();
             }
         }
     }
@@ -57,6 +101,8 @@ namespace crow
         body.clear();
         code = 200;
         headers.clear();
+        header_block.reset();
+        shared_body.reset();
         completed_ = false;
         file_info = static_file_info{};
     }
@@ -0,0 +1,137 @@
+// Measures the requests per second a server answers under keep-alive load, to compare the io_uring and epoll backends.
+// server_load_benchmark uses the backend CROW_FEATURES selects, when that is io_uring server_load_benchmark_epoll is built next to it.
+// Run both on the same machine with optional connection count and seconds, e.g. ./server_load_benchmark 64 10
+#include "crow.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    // the load comes from plain blocking sockets, so the client side is the same in both builds
+    int connect_to(uint16_t port)
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) std::abort();
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) std::abort();
+        return fd;
+    }
+
+    // send one request and read its whole response, false once the server closed the connection
+    bool round_trip(int fd, const std::string& request, std::string& buffer)
+    {
+        if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+            return false;
+
+        buffer.clear();
+        size_t expected = std::string::npos;
+        char chunk[65536];
+        while (expected == std::string::npos || buffer.size() < expected)
+        {
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+                return false;
+            buffer.append(chunk, static_cast<size_t>(n));
+            if (expected != std::string::npos)
+                continue;
+            auto header_end = buffer.find("\r\n\r\n");
+            if (header_end == std::string::npos)
+                continue;
+            auto length = buffer.find("Content-Length: ");
+            if (length == std::string::npos || length > header_end) std::abort();
+            expected = header_end + 4 + std::strtoull(buffer.c_str() + length + 16, nullptr, 10);
+        }
+        return true;
+    }
+
+    double requests_per_second(uint16_t port, const std::string& path, size_t connections, double seconds)
+    {
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        std::atomic<bool> running{true};
+        std::atomic<size_t> answered{0};
+
+        std::vector<std::thread> clients;
+        for (size_t i = 0; i < connections; i++)
+            clients.emplace_back([&] {
+                int fd = connect_to(port);
+                std::string buffer;
+                size_t count = 0;
+                while (running && round_trip(fd, request, buffer))
+                    count++;
+                ::close(fd);
+                answered += count;
+            });
+
+        auto start = clock_type::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        running = false;
+        for (auto& client : clients)
+            client.join();
+        return double(answered) / std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t connections = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    double seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 5;
+
+    const char* file_path = "server_load_benchmark.bin";
+    {
+        std::ofstream file(file_path, std::ios::binary);
+        file << std::string(64 * 1024, 'x');
+    }
+
+    crow::SimpleApp app;
+    app.loglevel(crow::LogLevel::Warning);
+
+    CROW_ROUTE(app, "/")
+    ([] {
+        return "Hello world";
+    });
+
+    CROW_ROUTE(app, "/file")
+    ([file_path](crow::response& res) {
+        res.set_static_file_info_unsafe(file_path);
+        res.end();
+    });
+
+    unsigned threads = std::thread::hardware_concurrency() / 2;
+    auto server = app.bindaddr("127.0.0.1").port(45452).concurrency(threads > 1 ? threads : 2).run_async();
+    app.wait_for_server_start();
+
+#ifdef CROW_ENABLE_IO_URING
+    std::cout << "io_uring backend, ";
+#else
+    std::cout << "epoll backend, ";
+#endif
+    std::cout << connections << " connections, " << seconds << " s per run\n";
+
+    std::cout << "small response : " << requests_per_second(app.port(), "/", connections, seconds) << " requests/s\n";
+    std::cout << "64KB static file: " << requests_per_second(app.port(), "/file", connections, seconds) << " requests/s\n";
+
+    app.stop();
+    server.wait();
+    std::remove(file_path);
+}
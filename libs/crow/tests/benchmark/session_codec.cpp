@@ -0,0 +1,67 @@
+// Compares the binary and json session encodings: encode/decode time per session, and bytes per session.
+// Run with an optional iteration count, e.g. ./session_codec_benchmark 1000000
+#include "crow/middlewares/session.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace crow;
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    template<typename F>
+    double nanoseconds_per_iteration(size_t iterations, F&& f)
+    {
+        auto start = clock_type::now();
+        for (size_t i = 0; i < iterations; i++)
+            f();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+        return double(elapsed) / double(iterations);
+    }
+
+    template<typename Encode, typename Decode>
+    void run(const char* name, size_t iterations, const session::codec::entries_t& entries, Encode&& encode, Decode&& decode)
+    {
+        std::string data;
+        encode(entries, data);
+
+        size_t sink = 0;
+        auto encode_ns = nanoseconds_per_iteration(iterations, [&] {
+            std::string out;
+            encode(entries, out);
+            sink += out.size();
+        });
+        auto decode_ns = nanoseconds_per_iteration(iterations, [&] {
+            session::codec::entries_t out;
+            if (!decode(data.data(), data.size(), out)) std::abort();
+            sink += out.size();
+        });
+
+        std::cout << name << ": " << data.size() << " bytes, encode " << encode_ns << " ns, decode " << decode_ns
+                  << " ns (" << sink << ")\n";
+    }
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+    // what the site keeps in a session
+    session::codec::entries_t entries;
+    entries["clientID"].set("9b2f0c4e-54a1-4c52-8f1e-0d0c8d2f7a11");
+    entries["clientToken"].set("v1.3.dXNlcm5hbWUKMTcwMDAwMDAwMDAwMAoxNzAwMDAzNjAwCjMK.q2Vj6pMRYQ2tAvZ1f9tU6xq0pE1x4TnF9sfJ3t3i5nw");
+
+    run("json  ", iterations, entries, session::codec::encode_json, session::codec::decode_json);
+    run("binary", iterations, entries, session::codec::encode_binary, session::codec::decode_binary);
+
+    entries["counter"].set(1234);
+    entries["ratio"].set(0.25);
+    entries["admin"].set(true);
+
+    run("json   (mixed)", iterations, entries, session::codec::encode_json, session::codec::decode_json);
+    run("binary (mixed)", iterations, entries, session::codec::encode_binary, session::codec::decode_binary);
+}
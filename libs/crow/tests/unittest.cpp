@@ -6,6 +6,8 @@
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <set>
+#include <future>
 #include <chrono>
 #include <type_traits>
 #include <regex>
@@ -284,6 +286,80 @@ TEST_CASE("RoutingTest")
     }
 } // RoutingTest
 
+TEST_CASE("static_routes")
+{
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/")
+    ([] {
+        return "root";
+    });
+    CROW_ROUTE(app, "/favicon.ico")
+    ([] {
+        return "favicon";
+    });
+    CROW_ROUTE(app, "/res/login").methods(HTTPMethod::Post)([] {
+        return "login";
+    });
+    CROW_ROUTE(app, "/<string>")
+    ([](const string& page) {
+        return "page " + page;
+    });
+    // registered after the parameter rule that also matches it, which keeps precedence
+    CROW_ROUTE(app, "/about.html")
+    ([] {
+        return "about";
+    });
+    CROW_ROUTE(app, "/projects/")
+    ([] {
+        return "projects";
+    });
+    CROW_ROUTE(app, "/projects/<path>")
+    ([](const string& path) {
+        return "project " + path;
+    });
+
+    app.validate();
+
+    auto get = [&app](HTTPMethod method, const char* url) {
+        request req;
+        response res;
+        req.method = method;
+        req.url = url;
+        app.handle_full(req, res);
+        return res;
+    };
+
+    CHECK("root" == get(HTTPMethod::Get, "/").body);
+    CHECK("favicon" == get(HTTPMethod::Get, "/favicon.ico").body);
+    CHECK("login" == get(HTTPMethod::Post, "/res/login").body);
+    CHECK(405 == get(HTTPMethod::Get, "/res/login").code);
+    CHECK("page about.html" == get(HTTPMethod::Get, "/about.html").body);
+    CHECK("page index.html" == get(HTTPMethod::Get, "/index.html").body);
+    CHECK("projects" == get(HTTPMethod::Get, "/projects/").body);
+    CHECK(301 == get(HTTPMethod::Get, "/projects").code);
+    CHECK("project crow/docs" == get(HTTPMethod::Get, "/projects/crow/docs").body);
+    CHECK(404 == get(HTTPMethod::Get, "/res/logout").code);
+    CHECK(get(HTTPMethod::Head, "/favicon.ico").skip_body);
+
+    // the table on its own, past the size of a bucket
+    detail::static_route_table table;
+    std::vector<detail::static_route_table::route> routes;
+    for (uint16_t i = 0; i < 1000; i++)
+        routes.emplace_back("/route/" + std::to_string(i), routing_handle_result(i, {}, {}));
+    table.build(routes);
+    CHECK(1000 == table.size());
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+        auto found = table.find("/route/" + std::to_string(i));
+        REQUIRE(found);
+        CHECK(i == found->rule_index);
+    }
+    CHECK(!table.find("/route/1000"));
+    CHECK(!table.find("/route/"));
+    CHECK(!table.find(""));
+} // static_routes
+
 TEST_CASE("simple_response_routing_params")
 {
     CHECK(100 == response(100).code);
@@ -598,6 +674,184 @@ TEST_CASE("server_handling_error_request_http_version")
     app.stop();
 } // server_handling_error_request_http_version
 
+TEST_CASE("request_parsing")
+{
+    struct handler
+    {
+        int messages = 0;
+        void handle_url() {}
+        void handle_header() {}
+        void handle() { messages++; }
+    } h;
+    HTTPParser<handler> parser(&h);
+
+    // every header split across reads
+    std::string first = "GET /some/longer/path?a=1&b=two%20words HTTP/1.1\r\nHost: localhost\r\nX-Empty:\r\nuser-agent: test agent\r\nCookie: a=b\r\n\r\n";
+    for (size_t i = 0; i < first.size(); i += 7)
+        CHECK(parser.feed(first.data() + i, std::min<size_t>(7, first.size() - i)));
+    CHECK(h.messages == 1);
+    CHECK(parser.req.url == "/some/longer/path");
+    CHECK(parser.req.raw_url == "/some/longer/path?a=1&b=two%20words");
+    CHECK(std::string(parser.req.url_params.get("a")) == "1");
+    CHECK(std::string(parser.req.url_params.get("b")) == "two words");
+    CHECK(parser.req.headers.size() == 4);
+    CHECK(parser.req.get_header_value("User-Agent") == "test agent");
+    CHECK(parser.req.get_header_value(std::string("HOST")) == "localhost");
+    CHECK(parser.req.headers.count("x-empty") == 1);
+    CHECK(parser.req.get_header_value("X-Empty") == "");
+    CHECK(parser.req.headers.count("X-Missing") == 0);
+    CHECK(parser.req.keep_alive);
+
+    // the next request on the connection is parsed into the same memory
+    const char* url_memory = parser.req.raw_url.data();
+    parser.clear();
+    std::string second = "POST /another/long/path HTTP/1.0\r\nContent-Length: 3\r\n\r\nA=B";
+    CHECK(parser.feed(second.data(), second.size()));
+    CHECK(h.messages == 2);
+    CHECK(parser.req.raw_url.data() == url_memory);
+    CHECK(parser.req.url == "/another/long/path");
+    CHECK(parser.req.url_params.get("a") == nullptr);
+    CHECK(parser.req.headers.size() == 1);
+    CHECK(parser.req.get_header_value("Host") == "");
+    CHECK(parser.req.body == "A=B");
+    CHECK_FALSE(parser.req.keep_alive);
+} // request_parsing
+
+TEST_CASE("request_arena")
+{
+    request_arena arena;
+    CHECK(0 == arena.capacity());
+
+    auto small = static_cast<char*>(arena.allocate(3, 1));
+    auto aligned = arena.allocate(sizeof(double), alignof(double));
+    CHECK(1 == arena.block_count());
+    CHECK(0 == reinterpret_cast<std::uintptr_t>(aligned) % alignof(double));
+    CHECK(static_cast<char*>(aligned) >= small + 3);
+
+    // containers growing past the first block
+    using arena_string = std::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+    std::vector<arena_string, arena_allocator<arena_string>> strings{arena_allocator<arena_string>(arena)};
+    for (int i = 0; i < 1000; i++)
+        strings.emplace_back(std::string(40, static_cast<char>('a' + i % 26)).c_str(), arena_allocator<char>(arena));
+    CHECK(std::string(40, 'b') == strings[27].c_str());
+    CHECK(arena.block_count() > 1);
+    strings.clear();
+
+    // the next request gets one block for what this one used
+    size_t used = arena.capacity();
+    arena.reset();
+    CHECK(1 == arena.block_count());
+    CHECK(std::min<size_t>(used, request_arena::max_retained) == arena.capacity());
+    auto reused = arena.allocate(16);
+    arena.reset();
+    CHECK(reused == arena.allocate(16));
+
+    // without an arena the allocator uses the heap
+    arena_string heap("heap allocated string past the small string buffer");
+    CHECK(nullptr == heap.get_allocator().arena());
+    CHECK(arena_allocator<int>() != arena_allocator<int>(arena));
+
+    // handlers reach it through the request, which releases it once the response is sent
+    SimpleApp app;
+    CROW_ROUTE(app, "/")
+    ([](const request& req) {
+        std::vector<int, arena_allocator<int>> numbers{arena_allocator<int>(req.arena)};
+        for (int i = 0; i < 100; i++)
+            numbers.push_back(i);
+        return std::to_string(numbers.back());
+    });
+    app.validate();
+
+    request req;
+    response res;
+    req.url = "/";
+    app.handle_full(req, res);
+    CHECK("99" == res.body);
+    CHECK(req.arena.capacity() > 0);
+    CHECK(1 == req.arena.block_count());
+    req.clear();
+    CHECK(req.arena.capacity() > 0);
+} // request_arena
+
+TEST_CASE("request_scanner")
+{
+    struct handler
+    {
+        int urls = 0, headers = 0, messages = 0;
+        void handle_url() { urls++; }
+        void handle_header() { headers++; }
+        void handle() { messages++; }
+    };
+
+    // a request fed whole goes through the scanner, fed a byte at a time it can only go through the state machine
+    auto compare = [](const std::string& message) {
+        INFO(message);
+        handler whole_handler, bytes_handler;
+        HTTPParser<handler> whole(&whole_handler), bytes(&bytes_handler);
+        bool whole_ok = whole.feed(message.data(), message.size());
+        bool bytes_ok = true;
+        for (size_t i = 0; i < message.size() && bytes_ok; i++)
+            bytes_ok = bytes.feed(message.data() + i, 1);
+
+        CHECK(whole_ok == bytes_ok);
+        if (!whole_ok || !bytes_ok)
+            return;
+        CHECK(whole_handler.urls == 1);
+        CHECK(whole_handler.headers == bytes_handler.headers);
+        CHECK(whole_handler.messages == bytes_handler.messages);
+        CHECK(whole.req.method == bytes.req.method);
+        CHECK(whole.req.raw_url == bytes.req.raw_url);
+        CHECK(whole.req.url == bytes.req.url);
+        CHECK(whole.req.body == bytes.req.body);
+        CHECK(whole.req.http_ver_minor == bytes.req.http_ver_minor);
+        CHECK(whole.req.keep_alive == bytes.req.keep_alive);
+        CHECK(whole.req.close_connection == bytes.req.close_connection);
+        CHECK(whole.req.upgrade == bytes.req.upgrade);
+        REQUIRE(whole.req.headers.size() == bytes.req.headers.size());
+        auto expected = bytes.req.headers.begin();
+        for (auto& header : whole.req.headers)
+        {
+            CHECK(header.first == expected->first);
+            CHECK(header.second == expected->second);
+            ++expected;
+        }
+    };
+
+    compare("GET /index.html?referer=%2Fhome&x=1 HTTP/1.1\r\n"
+            "Host: localhost:8080\r\n"
+            "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+            "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+            "Accept-Language: en-US,en;q=0.5\r\n"
+            "Accept-Encoding: gzip, deflate, br\r\n"
+            "Connection: keep-alive\r\n"
+            "Cookie: session=0123456789abcdef; theme=dark\r\n"
+            "Upgrade-Insecure-Requests: 1\r\n"
+            "Sec-Fetch-Dest: document\r\n"
+            "If-None-Match: \"3f9a1c0d2b4e\"\r\n"
+            "\r\n");
+    compare("POST /res/login HTTP/1.1\r\nHost: a\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: 27\r\n\r\nusername=a&password=b&x=yz");
+    compare("GET / HTTP/1.0\r\nconnection: Keep-Alive\r\n\r\n");
+    compare("GET / HTTP/1.0\r\n\r\n");
+    compare("GET / HTTP/1.1\r\nHost: a\r\nConnection: close\r\n\r\n");
+    compare("GET / HTTP/1.1\r\nHost: a\r\nConnection: foo, keep-alive\r\n\r\n");
+    compare("DELETE /a#fragment HTTP/1.1\r\nHost: a\r\nX-Trailing: value  \r\nX-Tab:\tvalue\r\nX-Empty:\r\nX|Odd~Name: 1\r\nX-High: caf\xc3\xa9\r\n\r\n");
+    compare("OPTIONS /a/b/c HTTP/1.1\r\nHost: a\r\nContent-Length: 0\r\n\r\n");
+    compare("PATCH /x HTTP/1.1\r\nHost: a\r\nContent-Length: 3\r\n\r\nabc");
+    // handed to the state machine
+    compare("GET http://localhost/absolute HTTP/1.1\r\nHost: a\r\n\r\n");
+    compare("GET /ws HTTP/1.1\r\nHost: a\r\nConnection: Upgrade\r\nUpgrade: websocket\r\n\r\n");
+    compare("POST /chunked HTTP/1.1\r\nHost: a\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n");
+    compare("GET / HTTP/1.1\r\nHost: a\r\nX-Folded: one\r\n two\r\n\r\n");
+    compare("\r\nGET / HTTP/1.1\r\nHost: a\r\n\r\n");
+    // errors either way
+    compare("GET / HTTP/1.1\r\nBad Header: a\r\n\r\n");
+    compare("GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n");
+    compare("GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\na");
+    compare("GET / HTTP/1.1\r\nX-Del: a\x7f\r\n\r\n");
+    compare("GET /a b HTTP/1.1\r\n\r\n");
+    compare("BREW /pot HTTP/1.1\r\n\r\n");
+} // request_scanner
+
 TEST_CASE("multi_server")
 {
     static char buf[2048];
@@ -650,6 +904,279 @@ TEST_CASE("multi_server")
     app2.stop();
 } // multi_server
 
+TEST_CASE("reuse_port_server")
+{
+    static char buf[2048];
+    SimpleApp app;
+
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    CROW_ROUTE(app, "/")
+    ([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+        return "A";
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).concurrency(4).reuse_port().run_async();
+    app.wait_for_server_start();
+
+    std::string sendmsg = "GET / HTTP/1.0\r\n\r\n";
+    for (int i = 0; i < 40; i++)
+    {
+        asio::io_service is;
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(
+          asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+        c.send(asio::buffer(sendmsg));
+
+        size_t recved = c.receive(asio::buffer(buf, 2048));
+        CHECK('A' == buf[recved - 1]);
+    }
+
+#ifdef SO_REUSEPORT
+    // each IO thread accepts its own share of the connections
+    CHECK(threads.size() > 1);
+#endif
+
+    app.stop();
+} // reuse_port_server
+
+TEST_CASE("connection_pool")
+{
+    static char buf[2048];
+    SimpleApp app;
+    CROW_ROUTE(app, "/")
+    ([] {
+        return "A";
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).concurrency(2).run_async();
+    app.wait_for_server_start();
+
+    auto send = [](const std::string& message) -> std::string {
+        asio::io_service is;
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(
+          asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(message));
+        std::string received;
+        asio::error_code ec;
+        size_t recved;
+        while ((recved = c.receive(asio::buffer(buf, 2048), 0, ec)) > 0 && !ec)
+            received.append(buf, recved);
+        return received;
+    };
+
+    for (int i = 0; i < 20; i++)
+    {
+        // a connection dropped mid request or after a parse error has to come back clean
+        if (i % 5 == 1)
+            CHECK(send("GET / HTTP/1.1\r\nHost: loc").empty());
+        if (i % 5 == 2)
+            send("POX\r\n\r\n");
+
+        auto response = send("GET / HTTP/1.0\r\n\r\n");
+        CHECK(response.substr(0, 15) == "HTTP/1.1 200 OK");
+        CHECK(response.back() == 'A');
+    }
+
+    // connections go back to the pool once their last handler lets go of them, which may be just after the client saw the response
+    // the acceptor always holds one connection for the next socket
+    crow::connection_pool_stats stats;
+    for (int i = 0; i < 100; i++)
+    {
+        stats = app.connection_stats();
+        if (stats.active == 1) break;
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    CHECK(stats.active == 1);
+    CHECK(stats.created + stats.reused == 29);
+    CHECK(stats.created < 5);
+    CHECK(stats.idle + stats.active == stats.created);
+
+    app.stop();
+} // connection_pool
+
+TEST_CASE("connection_pool_control_blocks")
+{
+    static char buf[2048];
+    // sockets are accepted on one thread and released on another by default, and on the same IO thread with reuse_port
+    for (bool reuse_port : {false, true})
+    {
+        SimpleApp app;
+        CROW_ROUTE(app, "/")
+        ([] {
+            return "A";
+        });
+
+        // two IO threads, the app's own thread runs the default acceptor
+        app.bindaddr(LOCALHOST_ADDRESS).port(45451).concurrency(3);
+        if (reuse_port)
+            app.reuse_port();
+        auto _ = app.run_async();
+        app.wait_for_server_start();
+
+        std::string sendmsg = "GET / HTTP/1.0\r\n\r\n";
+        for (int i = 0; i < 40; i++)
+        {
+            asio::io_service is;
+            asio::ip::tcp::socket c(is);
+            c.connect(asio::ip::tcp::endpoint(
+              asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+            c.send(asio::buffer(sendmsg));
+            asio::error_code ec;
+            while (c.receive(asio::buffer(buf, 2048), 0, ec) > 0 && !ec)
+                ;
+        }
+
+        // every acceptor holds a connection for the next socket, with reuse_port there is one per IO thread
+        size_t acceptors = reuse_port ? 2 : 1;
+        crow::connection_pool_stats stats;
+        for (int i = 0; i < 100; i++)
+        {
+            stats = app.connection_stats();
+            if (stats.active == acceptors) break;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+        CHECK(stats.active == acceptors);
+        CHECK(stats.created + stats.reused == 40 + acceptors);
+        // a connection needs a new control block only when it is wrapped while its previous one is still alive,
+        // at most once per connection and pool, no matter which thread accepted or released it
+        CHECK(stats.control_blocks <= stats.created + 2);
+
+        app.stop();
+    }
+} // connection_pool_control_blocks
+
+TEST_CASE("blocking_route")
+{
+    static char buf[2048];
+    SimpleApp app;
+
+    std::mutex mutex;
+    std::thread::id slow_thread, fast_thread;
+    CROW_ROUTE(app, "/slow")
+      .blocking()([&] {
+          std::this_thread::sleep_for(std::chrono::milliseconds(500));
+          std::lock_guard<std::mutex> lock(mutex);
+          slow_thread = std::this_thread::get_id();
+          return "slow";
+      });
+
+    CROW_ROUTE(app, "/fast")
+    ([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        fast_thread = std::this_thread::get_id();
+        return "fast";
+    });
+
+    // a single IO thread, so a blocking handler running on it would hold up /fast
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).concurrency(2).blocking_workers(2).run_async();
+    app.wait_for_server_start();
+    REQUIRE(app.blocking_pool() != nullptr);
+
+    asio::io_service is;
+    auto connect = [&] {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        return c;
+    };
+    auto read_body = [&](asio::ip::tcp::socket& c) {
+        std::string received;
+        while (received.find("\r\n\r\n") == std::string::npos || received.size() < received.find("\r\n\r\n") + 8)
+            received.append(buf, c.receive(asio::buffer(buf, 2048)));
+        return received.substr(received.size() - 4);
+    };
+
+    auto slow = connect();
+    auto started = std::chrono::steady_clock::now();
+    slow.send(asio::buffer(std::string("GET /slow HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto fast = connect();
+    fast.send(asio::buffer(std::string("GET /fast HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    CHECK(read_body(fast) == "fast");
+    CHECK(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(400));
+
+    CHECK(read_body(slow) == "slow");
+    CHECK(slow_thread != fast_thread);
+
+    // the connection carries on once the response came back from the worker
+    slow.send(asio::buffer(std::string("GET /fast HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    CHECK(read_body(slow) == "fast");
+
+    app.stop();
+} // blocking_route
+
+#ifdef CROW_CAN_USE_COROUTINES
+TEST_CASE("coroutine_handlers")
+{
+    static char buf[2048];
+    SimpleApp app;
+
+    auto square = [](int x) -> crow::task<int> {
+        co_return x * x;
+    };
+
+    CROW_ROUTE(app, "/co/<int>")
+    ([&](const request& req, int x) -> crow::task<crow::response> {
+        // waits on a blocking worker without holding the IO thread, then continues on it
+        auto io_thread = std::this_thread::get_id();
+        auto worker_thread = co_await crow::blocking(app, req, [] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            return std::this_thread::get_id();
+        });
+        CHECK(worker_thread != io_thread);
+        CHECK(std::this_thread::get_id() == io_thread);
+
+        int squared = co_await square(x);
+        co_return crow::response(std::to_string(squared));
+    });
+
+    CROW_ROUTE(app, "/co_string")
+    ([&](const request& req) -> crow::task<std::string> {
+        co_await crow::resume_on(*req.io_service);
+        co_return "resumed";
+    });
+
+    CROW_ROUTE(app, "/co_throw")
+    ([&](const request& req) -> crow::task<crow::response> {
+        co_await crow::blocking(app, req, [] {});
+        throw std::runtime_error("failed after suspending");
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).blocking_workers(2).run_async();
+    app.wait_for_server_start();
+
+    auto request = [&](const std::string& path) {
+        asio::io_service is;
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer("GET " + path + " HTTP/1.0\r\n\r\n"));
+        std::string received;
+        asio::error_code ec;
+        size_t n;
+        while ((n = c.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+            received.append(buf, n);
+        return received;
+    };
+
+    auto squared = request("/co/7");
+    CHECK(squared.substr(0, 12) == "HTTP/1.1 200");
+    CHECK(squared.substr(squared.size() - 2) == "49");
+
+    auto resumed = request("/co_string");
+    CHECK(resumed.substr(resumed.size() - 7) == "resumed");
+
+    auto failed = request("/co_throw");
+    CHECK(failed.substr(0, 12) == "HTTP/1.1 500");
+
+    app.stop();
+} // coroutine_handlers
+#endif
+
 
 TEST_CASE("undefined_status_code")
 {
@@ -1939,6 +2466,14 @@ TEST_CASE("middleware_session")
         return "ok";
     });
 
+    CROW_ROUTE(app, "/remove")
+    ([&](const request& req) {
+        auto& session = app.get_context<Session>(req);
+        auto key = req.url_params.get("key");
+        session.remove(key);
+        return "ok";
+    });
+
     CROW_ROUTE(app, "/count")
     ([&](const request& req) {
         auto& session = app.get_context<Session>(req);
@@ -1986,6 +2521,12 @@ TEST_CASE("middleware_session")
 
     std::string cookie = "Cookie: session=";
 
+    // reading without a session doesn't create one
+    {
+        auto res = make_request("GET /get?key=test\r\n\r\n");
+        CHECK(res.find("Set-Cookie") == std::string::npos);
+    }
+
     // test = works
     {
         auto res = make_request(
@@ -2028,11 +2569,269 @@ TEST_CASE("middleware_session")
         c_lock.close();
     }
 
+    // removing every value drops the session and expires the cookie
+    {
+        make_request("GET /remove?key=test\r\n" + cookie + "\r\n\r\n");
+        auto res = make_request("GET /remove?key=counter\r\n" + cookie + "\r\n\r\n");
+        CHECK(res.find("Max-Age=0") != std::string::npos);
+
+        // the old id is gone from the store, so setting a value issues a fresh session
+        res = make_request("GET /set?key=test&value=again\r\n" + cookie + "\r\n\r\n");
+        CHECK(res.find("Set-Cookie") != std::string::npos);
+    }
 
     app.stop();
 } // middleware_session
 
 
+TEST_CASE("session_codec")
+{
+    session::codec::entries_t entries;
+    entries["clientID"].set("9b2f0c4e-54a1-4c52-8f1e-0d0c8d2f7a11");
+    entries["counter"].set(42);
+    entries["ratio"].set(0.5);
+    entries["admin"].set(true);
+    entries["empty"].set(std::string());
+
+    std::string binary;
+    session::codec::encode(entries, binary);
+    CHECK(binary[0] == session::codec::binary_tag);
+
+    std::string json(1, session::codec::json_tag);
+    session::codec::encode_json(entries, json);
+    CHECK(binary.size() < json.size());
+
+    for (const auto& data : {binary, json})
+    {
+        session::codec::entries_t decoded;
+        REQUIRE(session::codec::decode(data.data(), data.size(), decoded));
+        CHECK(decoded.size() == entries.size());
+        CHECK(decoded["clientID"].get<std::string>("") == "9b2f0c4e-54a1-4c52-8f1e-0d0c8d2f7a11");
+        CHECK(decoded["counter"].get(0) == 42);
+        CHECK(decoded["ratio"].get(0.0) == 0.5);
+        CHECK(decoded["admin"].get(false));
+        CHECK(decoded.count("empty") == 1);
+    }
+
+    // truncated data is rejected rather than partially decoded
+    session::codec::entries_t decoded;
+    CHECK_FALSE(session::codec::decode(binary.data(), binary.size() - 1, decoded));
+    CHECK_FALSE(session::codec::decode(binary.data(), 0, decoded));
+} // session_codec
+
+TEST_CASE("session_file_store_legacy")
+{
+    const std::string folder = "session_test_store";
+    mkdir(folder.c_str(), 0755);
+    {
+        std::ofstream legacy(folder + "/legacy.json");
+        legacy << R"({"clientID":"abc","clientToken":"def"})";
+    }
+
+    {
+        FileStore store(folder);
+        REQUIRE(store.contains("legacy"));
+
+        session::CachedSession cn;
+        cn.session_id = "legacy";
+        store.load(cn);
+        CHECK(cn.entries["clientToken"].string() == "def");
+
+        // the json file is converted on load
+        CHECK_FALSE(std::ifstream(folder + "/legacy.json").good());
+        CHECK(std::ifstream(folder + "/legacy.session").good());
+
+        session::CachedSession reloaded;
+        reloaded.session_id = "legacy";
+        store.load(reloaded);
+        CHECK(reloaded.entries["clientID"].string() == "abc");
+
+        store.evict("legacy");
+        CHECK_FALSE(store.contains("legacy"));
+    }
+
+    std::remove((folder + "/.expirations").c_str());
+    rmdir(folder.c_str());
+} // session_file_store_legacy
+
+TEST_CASE("session_expiration_wheel")
+{
+    const uint64_t start = 1700000000;
+    session::ExpirationWheel wheel(start);
+
+    wheel.add("soon", start + 1);
+    wheel.add("minute", start + 90);
+    wheel.add("day", start + 24 * 60 * 60);
+    wheel.add("year", start + 365 * 24 * 60 * 60);
+    wheel.add("removed", start + 10);
+    wheel.add("moved", start + 5);
+    wheel.add("moved", start + 5000);
+    wheel.remove("removed");
+    CHECK(wheel.size() == 5);
+    CHECK(wheel.expiration("moved") == start + 5000);
+
+    CHECK(wheel.advance(start).empty());
+    CHECK(wheel.advance(start + 1) == std::vector<std::string>{"soon"});
+    CHECK(wheel.advance(start + 89).empty());
+    CHECK(wheel.advance(start + 90) == std::vector<std::string>{"minute"});
+    CHECK(wheel.advance(start + 4999).empty());
+    CHECK(wheel.advance(start + 5000) == std::vector<std::string>{"moved"});
+    CHECK(wheel.advance(start + 24 * 60 * 60 - 1).empty());
+    CHECK(wheel.advance(start + 24 * 60 * 60) == std::vector<std::string>{"day"});
+
+    // keys that are already due expire on the next advance
+    wheel.add("late", start);
+    CHECK(wheel.advance(start + 24 * 60 * 60 + 1) == std::vector<std::string>{"late"});
+
+    // keys further out than the wheel spans wait in the overflow list
+    CHECK(wheel.advance(start + 365 * 24 * 60 * 60 - 1).empty());
+    CHECK(wheel.advance(start + 365 * 24 * 60 * 60) == std::vector<std::string>{"year"});
+    CHECK(wheel.size() == 0);
+
+    // every key expires exactly at its time
+    uint64_t now = start + 365 * 24 * 60 * 60;
+    std::multimap<uint64_t, std::string> expected;
+    uint64_t seed = 42;
+    for (int i = 0; i < 2000; i++)
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        auto time = now + 1 + (seed >> 33) % 300000;
+        wheel.add(std::to_string(i), time);
+        expected.emplace(time, std::to_string(i));
+    }
+    while (!expected.empty())
+    {
+        auto time = expected.begin()->first;
+        auto expired = wheel.advance(time);
+        std::vector<std::string> due;
+        for (auto it = expected.begin(); it != expected.end() && it->first == time; it = expected.erase(it))
+            due.push_back(it->second);
+        std::sort(expired.begin(), expired.end());
+        std::sort(due.begin(), due.end());
+        CHECK(expired == due);
+    }
+} // session_expiration_wheel
+
+TEST_CASE("session_log_store")
+{
+    const std::string path = "session_test.log";
+    std::remove(path.c_str());
+
+    auto save = [](LogStore& store, const std::string& id, const std::string& key, const std::string& value) {
+        session::CachedSession cn;
+        cn.session_id = id;
+        cn.requested_refresh = true;
+        cn.entries[key].set(value);
+        cn.dirty.insert(key);
+        store.save(cn);
+    };
+
+    {
+        LogStore store(path);
+        save(store, "first", "user", "a");
+        save(store, "second", "user", "b");
+        save(store, "first", "user", "c");
+        store.evict("second");
+
+        CHECK(store.contains("first"));
+        CHECK_FALSE(store.contains("second"));
+    }
+
+    // the log is replayed in order
+    {
+        LogStore store(path);
+        CHECK(store.contains("first"));
+        CHECK_FALSE(store.contains("second"));
+
+        session::CachedSession cn;
+        cn.session_id = "first";
+        store.load(cn);
+        CHECK(cn.entries["user"].string() == "c");
+    }
+
+    // a torn record at the end is dropped, everything before it survives
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::app);
+        const char torn[] = {0x40, 0, 0, 0, 'S'};
+        out.write(torn, sizeof(torn));
+    }
+    {
+        LogStore store(path);
+        CHECK(store.contains("first"));
+        save(store, "third", "user", "d");
+    }
+    {
+        LogStore store(path);
+        CHECK(store.contains("first"));
+        CHECK(store.contains("third"));
+
+        store.compact();
+        session::CachedSession cn;
+        cn.session_id = "third";
+        store.load(cn);
+        CHECK(cn.entries["user"].string() == "d");
+    }
+
+    std::remove(path.c_str());
+} // session_log_store
+
+TEST_CASE("session_log_store_compaction")
+{
+    const std::string path = "session_compact_test.log";
+    std::remove(path.c_str());
+
+    auto save = [](LogStore& store, const std::string& id, const std::string& value) {
+        session::CachedSession cn;
+        cn.session_id = id;
+        cn.requested_refresh = true;
+        cn.entries["value"].set(value);
+        cn.dirty.insert("value");
+        store.save(cn);
+    };
+
+    // sessions keep changing while the log is rewritten, the new log has to end up with their latest state
+    {
+        LogStore store(path);
+        for (int i = 0; i < 200; i++)
+            save(store, "session" + std::to_string(i), "0");
+
+        // each session is written by a single thread, the last round it wrote is what the log has to hold
+        std::atomic<int> finished{0};
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++)
+            writers.emplace_back([&, t] {
+                for (int round = 1; round <= 100; round++)
+                    for (int i = t; i < 200; i += 4)
+                    {
+                        save(store, "session" + std::to_string(i), std::to_string(round));
+                        if (i % 20 == t) store.evict("gone" + std::to_string(i));
+                    }
+                finished++;
+            });
+        int compactions = 0;
+        while (finished != 4 || compactions < 2)
+        {
+            store.compact();
+            compactions++;
+        }
+        for (auto& writer : writers)
+            writer.join();
+        save(store, "session0", "after");
+    }
+    {
+        LogStore store(path);
+        for (int i = 0; i < 200; i++)
+        {
+            session::CachedSession cn;
+            cn.session_id = "session" + std::to_string(i);
+            store.load(cn);
+            CHECK(cn.entries["value"].string() == (i == 0 ? "after" : "100"));
+        }
+    }
+
+    std::remove(path.c_str());
+} // session_log_store_compaction
+
 TEST_CASE("bug_quick_repeated_request")
 {
     static char buf[2048];
@@ -2459,6 +3258,314 @@ TEST_CASE("send_file")
     }
 } // send_file
 
+TEST_CASE("send_file_over_socket")
+{
+    const std::string path = "send_file_test.bin";
+    std::string contents;
+    for (size_t i = 0; contents.size() < 8 * 1024 * 1024 + 17; i++)
+        contents += std::to_string(i) + ',';
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/file")
+    ([&](const crow::request&, crow::response& res) {
+        res.set_static_file_info(path);
+        res.end();
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    asio::ip::tcp::socket c(is);
+    c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+    // reads one response off the keep-alive connection, returning its body
+    std::string pending;
+    auto read_response = [&](bool slow) {
+        char buf[65536];
+        size_t header_end;
+        while ((header_end = pending.find("\r\n\r\n")) == std::string::npos)
+            pending.append(buf, c.receive(asio::buffer(buf)));
+
+        auto headers = pending.substr(0, header_end);
+        auto length_pos = headers.find("Content-Length: ");
+        REQUIRE(length_pos != std::string::npos);
+        size_t length = std::stoul(headers.substr(length_pos + 16));
+
+        pending.erase(0, header_end + 4);
+        while (pending.size() < length)
+        {
+            // let the server fill the socket buffer and wait for it to drain
+            if (slow && pending.size() < 1024 * 1024) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            pending.append(buf, c.receive(asio::buffer(buf)));
+        }
+        auto body = pending.substr(0, length);
+        pending.erase(0, length);
+        return body;
+    };
+
+    c.send(asio::buffer(std::string("GET /file HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    CHECK(read_response(true) == contents);
+
+    // the connection keeps serving requests once the transfer is done
+    c.send(asio::buffer(std::string("GET /file HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+    CHECK(read_response(false) == contents);
+
+    c.close();
+    app.stop();
+    std::remove(path.c_str());
+} // send_file_over_socket
+
+TEST_CASE("byte_range_parsing")
+{
+    using crow::detail::parse_range;
+    using crow::detail::range_result;
+    std::vector<crow::byte_range> ranges;
+
+    CHECK(parse_range("bytes=0-99", 1000, ranges) == range_result::satisfiable);
+    REQUIRE(ranges.size() == 1);
+    CHECK(ranges[0].first == 0);
+    CHECK(ranges[0].last == 99);
+
+    // open ended and suffix ranges are clamped to the representation
+    CHECK(parse_range("bytes=900-", 1000, ranges) == range_result::satisfiable);
+    CHECK(ranges[0].first == 900);
+    CHECK(ranges[0].last == 999);
+    CHECK(parse_range("bytes=-5000", 1000, ranges) == range_result::satisfiable);
+    CHECK(ranges[0].first == 0);
+    CHECK(ranges[0].last == 999);
+    CHECK(parse_range("Bytes=990-2000", 1000, ranges) == range_result::satisfiable);
+    CHECK(ranges[0].length() == 10);
+
+    // overlapping and adjacent ranges are merged, the rest are sorted
+    CHECK(parse_range("bytes=500-599, 0-9,10-19 ,550-650", 1000, ranges) == range_result::satisfiable);
+    REQUIRE(ranges.size() == 2);
+    CHECK(ranges[0].first == 0);
+    CHECK(ranges[0].last == 19);
+    CHECK(ranges[1].first == 500);
+    CHECK(ranges[1].last == 650);
+
+    // unsatisfiable ranges are dropped, only when none remain is the request unsatisfiable
+    CHECK(parse_range("bytes=2000-3000,10-20", 1000, ranges) == range_result::satisfiable);
+    CHECK(ranges.size() == 1);
+    CHECK(parse_range("bytes=1000-", 1000, ranges) == range_result::unsatisfiable);
+    CHECK(parse_range("bytes=-0", 1000, ranges) == range_result::unsatisfiable);
+
+    // anything malformed is ignored and the whole file sent
+    CHECK(parse_range("items=0-10", 1000, ranges) == range_result::ignore);
+    CHECK(parse_range("bytes=10-5", 1000, ranges) == range_result::ignore);
+    CHECK(parse_range("bytes=a-5", 1000, ranges) == range_result::ignore);
+    CHECK(parse_range("bytes=5", 1000, ranges) == range_result::ignore);
+    CHECK(parse_range("bytes=,", 1000, ranges) == range_result::ignore);
+    CHECK(parse_range("bytes=99999999999999999999-", 1000, ranges) == range_result::ignore);
+} // byte_range_parsing
+
+TEST_CASE("send_file_ranges")
+{
+    const std::string path = "send_file_range_test.txt";
+    std::string contents;
+    for (size_t i = 0; contents.size() < 256 * 1024; i++)
+        contents += std::to_string(i) + ',';
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << contents;
+    }
+
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/file")
+    ([&](const crow::request&, crow::response& res) {
+        res.set_static_file_info(path);
+        res.end();
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    asio::ip::tcp::socket c(is);
+    c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+    // sends a request on the keep-alive connection and returns its headers and body
+    std::string pending;
+    auto request = [&](const std::string& headers) {
+        c.send(asio::buffer("GET /file HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n"));
+        char buf[65536];
+        size_t header_end;
+        while ((header_end = pending.find("\r\n\r\n")) == std::string::npos)
+            pending.append(buf, c.receive(asio::buffer(buf)));
+
+        auto head = pending.substr(0, header_end + 2);
+        auto length_pos = head.find("Content-Length: ");
+        REQUIRE(length_pos != std::string::npos);
+        size_t length = std::stoul(head.substr(length_pos + 16));
+
+        pending.erase(0, header_end + 4);
+        while (pending.size() < length)
+            pending.append(buf, c.receive(asio::buffer(buf)));
+        auto body = pending.substr(0, length);
+        pending.erase(0, length);
+        return std::make_pair(head, body);
+    };
+    auto header = [](const std::string& head, const std::string& name) {
+        auto pos = head.find("\r\n" + name + ": ");
+        if (pos == std::string::npos) return std::string();
+        pos += name.size() + 4;
+        return head.substr(pos, head.find("\r\n", pos) - pos);
+    };
+
+    auto full = request("");
+    CHECK(full.first.find("HTTP/1.1 200") == 0);
+    CHECK(header(full.first, "Accept-Ranges") == "bytes");
+    CHECK(full.second == contents);
+    auto etag = header(full.first, "ETag");
+    CHECK(!etag.empty());
+
+    auto single = request("Range: bytes=1000-1999\r\n");
+    CHECK(single.first.find("HTTP/1.1 206") == 0);
+    CHECK(header(single.first, "Content-Range") == "bytes 1000-1999/" + std::to_string(contents.size()));
+    CHECK(single.second == contents.substr(1000, 1000));
+
+    auto tail = request("Range: bytes=-10\r\n");
+    CHECK(tail.second == contents.substr(contents.size() - 10));
+
+    auto multi = request("Range: bytes=0-4, 200000-200009\r\n");
+    CHECK(multi.first.find("HTTP/1.1 206") == 0);
+    auto type = header(multi.first, "Content-Type");
+    REQUIRE(type.find("multipart/byteranges; boundary=") == 0);
+    auto boundary = type.substr(type.find('=') + 1);
+    CHECK(multi.second ==
+          "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 0-4/" + std::to_string(contents.size()) + "\r\n\r\n" +
+            contents.substr(0, 5) +
+            "\r\n--" + boundary + "\r\nContent-Type: text/plain\r\nContent-Range: bytes 200000-200009/" + std::to_string(contents.size()) + "\r\n\r\n" +
+            contents.substr(200000, 10) +
+            "\r\n--" + boundary + "--\r\n");
+
+    auto unsatisfiable = request("Range: bytes=999999999-\r\n");
+    CHECK(unsatisfiable.first.find("HTTP/1.1 416") == 0);
+    CHECK(header(unsatisfiable.first, "Content-Range") == "bytes */" + std::to_string(contents.size()));
+
+    // If-Range only allows a partial response while the validator still matches
+    auto matching = request("Range: bytes=0-9\r\nIf-Range: " + etag + "\r\n");
+    CHECK(matching.second == contents.substr(0, 10));
+    auto outdated = request("Range: bytes=0-9\r\nIf-Range: \"outdated\"\r\n");
+    CHECK(outdated.first.find("HTTP/1.1 200") == 0);
+    CHECK(outdated.second == contents);
+
+    c.close();
+    app.stop();
+    std::remove(path.c_str());
+} // send_file_ranges
+
+TEST_CASE("serialized_header_block")
+{
+    ci_map headers;
+    headers.emplace("Content-Type", "text/css");
+    headers.emplace("Content-Length", "12");
+    headers.emplace("Cache-Control", "no-cache");
+    auto block = std::make_shared<const crow::serialized_headers>(headers);
+    // Content-Length is always written per response
+    CHECK(block->data.find("Content-Length") == std::string::npos);
+    CHECK(block->data.find("Content-Type: text/css\r\n") != std::string::npos);
+    CHECK(block->data.find("Cache-Control: no-cache\r\n") != std::string::npos);
+    CHECK_FALSE(block->has_server);
+
+    SimpleApp app;
+
+    CROW_ROUTE(app, "/cached")
+    ([&](const crow::request&, crow::response& res) {
+        res.header_block = block;
+        res.add_header("Set-Cookie", "a=b");
+        res.body = "body{margin:0}";
+        res.end();
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    asio::ip::tcp::socket c(is);
+    c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+    c.send(asio::buffer(std::string("GET /cached HTTP/1.1\r\nHost: localhost\r\n\r\n")));
+
+    std::string received;
+    char buf[2048];
+    while (received.find("body{margin:0}") == std::string::npos)
+        received.append(buf, c.receive(asio::buffer(buf)));
+
+    CHECK(received.find("HTTP/1.1 200 OK\r\n") == 0);
+    CHECK(received.find("\r\nContent-Type: text/css\r\n") != std::string::npos);
+    CHECK(received.find("\r\nCache-Control: no-cache\r\n") != std::string::npos);
+    CHECK(received.find("\r\nSet-Cookie: a=b\r\n") != std::string::npos);
+    CHECK(received.find("\r\nContent-Length: 14\r\n") != std::string::npos);
+    CHECK(received.find("\r\nDate: ") != std::string::npos);
+    CHECK(received.find("\r\n\r\nbody{margin:0}") != std::string::npos);
+
+    c.close();
+    app.stop();
+} // serialized_header_block
+
+TEST_CASE("shared_response_body")
+{
+    // larger than the stream threshold, a shared body is still sent in one write straight from the shared string
+    auto body = std::make_shared<const std::string>(2 * 1024 * 1024, 'x');
+
+    SimpleApp app;
+    app.stream_threshold(64 * 1024);
+    CROW_ROUTE(app, "/shared")
+    ([&](const crow::request&, crow::response& res) {
+        res.shared_body = body;
+        res.end();
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451)
+#ifdef CROW_ENABLE_COMPRESSION
+               .use_compression(compression::GZIP)
+#endif
+               .run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    asio::ip::tcp::socket c(is);
+    c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+    // the body goes out as it is, even to a client accepting compression
+    c.send(asio::buffer(std::string("GET /shared HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n")));
+    std::string received;
+    std::vector<char> buf(65536);
+    size_t header_end = std::string::npos;
+    while (header_end == std::string::npos || received.size() < header_end + 4 + body->size())
+    {
+        received.append(buf.data(), c.receive(asio::buffer(buf)));
+        if (header_end == std::string::npos)
+            header_end = received.find("\r\n\r\n");
+    }
+    CHECK(received.find("HTTP/1.1 200 OK\r\n") == 0);
+    CHECK(received.find("\r\nContent-Length: 2097152\r\n") != std::string::npos);
+    CHECK(received.find("Content-Encoding") == std::string::npos);
+    CHECK(received.size() == header_end + 4 + body->size());
+    CHECK(received.compare(header_end + 4, body->size(), *body) == 0);
+
+    // a HEAD response keeps the length and leaves out the body
+    c.send(asio::buffer(std::string("HEAD /shared HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n")));
+    received.clear();
+    asio::error_code ec;
+    size_t n;
+    while ((n = c.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+        received.append(buf.data(), n);
+    CHECK(received.find("\r\nContent-Length: 2097152\r\n") != std::string::npos);
+    CHECK(received.size() == received.find("\r\n\r\n") + 4);
+
+    app.stop();
+    // nothing holds on to the body once it was sent
+    CHECK(body.use_count() == 1);
+} // shared_response_body
+
 TEST_CASE("stream_response")
 {
     SimpleApp app;
@@ -2828,6 +3935,390 @@ TEST_CASE("websocket_max_payload")
 } // websocket_max_payload
 
 #ifdef CROW_ENABLE_COMPRESSION
+TEST_CASE("compression_policy")
+{
+    compression::policy policy{compression::GZIP, compression::DEFLATE};
+    compression::algorithm chosen;
+
+    CHECK_FALSE(policy.negotiate("", chosen));
+    CHECK_FALSE(policy.negotiate("br, identity", chosen));
+    CHECK(policy.negotiate("deflate", chosen));
+    CHECK(chosen == compression::DEFLATE);
+    // equal q-values fall back to the policy's own preference
+    CHECK(policy.negotiate("deflate, gzip", chosen));
+    CHECK(chosen == compression::GZIP);
+    CHECK(policy.negotiate("gzip;q=0.5, deflate;q=0.8", chosen));
+    CHECK(chosen == compression::DEFLATE);
+    CHECK(policy.negotiate("gzip;q=0, *", chosen));
+    CHECK(chosen == compression::GZIP);
+    CHECK_FALSE(policy.negotiate("gzip;q=0, deflate; q=0", chosen));
+
+    policy.min_size = 100;
+    policy.levels["application/json"] = 1;
+    CHECK_FALSE(policy.should_compress("text/html", 99));
+    CHECK(policy.should_compress("text/html", 100));
+    CHECK_FALSE(policy.should_compress("image/png", 100000));
+    CHECK(policy.level_for("application/json; charset=utf-8") == 1);
+    CHECK(policy.level_for("text/html") == policy.default_level);
+
+    // the streaming encoder gives the same result as compressing in one go, however the input is sliced
+    std::string text;
+    for (int i = 0; i < 20000; i++)
+        text += "line " + std::to_string(i % 97) + " of the compressed text\n";
+    compression::encoder encoder(compression::GZIP, 6);
+    std::string streamed;
+    for (size_t offset = 0; offset < text.size(); offset += 1000)
+        CHECK(encoder.write(text.data() + offset, std::min<size_t>(1000, text.size() - offset), offset + 1000 >= text.size(), streamed));
+    CHECK(streamed.size() < text.size() / 4);
+    CHECK(compression::decompress_string(streamed) == text);
+    CHECK(compression::decompress_string(compression::compress_string(text, compression::DEFLATE, 1)) == text);
+#ifdef CROW_ENABLE_BROTLI
+    CHECK(compression::content_encoding(compression::BROTLI) == std::string("br"));
+    CHECK(!compression::compress_string(text, compression::BROTLI).empty());
+#endif
+} // compression_policy
+
+TEST_CASE("compression_streaming_response")
+{
+    SimpleApp app;
+    app.stream_threshold(64 * 1024);
+
+    std::string text;
+    for (int i = 0; i < 30000; i++)
+        text += "row " + std::to_string(i) + ",";
+
+    CROW_ROUTE(app, "/big")
+    ([&] {
+        return text;
+    });
+
+    CROW_ROUTE(app, "/tiny")
+    ([] {
+        return "small";
+    });
+
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).use_compression(compression::GZIP).run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    auto request = [&](const std::string& path) {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer("GET " + path + " HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n"));
+        std::string received;
+        char buf[65536];
+        asio::error_code ec;
+        size_t n;
+        while ((n = c.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+            received.append(buf, n);
+        return received;
+    };
+
+    // large bodies are compressed while streaming, using chunked encoding
+    auto big = request("/big");
+    auto header_end = big.find("\r\n\r\n");
+    REQUIRE(header_end != std::string::npos);
+    auto headers = big.substr(0, header_end);
+    CHECK(headers.find("Transfer-Encoding: chunked") != std::string::npos);
+    CHECK(headers.find("Content-Encoding: gzip") != std::string::npos);
+    CHECK(headers.find("Content-Length") == std::string::npos);
+
+    std::string compressed;
+    size_t pos = header_end + 4;
+    while (true)
+    {
+        auto line_end = big.find("\r\n", pos);
+        REQUIRE(line_end != std::string::npos);
+        size_t size = std::stoul(big.substr(pos, line_end - pos), nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0) break;
+        compressed += big.substr(pos, size);
+        pos += size + 2;
+    }
+    CHECK(compression::decompress_string(compressed) == text);
+
+    // bodies below the policy's minimum aren't worth compressing
+    auto tiny = request("/tiny");
+    CHECK(tiny.find("Content-Encoding") == std::string::npos);
+    CHECK(tiny.substr(tiny.size() - 5) == "small");
+
+    app.stop();
+} // compression_streaming_response
+
+TEST_CASE("compression_streaming_slow_client")
+{
+    SimpleApp app;
+    app.stream_threshold(64 * 1024);
+
+    // random bytes barely compress, so the chunks fill the socket buffers long before the body is through
+    std::string noise(16 * 1024 * 1024, '\0');
+    std::mt19937 generator(42);
+    for (auto& c : noise)
+        c = static_cast<char>(generator());
+
+    CROW_ROUTE(app, "/big")
+    ([&] {
+        return noise;
+    });
+
+    CROW_ROUTE(app, "/tiny")
+    ([] {
+        return "small";
+    });
+
+    // a single IO thread, a blocked write would hold up every other connection
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).concurrency(2).use_compression(compression::GZIP).run_async();
+    app.wait_for_server_start();
+
+    asio::io_service is;
+    asio::ip::tcp::socket slow(is);
+    slow.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+    slow.send(asio::buffer(std::string("GET /big HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n")));
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    auto tiny = std::async(std::launch::async, [] {
+        asio::io_service is;
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer(std::string("GET /tiny HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n")));
+        std::string received;
+        char buf[2048];
+        asio::error_code ec;
+        size_t n;
+        while ((n = c.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+            received.append(buf, n);
+        return received;
+    });
+    // answered while the slow client hasn't read anything yet
+    CHECK(tiny.wait_for(chrono::seconds(3)) == std::future_status::ready);
+
+    // the whole body still arrives once the client reads
+    std::string received;
+    std::string compressed;
+    size_t pos = std::string::npos;
+    bool complete = false;
+    std::vector<char> buf(65536);
+    while (!complete)
+    {
+        asio::error_code ec;
+        size_t n = slow.read_some(asio::buffer(buf), ec);
+        if (ec)
+            break;
+        received.append(buf.data(), n);
+        if (pos == std::string::npos)
+        {
+            auto header_end = received.find("\r\n\r\n");
+            if (header_end == std::string::npos)
+                continue;
+            CHECK(received.substr(0, header_end).find("Transfer-Encoding: chunked") != std::string::npos);
+            pos = header_end + 4;
+        }
+        while (true)
+        {
+            auto line_end = received.find("\r\n", pos);
+            if (line_end == std::string::npos)
+                break;
+            size_t size = std::stoul(received.substr(pos, line_end - pos), nullptr, 16);
+            if (received.size() < line_end + 2 + size + 2)
+                break;
+            compressed.append(received, line_end + 2, size);
+            pos = line_end + 2 + size + 2;
+            if (size == 0)
+            {
+                complete = true;
+                break;
+            }
+        }
+    }
+    REQUIRE(complete);
+    CHECK(pos == received.size());
+    CHECK(compression::decompress_string(compressed) == noise);
+    CHECK(tiny.get().find("small") != std::string::npos);
+
+    // the connection goes back to reading requests afterwards
+    slow.send(asio::buffer(std::string("GET /tiny HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n")));
+    std::string next;
+    asio::error_code ec;
+    size_t n;
+    while ((n = slow.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+        next.append(buf.data(), n);
+    CHECK(next.find("HTTP/1.1 200 OK") == 0);
+    CHECK(next.substr(next.size() - 5) == "small");
+
+    app.stop();
+} // compression_streaming_slow_client
+
+TEST_CASE("worker_pool")
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool release = false;
+    std::atomic<int> done{0};
+
+    detail::worker_pool pool(1, 2);
+    auto blocked = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] {
+            return release;
+        });
+        done++;
+    };
+
+    // one job occupies the only thread, two more fill the queue
+    CHECK(pool.try_post(blocked));
+    while (pool.pending() != 0)
+        std::this_thread::yield();
+    CHECK(pool.try_post(blocked));
+    CHECK(pool.try_post(blocked));
+    CHECK_FALSE(pool.try_post(blocked));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+
+    // stopping runs whatever is still queued
+    pool.stop();
+    CHECK(done == 3);
+    CHECK_FALSE(pool.try_post([] {}));
+} // worker_pool
+
+TEST_CASE("compression_offload")
+{
+    SimpleApp app;
+
+    std::string text;
+    for (int i = 0; i < 20000; i++)
+        text += "row " + std::to_string(i) + ",";
+
+    CROW_ROUTE(app, "/big")
+    ([&] {
+        return text;
+    });
+
+    CROW_ROUTE(app, "/tiny")
+    ([] {
+        return "small";
+    });
+
+    compression::policy policy{compression::GZIP};
+    policy.offload_size = 16 * 1024;
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).use_compression(policy).compression_workers(2).run_async();
+    app.wait_for_server_start();
+    REQUIRE(app.compression_pool() != nullptr);
+
+    asio::io_service is;
+    asio::ip::tcp::socket c(is);
+    c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+
+    std::string received;
+    auto read_response = [&] {
+        char buf[65536];
+        size_t header_end, length;
+        while (true)
+        {
+            header_end = received.find("\r\n\r\n");
+            if (header_end != std::string::npos)
+            {
+                auto found = received.find("Content-Length: ");
+                length = std::stoul(received.substr(found + 16));
+                if (received.size() >= header_end + 4 + length)
+                    break;
+            }
+            received.append(buf, c.receive(asio::buffer(buf)));
+        }
+        auto response = received.substr(0, header_end + 4 + length);
+        received.erase(0, response.size());
+        return response;
+    };
+
+    // the body is compressed on a worker, the connection then carries on reading requests
+    c.send(asio::buffer(std::string("GET /big HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n")));
+    auto big = read_response();
+    auto header_end = big.find("\r\n\r\n");
+    CHECK(big.substr(0, header_end).find("Content-Encoding: gzip") != std::string::npos);
+    CHECK(compression::decompress_string(big.substr(header_end + 4)) == text);
+
+    c.send(asio::buffer(std::string("GET /tiny HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\n\r\n")));
+    auto tiny = read_response();
+    CHECK(tiny.find("Content-Encoding") == std::string::npos);
+    CHECK(tiny.substr(tiny.size() - 5) == "small");
+
+    c.close();
+    app.stop();
+} // compression_offload
+
+TEST_CASE("compression_offload_streaming")
+{
+    SimpleApp app;
+    app.stream_threshold(64 * 1024);
+
+    std::string text;
+    for (int i = 0; i < 30000; i++)
+        text += "row " + std::to_string(i) + ",";
+
+    CROW_ROUTE(app, "/big")
+    ([&] {
+        return text;
+    });
+
+    CROW_ROUTE(app, "/medium")
+    ([&] {
+        return text.substr(0, 32 * 1024);
+    });
+
+    compression::policy policy{compression::GZIP};
+    policy.offload_size = 16 * 1024;
+    auto _ = app.bindaddr(LOCALHOST_ADDRESS).port(45451).use_compression(policy).compression_workers(2).run_async();
+    app.wait_for_server_start();
+    REQUIRE(app.compression_pool() != nullptr);
+
+    asio::io_service is;
+    auto request = [&](const std::string& path) {
+        asio::ip::tcp::socket c(is);
+        c.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string(LOCALHOST_ADDRESS), 45451));
+        c.send(asio::buffer("GET " + path + " HTTP/1.1\r\nHost: localhost\r\nAccept-Encoding: gzip\r\nConnection: close\r\n\r\n"));
+        std::string received;
+        char buf[65536];
+        asio::error_code ec;
+        size_t n;
+        while ((n = c.read_some(asio::buffer(buf), ec)) > 0 && !ec)
+            received.append(buf, n);
+        return received;
+    };
+
+    // past the stream threshold the body is streamed even though workers could compress it whole
+    auto big = request("/big");
+    auto header_end = big.find("\r\n\r\n");
+    REQUIRE(header_end != std::string::npos);
+    CHECK(big.substr(0, header_end).find("Transfer-Encoding: chunked") != std::string::npos);
+    CHECK(big.substr(0, header_end).find("Content-Length") == std::string::npos);
+
+    std::string compressed;
+    size_t pos = header_end + 4;
+    while (true)
+    {
+        auto line_end = big.find("\r\n", pos);
+        REQUIRE(line_end != std::string::npos);
+        size_t size = std::stoul(big.substr(pos, line_end - pos), nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0) break;
+        compressed += big.substr(pos, size);
+        pos += size + 2;
+    }
+    CHECK(compression::decompress_string(compressed) == text);
+
+    // below it the workers still compress the body in one piece
+    auto medium = request("/medium");
+    header_end = medium.find("\r\n\r\n");
+    REQUIRE(header_end != std::string::npos);
+    CHECK(medium.substr(0, header_end).find("Content-Length") != std::string::npos);
+    CHECK(compression::decompress_string(medium.substr(header_end + 4)) == text.substr(0, 32 * 1024));
+
+    app.stop();
+} // compression_offload_streaming
+
 TEST_CASE("zlib_compression")
 {
     static char buf_deflate[2048];
@@ -3410,6 +4901,87 @@ TEST_CASE("task_timer")
     io_thread.join();
 } // task_timer
 
+TEST_CASE("task_timer_wheel")
+{
+    using work_guard_type = asio::executor_work_guard<asio::io_service::executor_type>;
+
+    asio::io_service io_service;
+    work_guard_type work_guard(io_service.get_executor());
+    thread io_thread([&io_service]() {
+        io_service.run();
+    });
+
+    struct counting_node : crow::detail::timer_node
+    {
+        std::atomic<int> fired{0};
+        std::atomic<int> released{0};
+    };
+    auto count = [](crow::detail::timer_node& node, bool expired) {
+        if (expired)
+            static_cast<counting_node&>(node).fired++;
+        else
+            static_cast<counting_node&>(node).released++;
+    };
+
+    std::unique_ptr<crow::detail::task_timer> timer;
+    counting_node fast, cancelled, moved, leftover;
+    std::vector<counting_node> many(10000);
+    for (auto* node : {&fast, &cancelled, &moved, &leftover})
+        node->callback = count;
+    for (auto& node : many)
+        node.callback = count;
+
+    // the timer may only be used from its io_service's thread
+    auto on_io = [&](std::function<void()> f) {
+        std::promise<void> done;
+        asio::post(io_service, [&] {
+            f();
+            done.set_value();
+        });
+        done.get_future().wait();
+    };
+
+    on_io([&] {
+        timer.reset(new crow::detail::task_timer(io_service));
+        timer->schedule(fast, chrono::milliseconds(200));
+        timer->schedule(cancelled, chrono::milliseconds(200));
+        timer->schedule(moved, chrono::milliseconds(200));
+        timer->schedule(leftover, chrono::seconds(60));
+        for (auto& node : many)
+            timer->schedule(node, chrono::milliseconds(300));
+        CHECK(timer->scheduled() == 10004);
+
+        timer->cancel(cancelled);
+        timer->cancel(cancelled);
+        CHECK(!cancelled.scheduled());
+        // rescheduling replaces the earlier timeout
+        timer->schedule(moved, chrono::seconds(8));
+        CHECK(timer->scheduled() == 10003);
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(700));
+    on_io([&] {
+        CHECK(fast.fired == 1);
+        CHECK(cancelled.fired == 0);
+        CHECK(moved.fired == 0);
+        CHECK(moved.scheduled());
+        CHECK(std::all_of(many.begin(), many.end(), [](const counting_node& node) {
+            return node.fired == 1 && !node.scheduled();
+        }));
+        CHECK(timer->scheduled() == 2);
+
+        // destroying the timer hands back what is still scheduled
+        timer.reset();
+    });
+    CHECK(moved.released == 1);
+    CHECK(leftover.released == 1);
+    CHECK(fast.released == 0);
+    CHECK(!leftover.scheduled());
+
+    io_service.stop();
+    io_thread.join();
+} // task_timer_wheel
+
 
 TEST_CASE("trim")
 {
@@ -6,6 +6,10 @@
 #include <blt/std/hashmap.h>
 #include <blt/std/memory.h>
 #include <cstring>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <atomic>
 
 namespace cs
 {
@@ -30,6 +34,81 @@ namespace cs
         return size * nmemb;
     }
     
+    struct async_request::transfer
+    {
+        CURL* handle = nullptr;
+        struct curl_slist* headers = nullptr;
+        std::string url;
+        std::string data;
+        asio::io_service* service;
+        std::coroutine_handle<> awaiting;
+        requests::response response;
+    };
+    
+    /**
+     * Every async_request is driven by one curl multi handle on a single thread, however many are in flight.
+     */
+    struct
+    {
+        CURLM* multi = nullptr;
+        std::thread thread;
+        std::mutex mutex;
+        std::vector<async_request::transfer*> queued;
+        std::atomic_bool running = false;
+    } transfers;
+    
+    // transfers which take longer than this are failed, a coroutine waiting on them would otherwise never finish
+    constexpr long async_request_timeout_ms = 30 * 1000;
+    
+    size_t writeTransferData(char* ptr, size_t size, size_t nmemb, void* userdata)
+    {
+        static_cast<requests::response*>(userdata)->body.append(ptr, size * nmemb);
+        return size * nmemb;
+    }
+    
+    void runTransfers()
+    {
+        while (transfers.running)
+        {
+            {
+                std::scoped_lock lock(transfers.mutex);
+                for (auto* transfer : transfers.queued)
+                    curl_multi_add_handle(transfers.multi, transfer->handle);
+                transfers.queued.clear();
+            }
+            
+            int active = 0;
+            curl_multi_perform(transfers.multi, &active);
+            
+            CURLMsg* message;
+            int remaining = 0;
+            while ((message = curl_multi_info_read(transfers.multi, &remaining)))
+            {
+                if (message->msg != CURLMSG_DONE)
+                    continue;
+                async_request::transfer* transfer = nullptr;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+                curl_multi_remove_handle(transfers.multi, message->easy_handle);
+                
+                if (message->data.result != CURLE_OK)
+                {
+                    BLT_ERROR("CURL failed to send request '%s'. Error '%s'", transfer->url.c_str(), curl_easy_strerror(message->data.result));
+                    transfer->response.failed = true;
+                } else
+                    curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &transfer->response.status);
+                
+                // the coroutine owns the transfer, it may be gone as soon as it resumes
+                auto awaiting = transfer->awaiting;
+                asio::post(*transfer->service, [awaiting]() {
+                    awaiting.resume();
+                });
+            }
+            
+            // woken early by curl_multi_wakeup when a new transfer is queued
+            curl_multi_poll(transfers.multi, nullptr, 0, 1000, nullptr);
+        }
+    }
+    
     void requests::init()
     {
         auto code = curl_global_init(CURL_GLOBAL_ALL);
@@ -38,10 +117,22 @@ namespace cs
             BLT_ERROR("Unable to call CURL init!");
             std::exit(code);
         }
+        transfers.multi = curl_multi_init();
+        transfers.running = true;
+        transfers.thread = std::thread(runTransfers);
     }
     
     void requests::cleanup()
     {
+        // coroutines still waiting on a transfer are never resumed, this only happens on shutdown
+        transfers.running = false;
+        if (transfers.multi)
+            curl_multi_wakeup(transfers.multi);
+        if (transfers.thread.joinable())
+            transfers.thread.join();
+        if (transfers.multi)
+            curl_multi_cleanup(transfers.multi);
+        transfers.multi = nullptr;
         curl_global_cleanup();
     }
     
@@ -129,4 +220,84 @@ namespace cs
         curl_easy_getinfo(handler, CURLINFO_RESPONSE_CODE, &code);
         return code;
     }
-}
\ No newline at end of file
+    
+    async_request::async_request(asio::io_service& service): m_Transfer(std::make_unique<transfer>())
+    {
+        m_Transfer->handle = curl_easy_init();
+        m_Transfer->service = &service;
+    }
+    
+    async_request::~async_request()
+    {
+        curl_slist_free_all(m_Transfer->headers);
+        curl_easy_cleanup(m_Transfer->handle);
+    }
+    
+    void async_request::setAuthHeader(const std::string& header)
+    {
+        m_Transfer->headers = curl_slist_append(m_Transfer->headers, ("Authorization: " + header).c_str());
+    }
+    
+    void async_request::setContentHeaderJson()
+    {
+        setContentHeader("application/json");
+    }
+    
+    void async_request::setContentHeaderXForm()
+    {
+        setContentHeader("application/x-www-form-urlencoded");
+    }
+    
+    void async_request::setContentHeader(const std::string& header)
+    {
+        m_Transfer->headers = curl_slist_append(m_Transfer->headers, ("Content-Type: " + header).c_str());
+    }
+    
+    async_request::awaiter async_request::get(const std::string& url)
+    {
+        m_Transfer->url = url;
+        curl_easy_setopt(m_Transfer->handle, CURLOPT_HTTPGET, 1L);
+        return {m_Transfer.get()};
+    }
+    
+    async_request::awaiter async_request::post(const std::string& url, std::string data)
+    {
+        m_Transfer->url = url;
+        m_Transfer->data = std::move(data);
+        curl_easy_setopt(m_Transfer->handle, CURLOPT_POSTFIELDS, m_Transfer->data.c_str());
+        curl_easy_setopt(m_Transfer->handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(m_Transfer->data.size()));
+        return {m_Transfer.get()};
+    }
+    
+    bool async_request::awaiter::await_suspend(std::coroutine_handle<> handle)
+    {
+        if (!transfers.running || !m_Transfer->handle)
+        {
+            BLT_ERROR("Unable to send request '%s', requests were not initialized", m_Transfer->url.c_str());
+            m_Transfer->response.failed = true;
+            return false;
+        }
+        
+        auto* easy = m_Transfer->handle;
+        curl_easy_setopt(easy, CURLOPT_URL, m_Transfer->url.c_str());
+        curl_easy_setopt(easy, CURLOPT_HTTPHEADER, m_Transfer->headers);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, writeTransferData);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, &m_Transfer->response);
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, m_Transfer);
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, async_request_timeout_ms);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        m_Transfer->awaiting = handle;
+        
+        {
+            std::scoped_lock lock(transfers.mutex);
+            transfers.queued.push_back(m_Transfer);
+        }
+        curl_multi_wakeup(transfers.multi);
+        return true;
+    }
+    
+    requests::response async_request::awaiter::await_resume()
+    {
+        return std::move(m_Transfer->response);
+    }
+}
@@ -6,6 +6,7 @@
 #include <crow/json.h>
 #include <blt/std/hashmap.h>
 #include <blt/std/logging.h>
+#include <shared_mutex>
 
 namespace cs::jellyfin
 {
@@ -14,6 +15,8 @@ namespace cs::jellyfin
     {
         std::string token;
         HASHMAP<std::string, client_data> user_ids;
+        // users are loaded from the IO threads while requests look them up
+        std::shared_mutex user_ids_mutex;
     } GLOBALS;
     
     void setToken(std::string_view token)
@@ -21,12 +24,11 @@ namespace cs::jellyfin
         GLOBALS.token = token;
     }
     
-    void processUserData()
+    void loadUserData(const std::string& usr_data)
     {
-        auto usr_data = getUserData();
-        
         auto json = crow::json::load(usr_data);
         
+        std::unique_lock lock(GLOBALS.user_ids_mutex);
         for (const auto& users : json)
         {
             const auto& policy = users["Policy"];
@@ -49,6 +51,11 @@ namespace cs::jellyfin
         }
     }
     
+    void processUserData()
+    {
+        loadUserData(getUserData());
+    }
+    
     std::string getUserData()
     {
         const auto url = "https://media.tpgc.me/Users";
@@ -68,6 +75,7 @@ namespace cs::jellyfin
     
     bool hasUser(std::string_view username)
     {
+        std::shared_lock lock(GLOBALS.user_ids_mutex);
         return GLOBALS.user_ids.find(std::string(username)) != GLOBALS.user_ids.end();
     }
     
@@ -98,9 +106,44 @@ namespace cs::jellyfin
         return auth_response::ERROR;
     }
     
-    const client_data& getUserData(const std::string& username)
+    crow::task<auth_response> authenticateUserAsync(asio::io_service& service, std::string username, std::string password)
+    {
+        if (!hasUser(username))
+        {
+            async_request users(service);
+            users.setContentHeaderJson();
+            users.setAuthHeader(generateAuthHeader());
+            auto response = co_await users.get("https://media.tpgc.me/Users");
+            if (!response.failed)
+                loadUserData(response.body);
+        }
+        if (!hasUser(username))
+        {
+            BLT_ERROR("User not found!");
+            co_return auth_response::USERNAME;
+        }
+        
+        async_request post(service);
+        post.setContentHeaderJson();
+        post.setAuthHeader(generateAuthHeader());
+        crow::json::wvalue json;
+        json["Username"] = username;
+        json["Pw"] = password;
+        auto response = co_await post.post("https://media.tpgc.me/Users/AuthenticateByName", json.dump());
+        
+        if (response.status == 200)
+            co_return auth_response::AUTHORIZED;
+        
+        co_return auth_response::ERROR;
+    }
+    
+    client_data getUserData(const std::string& username)
     {
-        return GLOBALS.user_ids[username];
+        std::shared_lock lock(GLOBALS.user_ids_mutex);
+        auto find = GLOBALS.user_ids.find(username);
+        if (find == GLOBALS.user_ids.end())
+            return {};
+        return find->second;
     }
     
 }
\ No newline at end of file
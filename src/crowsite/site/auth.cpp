@@ -7,11 +7,22 @@
 #include <crowsite/utility.h>
 #include "blt/std/logging.h"
 #include "blt/std/uuid.h"
+#include "blt/std/string.h"
 #include <openssl/sha.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
 #include <crowsite/sql_helper.h>
 #include <random>
+#include <optional>
+#include <algorithm>
 #include <filesystem>
+#include <chrono>
+#include <shared_mutex>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 using namespace blt;
 
@@ -19,6 +30,31 @@ namespace cs
 {
     cs::sql::database* user_database;
     
+    struct token_key
+    {
+        int64_t keyID;
+        int64_t created;
+        std::string key;
+    };
+    
+    // newest key first. only written during auth::init() so reads don't need to be synchronized
+    std::vector<token_key> token_keys;
+    
+    // clientID -> time (ms) of the last revocation, any signed token issued before this is invalid
+    HASHMAP<std::string, int64_t> revoked_sessions;
+    std::shared_mutex revoked_mutex;
+    
+    // v2 tokens carry the session tag, v1 tokens are no longer accepted
+    const std::string signed_token_prefix = "v2.";
+    
+    struct
+    {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool running = false;
+    } sweeper;
+    
     // https://stackoverflow.com/questions/5288076/base64-encoding-and-decoding-with-openssl
     
     char* base64(const unsigned char* input, int length)
@@ -33,16 +69,102 @@ namespace cs
         return output;
     }
     
-    unsigned char* decode64(const char* input, int length)
+    std::string encode64(const std::string& input)
     {
-        const auto pl = 3 * length / 4;
-        auto output = reinterpret_cast<unsigned char*>(calloc(pl + 1, 1));
-        const auto ol = EVP_DecodeBlock(output, reinterpret_cast<const unsigned char*>(input), length);
-        if (pl != ol)
+        auto b64str = base64(reinterpret_cast<const unsigned char*>(input.data()), static_cast<int>(input.size()));
+        std::string out{b64str};
+        free(b64str);
+        return out;
+    }
+    
+    std::optional<std::string> decode64(const std::string& input)
+    {
+        if (input.empty() || input.size() % 4 != 0)
+            return {};
+        auto padding = static_cast<size_t>(input.ends_with("==") ? 2 : input.ends_with('=') ? 1 : 0);
+        // tokens come straight from cookies, anything that isn't valid base64 is rejected quietly
+        std::string out(3 * input.size() / 4, '\0');
+        const auto length = EVP_DecodeBlock(
+                reinterpret_cast<unsigned char*>(out.data()), reinterpret_cast<const unsigned char*>(input.data()), static_cast<int>(input.size())
+        );
+        if (length < 0 || static_cast<size_t>(length) != out.size())
+            return {};
+        out.resize(out.size() - padding);
+        return out;
+    }
+    
+    std::string toHex(const std::string& input)
+    {
+        constexpr char digits[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(input.size() * 2);
+        for (unsigned char c : input)
         {
-            std::cerr << "Whoops, decode predicted " << pl << " but we got " << ol << "\n";
+            out += digits[c >> 4];
+            out += digits[c & 0xF];
         }
-        return output;
+        return out;
+    }
+    
+    std::string fromHex(const std::string& input)
+    {
+        std::string out;
+        out.reserve(input.size() / 2);
+        for (size_t i = 0; i + 1 < input.size(); i += 2)
+            out += static_cast<char>(std::stoi(input.substr(i, 2), nullptr, 16));
+        return out;
+    }
+    
+    int64_t currentTimeSeconds()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    
+    int64_t currentTimeMillis()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    
+    std::string signPayload(const token_key& key, const std::string& payload)
+    {
+        unsigned char mac[EVP_MAX_MD_SIZE];
+        unsigned int macLength = 0;
+        HMAC(
+                EVP_sha256(), key.key.data(), static_cast<int>(key.key.size()), reinterpret_cast<const unsigned char*>(payload.data()),
+                payload.size(), mac, &macLength
+        );
+        return {reinterpret_cast<const char*>(mac), macLength};
+    }
+    
+    /**
+     * Ties a signed token to one login. Every login stores a new random token in user_sessions, so a signed token only refreshes
+     * while the login it was issued for is the current one. Hashed since the payload of a signed token is readable by anyone holding it.
+     */
+    std::string sessionTag(const std::string& sessionToken)
+    {
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char*>(sessionToken.data()), sessionToken.size(), hash);
+        return toHex(std::string(reinterpret_cast<const char*>(hash), 16));
+    }
+    
+    void touchUserSession(const std::string& clientID, int64_t now)
+    {
+        sql::statement touch {
+                user_database,
+                "UPDATE user_sessions SET last_seen=?, expires_at=? WHERE clientID=?;"
+        };
+        touch.set(now, 0);
+        touch.set(now + user_session_age, 1);
+        touch.set(clientID, 2);
+        if (touch.fail() || !touch.execute())
+            BLT_WARN("Failed to update user session %d : %s", touch.error(), sqlite3_errstr(touch.error()));
+    }
+    
+    bool isTokenRevoked(const token_data& data)
+    {
+        std::shared_lock lock(revoked_mutex);
+        auto find = revoked_sessions.find(data.clientID);
+        return find != revoked_sessions.end() && data.issued <= find->second;
     }
     
     bool checkUserAuthorization(cs::parser::Post& postData)
@@ -56,6 +178,15 @@ namespace cs
         return auth == jellyfin::auth_response::AUTHORIZED;
     }
     
+    crow::task<bool> checkUserAuthorizationAsync(asio::io_service& service, parser::Post& postData)
+    {
+        if (!postData.hasKey("username") || !postData.hasKey("password"))
+            co_return false;
+        auto auth = co_await jellyfin::authenticateUserAsync(service, postData["username"], postData["password"]);
+        
+        co_return auth == jellyfin::auth_response::AUTHORIZED;
+    }
+    
     cookie_data createUserAuthTokens(parser::Post& postData, const std::string& useragent)
     {
         cookie_data cookieOut;
@@ -89,7 +220,7 @@ namespace cs
     {
         sql::statement insertStmt {
                 user_database,
-                "INSERT OR REPLACE INTO user_sessions (clientID, username, useragent, token) VALUES (?, ?, ?, ?);"
+                "INSERT OR REPLACE INTO user_sessions (clientID, username, useragent, token, last_seen, expires_at) VALUES (?, ?, ?, ?, ?, ?);"
         };
         
         if (insertStmt.fail())
@@ -102,6 +233,9 @@ namespace cs
         insertStmt.set(username, 1);
         insertStmt.set(useragent, 2);
         insertStmt.set(tokens.clientToken, 3);
+        auto now = currentTimeSeconds();
+        insertStmt.set(now, 4);
+        insertStmt.set(now + user_session_age, 5);
         
         if (!insertStmt.execute())
         {
@@ -145,18 +279,170 @@ namespace cs
         return true;
     }
     
-    bool isUserLoggedIn(const std::string& clientID, const std::string& token)
+    std::string createSignedUserToken(const std::string& clientID, const std::string& username, const std::string& sessionToken)
+    {
+        if (token_keys.empty())
+        {
+            BLT_WARN("No token signing keys are loaded, unable to sign token for '%s'", username.c_str());
+            return "";
+        }
+        const auto& key = token_keys.front();
+        
+        std::string payload = clientID;
+        payload += '\n';
+        payload += username;
+        payload += '\n';
+        payload += std::to_string(getUserPermissions(username));
+        payload += '\n';
+        payload += std::to_string(currentTimeMillis());
+        payload += '\n';
+        payload += std::to_string(currentTimeSeconds() + signed_token_age);
+        payload += '\n';
+        payload += sessionTag(sessionToken);
+        
+        return signed_token_prefix + std::to_string(key.keyID) + "." + encode64(payload) + "." + encode64(signPayload(key, payload));
+    }
+    
+    bool isSignedToken(const std::string& token)
+    {
+        return token.starts_with(signed_token_prefix);
+    }
+    
+    std::optional<token_data> verifySignedUserToken(const std::string& token)
+    {
+        if (!isSignedToken(token))
+            return {};
+        // base64 never contains '.' so the token splits cleanly into version, keyID, payload and mac
+        auto parts = blt::string::split(token, ".");
+        if (parts.size() != 4)
+            return {};
+        
+        try
+        {
+            auto keyID = std::stoll(parts[1]);
+            auto key = std::find_if(
+                    token_keys.begin(), token_keys.end(), [keyID](const token_key& k) -> bool {
+                        return k.keyID == keyID;
+                    }
+            );
+            if (key == token_keys.end())
+                return {};
+            
+            auto payload = decode64(parts[2]);
+            auto mac = decode64(parts[3]);
+            if (!payload || !mac)
+                return {};
+            
+            auto expected = signPayload(*key, payload.value());
+            if (expected.size() != mac->size() || CRYPTO_memcmp(expected.data(), mac->data(), expected.size()) != 0)
+                return {};
+            
+            auto fields = blt::string::split(payload.value(), "\n");
+            if (fields.size() != 6)
+                return {};
+            
+            return token_data{
+                    fields[0],
+                    fields[1],
+                    static_cast<uint32_t>(std::stoul(fields[2])),
+                    std::stoll(fields[3]),
+                    std::stoll(fields[4]),
+                    fields[5]
+            };
+        } catch (std::exception& e)
+        {
+            BLT_WARN("Malformed signed token: %s", e.what());
+            return {};
+        }
+    }
+    
+    std::optional<token_data> getSignedUserData(const std::string& clientID, const std::string& token)
+    {
+        auto data = verifySignedUserToken(token);
+        if (!data || data->clientID != clientID || data->expires <= currentTimeSeconds() || isTokenRevoked(*data))
+            return {};
+        return data;
+    }
+    
+    void revokeUserSession(const std::string& clientID)
+    {
+        if (clientID.empty())
+            return;
+        auto revokeTime = currentTimeMillis();
+        {
+            std::unique_lock lock(revoked_mutex);
+            revoked_sessions[clientID] = revokeTime;
+        }
+        
+        sql::statement revokeStmt {
+                user_database,
+                "INSERT OR REPLACE INTO revoked_sessions (clientID, revoked) VALUES (?, ?);"
+        };
+        revokeStmt.set(clientID, 0);
+        revokeStmt.set(revokeTime, 1);
+        if (revokeStmt.fail() || !revokeStmt.execute())
+            BLT_WARN("Failed to store session revocation %d : %s", revokeStmt.error(), sqlite3_errstr(revokeStmt.error()));
+        
+        sql::statement deleteStmt {
+                user_database,
+                "DELETE FROM user_sessions WHERE clientID=?;"
+        };
+        deleteStmt.set(clientID, 0);
+        if (deleteStmt.fail() || !deleteStmt.execute())
+            BLT_WARN("Failed to delete user session %d : %s", deleteStmt.error(), sqlite3_errstr(deleteStmt.error()));
+    }
+    
+    bool isUserLoggedIn(const std::string& clientID, const std::string& token, std::string* refreshed)
     {
+        if (isSignedToken(token))
+        {
+            auto data = verifySignedUserToken(token);
+            if (!data || data->clientID != clientID || isTokenRevoked(*data))
+                return false;
+            if (data->expires > currentTimeSeconds())
+                return true;
+            // expired tokens are refreshed against the session table, which is cleared when the session is revoked.
+            // logging in again recreates the same clientID, so the token also has to belong to the login stored now
+            sql::statement refresh {
+                user_database,
+                "SELECT username, last_seen, token FROM user_sessions WHERE clientID=? AND expires_at>?;"
+            };
+            if (refresh.fail())
+                return false;
+            auto now = currentTimeSeconds();
+            refresh.set(clientID, 0);
+            refresh.set(now, 1);
+            refresh.execute();
+            if (!refresh.hasRow() || refresh.get<std::string>(0) != data->username)
+                return false;
+            auto sessionToken = refresh.get<std::string>(2);
+            auto tag = sessionTag(sessionToken);
+            if (tag.size() != data->session.size() || CRYPTO_memcmp(tag.data(), data->session.data(), tag.size()) != 0)
+                return false;
+            if (refresh.get<int64_t>(1) + user_session_touch_interval < now)
+                touchUserSession(clientID, now);
+            // a new token lets the following requests skip the database again
+            if (refreshed)
+                *refreshed = createSignedUserToken(clientID, data->username, sessionToken);
+            return true;
+        }
+        
+        auto now = currentTimeSeconds();
         sql::statement stmt {
             user_database,
-            "SELECT username FROM user_sessions WHERE clientID=? AND token=?;"
+            "SELECT last_seen FROM user_sessions WHERE clientID=? AND token=? AND expires_at>?;"
         };
         if (stmt.fail())
             return false;
         stmt.set(clientID, 0);
         stmt.set(token, 1);
+        stmt.set(now, 2);
         stmt.execute();
-        return stmt.hasRow();
+        if (!stmt.hasRow())
+            return false;
+        if (stmt.get<int64_t>(0) + user_session_touch_interval < now)
+            touchUserSession(clientID, now);
+        return true;
     }
     
     bool isUserAdmin(const std::string& username)
@@ -188,6 +474,233 @@ namespace cs
         return static_cast<uint32_t>(stmt.executeAndGet<int32_t>(0)) | cs::PERM_DEFAULT;
     }
     
+    void loadTokenKeys()
+    {
+        sql::statement newest {
+                user_database,
+                "SELECT created FROM token_keys ORDER BY keyID DESC LIMIT 1;"
+        };
+        
+        if (!newest.fail() && newest.execute() && (!newest.hasRow() || newest.get<int64_t>(0) + token_key_age < currentTimeSeconds()))
+        {
+            unsigned char key[SHA256_DIGEST_LENGTH];
+            if (RAND_bytes(key, sizeof(key)) != 1)
+                BLT_THROW(std::runtime_error("Unable to generate token signing key!"));
+            
+            sql::statement insertKey {
+                    user_database,
+                    "INSERT INTO token_keys (created, key) VALUES (?, ?);"
+            };
+            insertKey.set(currentTimeSeconds(), 0);
+            insertKey.set(toHex(std::string(reinterpret_cast<const char*>(key), sizeof(key))), 1);
+            if (insertKey.fail() || !insertKey.execute())
+                BLT_ERROR("Failed to store new token signing key %d : %s", insertKey.error(), sqlite3_errstr(insertKey.error()));
+            else
+                BLT_INFO("Rotated token signing key");
+        }
+        
+        sql::statement prune {
+                user_database,
+                "DELETE FROM token_keys WHERE keyID NOT IN (SELECT keyID FROM token_keys ORDER BY keyID DESC LIMIT ?);"
+        };
+        prune.set(static_cast<int64_t>(token_key_count), 0);
+        if (prune.fail() || !prune.execute())
+            BLT_WARN("Failed to prune old token signing keys %d : %s", prune.error(), sqlite3_errstr(prune.error()));
+        
+        sql::query<int64_t, int64_t, std::string> keys {
+                user_database,
+                "SELECT keyID, created, key FROM token_keys ORDER BY keyID DESC;"
+        };
+        token_keys.clear();
+        for (const auto& [keyID, created, key] : keys)
+            token_keys.push_back({keyID, created, fromHex(key)});
+        
+        BLT_INFO("Loaded %d token signing keys", token_keys.size());
+    }
+    
+    void loadRevokedSessions()
+    {
+        sql::query<std::string_view, int64_t> revoked {
+                user_database,
+                "SELECT clientID, revoked FROM revoked_sessions;"
+        };
+        std::unique_lock lock(revoked_mutex);
+        revoked_sessions.clear();
+        for (const auto& [clientID, revokeTime] : revoked)
+            revoked_sessions[std::string(clientID)] = revokeTime;
+    }
+    
+    void migrateUserDatabase()
+    {
+        std::vector<sql::migration> migrations;
+        
+        migrations.push_back(
+                {1, "initial schema", {
+                        "CREATE TABLE IF NOT EXISTS user_sessions (clientID VARCHAR(36), username TEXT, useragent TEXT, token TEXT, PRIMARY KEY(clientID));",
+                        "CREATE TABLE IF NOT EXISTS user_permissions (username TEXT, permission INT, PRIMARY KEY(username));"
+                }}
+        );
+        
+        migrations.push_back(
+                {2, "session expiry", {}, [](const sql::database* db) {
+                    // the columns may already exist if the table was created before migrations were tracked
+                    if (!sql::has_column(db, "user_sessions", "expires_at"))
+                    {
+                        sql::auto_statement(db, "ALTER TABLE user_sessions ADD COLUMN last_seen INTEGER;");
+                        sql::auto_statement(db, "ALTER TABLE user_sessions ADD COLUMN expires_at INTEGER;");
+                        
+                        sql::statement backfill {
+                                db,
+                                "UPDATE user_sessions SET last_seen=?, expires_at=? WHERE expires_at IS NULL;"
+                        };
+                        auto now = currentTimeSeconds();
+                        backfill.set(now, 0);
+                        backfill.set(now + user_session_age, 1);
+                        if (backfill.fail() || !backfill.execute())
+                            BLT_THROW(sql::sql_error("Failed to backfill session expiry: " + std::string(sqlite3_errstr(backfill.error()))));
+                    }
+                    sql::auto_statement(db, "CREATE INDEX IF NOT EXISTS user_sessions_expires_at ON user_sessions(expires_at);");
+                }}
+        );
+        
+        migrations.push_back(
+                {3, "signed tokens", {
+                        "CREATE TABLE IF NOT EXISTS token_keys (keyID INTEGER PRIMARY KEY AUTOINCREMENT, created INTEGER, key TEXT);",
+                        "CREATE TABLE IF NOT EXISTS revoked_sessions (clientID VARCHAR(36), revoked INTEGER, PRIMARY KEY(clientID));"
+                }}
+        );
+        
+        // every lookup is keyed on the primary key, sqlite will always pick the primary key's autoindex for those and then seek into
+        // the rowid table. storing the tables WITHOUT ROWID makes the primary key the table itself, so each lookup is a single b-tree search
+        migrations.push_back(
+                {4, "clustered primary keys", {
+                        "CREATE TABLE user_sessions_new (clientID VARCHAR(36), username TEXT, useragent TEXT, token TEXT, last_seen INTEGER, expires_at INTEGER, PRIMARY KEY(clientID)) WITHOUT ROWID;",
+                        "INSERT INTO user_sessions_new SELECT clientID, username, useragent, token, last_seen, expires_at FROM user_sessions WHERE clientID IS NOT NULL;",
+                        "DROP TABLE user_sessions;",
+                        "ALTER TABLE user_sessions_new RENAME TO user_sessions;",
+                        // covers the sweeper, secondary indexes of WITHOUT ROWID tables carry the primary key
+                        "CREATE INDEX user_sessions_expires_at ON user_sessions(expires_at);",
+                        
+                        "CREATE TABLE user_permissions_new (username TEXT, permission INT, PRIMARY KEY(username)) WITHOUT ROWID;",
+                        "INSERT INTO user_permissions_new SELECT username, permission FROM user_permissions WHERE username IS NOT NULL;",
+                        "DROP TABLE user_permissions;",
+                        "ALTER TABLE user_permissions_new RENAME TO user_permissions;"
+                }}
+        );
+        
+        sql::migrate(user_database, "users", std::move(migrations));
+        
+        // incremental vacuum only works if auto_vacuum was enabled before the tables were created, so rebuild once if it wasn't.
+        // VACUUM can't run inside a transaction which is why this isn't a migration
+        sql::statement vacuumMode {
+                user_database,
+                "PRAGMA auto_vacuum;"
+        };
+        if (!vacuumMode.fail() && vacuumMode.executeAndGet<int32_t>(0) != 2)
+        {
+            BLT_INFO("Enabling incremental vacuum on users database");
+            sql::auto_statement(user_database, "PRAGMA auto_vacuum = INCREMENTAL;");
+            sql::auto_statement(user_database, "VACUUM;");
+        }
+    }
+    
+    /**
+     * A revocation only has to outlive the signed tokens issued before it, after signed_token_age they have all expired
+     */
+    void pruneRevokedSessions()
+    {
+        auto cutoff = currentTimeMillis() - signed_token_age * 1000;
+        // held across the delete so a revocation can't be dropped from one of the table and the map but not the other
+        std::unique_lock lock(revoked_mutex);
+        sql::statement prune {
+                user_database,
+                "DELETE FROM revoked_sessions WHERE revoked<?;"
+        };
+        prune.set(cutoff, 0);
+        if (prune.fail() || !prune.execute())
+        {
+            BLT_WARN("Failed to prune revoked sessions %d : %s", prune.error(), sqlite3_errstr(prune.error()));
+            return;
+        }
+        for (auto it = revoked_sessions.begin(); it != revoked_sessions.end();)
+        {
+            if (it->second < cutoff)
+                it = revoked_sessions.erase(it);
+            else
+                ++it;
+        }
+    }
+    
+    int64_t auth::sweepExpiredSessions()
+    {
+        int64_t deleted = 0;
+        while (true)
+        {
+            sql::statement sweep {
+                    user_database,
+                    "DELETE FROM user_sessions WHERE clientID IN (SELECT clientID FROM user_sessions WHERE expires_at<? LIMIT ?) RETURNING clientID;"
+            };
+            if (sweep.fail())
+                break;
+            sweep.set(currentTimeSeconds(), 0);
+            sweep.set(user_session_sweep_batch, 1);
+            // the connection is shared with the request threads, so sqlite3_changes() could report one of their statements.
+            // the deleted rows are counted from the statement itself instead
+            int64_t changes = 0;
+            while (sweep.execute() && sweep.hasRow())
+                changes++;
+            if (sweep.fail())
+            {
+                BLT_WARN("Failed to sweep expired sessions %d : %s", sweep.error(), sqlite3_errstr(sweep.error()));
+                break;
+            }
+            deleted += changes;
+            if (changes < user_session_sweep_batch)
+                break;
+            // small batches keep the write lock short, give request threads a chance at the database between them
+            std::this_thread::yield();
+        }
+        
+        pruneRevokedSessions();
+        
+        if (deleted > 0)
+        {
+            sql::statement vacuum {
+                    user_database,
+                    "PRAGMA incremental_vacuum;"
+            };
+            while (!vacuum.fail() && vacuum.execute() && vacuum.hasRow());
+            BLT_DEBUG("Swept %d expired user sessions", deleted);
+        }
+        return deleted;
+    }
+    
+    void startSessionSweeper()
+    {
+        sweeper.running = true;
+        sweeper.thread = std::thread([]() {
+            std::unique_lock lock(sweeper.mutex);
+            while (sweeper.running)
+            {
+                lock.unlock();
+                auth::sweepExpiredSessions();
+                lock.lock();
+                sweeper.cv.wait_for(lock, std::chrono::seconds(user_session_sweep_interval), []() { return !sweeper.running; });
+            }
+        });
+    }
+    
+    void stopSessionSweeper()
+    {
+        {
+            std::scoped_lock lock(sweeper.mutex);
+            sweeper.running = false;
+        }
+        sweeper.cv.notify_all();
+        if (sweeper.thread.joinable())
+            sweeper.thread.join();
+    }
+    
     void auth::init()
     {
         // TODO: proper multithreading
@@ -205,25 +718,15 @@ namespace cs
         
         BLT_INFO("SQLite Version: %s", v.get<std::string>(0).c_str());
         
-        sql::statement tableStmt{
-                user_database,
-                "CREATE TABLE IF NOT EXISTS user_sessions (clientID VARCHAR(36), username TEXT, useragent TEXT, token TEXT, PRIMARY KEY(clientID));"
-        };
-        
-        if (tableStmt.fail() || !tableStmt.execute())
-            BLT_ERROR("Failed to execute user_sessions table creation! %d : %s", tableStmt.error(), sqlite3_errstr(tableStmt.error()));
-        
-        sql::statement permsStmt{
-                user_database,
-                "CREATE TABLE IF NOT EXISTS user_permissions (username TEXT, permission INT, PRIMARY KEY(username));"
-        };
-        
-        if (permsStmt.fail() || !permsStmt.execute())
-            BLT_ERROR("Failed to execute user_permissions table creation! %d : %s", permsStmt.error(), sqlite3_errstr(permsStmt.error()));
+        migrateUserDatabase();
+        loadTokenKeys();
+        loadRevokedSessions();
+        startSessionSweeper();
     }
     
     void auth::cleanup()
     {
+        stopSessionSweeper();
         delete(user_database);
     }
 }
\ No newline at end of file
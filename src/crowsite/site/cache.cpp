@@ -13,13 +13,16 @@
 
 namespace cs
 {
+    /**
+     * Lexers only look at the text they are given, which has to outlive them. Tokens are views into it.
+     */
     class LexerBase
     {
         protected:
-            std::string str;
+            std::string_view str;
             size_t index = 0;
         public:
-            explicit LexerBase(std::string str): str(std::move(str))
+            explicit LexerBase(std::string_view str): str(str)
             {}
             
             inline bool hasNext()
@@ -59,16 +62,17 @@ namespace cs
              * @return the token found between the prefix and suffix
              * @throws LexerSyntaxError if the parser is unable to process a full token
              */
-            inline std::string consumeToken()
+            inline std::string_view consumeToken()
             {
                 consumeTemplatePrefix();
-                std::string token;
+                auto start = index;
                 while (!hasTemplateSuffix())
                 {
                     if (!hasNext())
                     blt_throw(LexerSyntaxError());
-                    token += consume();
+                    index++;
                 }
+                auto token = str.substr(start, index - start);
                 consumeTemplateSuffix();
                 return token;
             }
@@ -77,7 +81,7 @@ namespace cs
     class CacheLexer : public LexerBase
     {
         public:
-            explicit CacheLexer(std::string str): LexerBase(std::move(str))
+            explicit CacheLexer(std::string_view str): LexerBase(str)
             {}
             
             static inline bool isCharNext(char c)
@@ -142,7 +146,7 @@ namespace cs
                     struct Token
                     {
                         TokenType type;
-                        std::optional<std::string> value;
+                        std::optional<std::string_view> value;
                     };
                     
                     static inline bool isSpecial(char c)
@@ -150,10 +154,10 @@ namespace cs
                         return c == '&' || c == '|' || c == '!' || c == '(' || c == ')' || std::isspace(c);
                     }
                     
-                    std::vector<Token> tokens;
+                    std::vector<Token, crow::arena_allocator<Token>> tokens;
                     size_t t_index = 0;
                     size_t s_index = 0;
-                    std::string str;
+                    std::string_view str;
                     
                     inline bool hasNextToken()
                     {
@@ -215,20 +219,19 @@ namespace cs
                                     tokens.emplace_back(TokenType::CLOSE);
                                     break;
                                 default:
-                                    std::string token;
-                                    token += c;
+                                    auto start = s_index - 1;
                                     while (hasNext() && !isSpecial(peek()))
-                                        token += consume();
-                                    tokens.emplace_back(TokenType::IDENT, token);
+                                        consume();
+                                    tokens.emplace_back(TokenType::IDENT, str.substr(start, s_index - start));
                                     break;
                             }
                         }
                     }
                     
-                    static inline bool isTrue(const context& context, const std::string& token)
+                    static inline bool isTrue(const context& context, std::string_view token)
                     {
-                        //BLT_DEBUG("isTrue for token '%s' contains? %s", token.c_str(), context.contains(token) ? "True" : "False");
-                        return context.contains(token) && !context.at(token).empty();
+                        auto value = context.find(token);
+                        return value != context.end() && !value->second.empty();
                     }
                     
                     // http://www.cs.unb.ca/~wdu/cs4613/a2ans.htm
@@ -278,7 +281,7 @@ namespace cs
                     }
                 
                 public:
-                    explicit LogicalEval(std::string str): str(std::move(str))
+                    LogicalEval(std::string_view str, const crow::arena_allocator<Token>& allocator): tokens(allocator), str(str)
                     {
                         processString();
                     }
@@ -290,7 +293,7 @@ namespace cs
             };
         
         public:
-            explicit RuntimeLexer(std::string str): LexerBase(std::move(str))
+            explicit RuntimeLexer(std::string_view str): LexerBase(str)
             {}
             
             inline bool hasTemplatePrefix(char c = '%')
@@ -300,7 +303,7 @@ namespace cs
                 return str[index] == '{' && str[index + 1] == '{' && str[index + 2] == c;
             }
 
-            static void getTagLocations(std::vector<size_t>& tagLocations, const std::string& tag, const std::string& data)
+            static void getTagLocations(std::vector<size_t>& tagLocations, std::string_view tag, std::string_view data)
             {
                 RuntimeLexer lexer(data);
                 while (lexer.hasNext())
@@ -315,27 +318,40 @@ namespace cs
                         lexer.consume();
                 }
                 if (tagLocations.empty())
-                blt_throw(LexerSearchFailure(tag));
+                blt_throw(LexerSearchFailure(std::string(tag)));
             }
             
-            static size_t findLastTagLocation(const std::string& tag, const std::string& data)
+            static size_t findLastTagLocation(std::string_view tag, std::string_view data)
             {
                 std::vector<size_t> tagLocations{};
                 getTagLocations(tagLocations, tag, data);
                 return tagLocations[tagLocations.size() - 1];
             }
             
-            static size_t findNextTagLocation(const std::string& tag, const std::string& data)
+            static size_t findNextTagLocation(std::string_view tag, std::string_view data)
             {
-                std::vector<size_t> tagLocations{};
-                getTagLocations(tagLocations, tag, data);
-                return tagLocations[0];
+                // only the first one matters, no need to look at the rest of the page
+                RuntimeLexer lexer(data);
+                while (lexer.hasNext())
+                {
+                    if (lexer.hasTemplatePrefix('/') || lexer.hasTemplatePrefix('*'))
+                    {
+                        auto loc = lexer.index;
+                        if (lexer.consumeToken() == tag)
+                            return loc;
+                    } else
+                        lexer.consume();
+                }
+                blt_throw(LexerSearchFailure(std::string(tag)));
             }
             
-            static std::string searchAndReplace(const std::string& data, const context& context)
+            /**
+             * Appends data to results with the logical blocks resolved against the context. Nothing is copied out of data
+             * until it is appended, the tokens of the expressions are allocated like the context.
+             */
+            static void searchAndReplace(std::string_view data, const context& context, std::string& results)
             {
                 RuntimeLexer lexer(data);
-                std::string results;
                 while (lexer.hasNext())
                 {
                     if (lexer.hasTemplatePrefix())
@@ -345,12 +361,12 @@ namespace cs
                         auto endTokenLoc = RuntimeLexer::findNextTagLocation(token, searchField);
                         auto internalData = searchField.substr(0, endTokenLoc);
                         
-                        LogicalEval eval(token);
+                        LogicalEval eval(token, context.get_allocator());
                         bool expressionValue = eval.eval(context);
                         
                         if (expressionValue)
                         {
-                            results += searchAndReplace(internalData, context);
+                            searchAndReplace(internalData, context, results);
                         }
                         
                         lexer.index += endTokenLoc;
@@ -363,7 +379,7 @@ namespace cs
                             
                             if (!expressionValue)
                             {
-                                results += searchAndReplace(nextInternalData, context);
+                                searchAndReplace(nextInternalData, context, results);
                             }
                             lexer.index += nextEndLoc;
                         }
@@ -373,9 +389,15 @@ namespace cs
                         blt_throw(LexerSyntaxError("Ending token not found!"));
                         
                     } else
-                        results += lexer.consume();
+                    {
+                        // copy everything up to the next possible tag at once
+                        auto next = lexer.str.find('{', lexer.index + 1);
+                        if (next == std::string_view::npos)
+                            next = lexer.str.size();
+                        results.append(lexer.str.substr(lexer.index, next - lexer.index));
+                        lexer.index = next;
+                    }
                 }
-                return results;
             }
         
     };
@@ -386,15 +408,16 @@ namespace cs
         return (double) (v) / 1000000000.0;
     }
     
-    CacheEngine::CacheEngine(context& ctx, const CacheSettings& settings): m_Context(ctx),
-                                                                           m_Settings((settings))
+    CacheEngine::CacheEngine(context& ctx, StaticCache& staticCache, const CacheSettings& settings): m_Context(ctx),
+                                                                                                     m_StaticCache(staticCache),
+                                                                                                     m_Settings((settings))
     {}
     
     uint64_t CacheEngine::calculateMemoryUsage(const std::string& path, const CacheEngine::CacheValue& value)
     {
         uint64_t pageContentSize = path.size() * sizeof(char);
         pageContentSize += value.page->getRawSite().size() * sizeof(char);
-        pageContentSize += value.renderedPage.size() * sizeof(char);
+        pageContentSize += value.renderedPage->size() * sizeof(char);
         return pageContentSize;
     }
     
@@ -409,7 +432,13 @@ namespace cs
         return pagesBaseSize + pageContentSizes;
     }
     
-    const std::string& CacheEngine::fetch(const std::string& path)
+    std::shared_ptr<const std::string> CacheEngine::fetch(const std::string& path)
+    {
+        std::scoped_lock lock(m_PagesMutex);
+        return fetchPage(path);
+    }
+    
+    std::shared_ptr<const std::string> CacheEngine::fetchPage(const std::string& path)
     {
         bool load = false;
         auto find = m_Pages.find(path);
@@ -417,15 +446,8 @@ namespace cs
         {
             BLT_DEBUG("Page '%s' was not found in cache, loading now!", path.c_str());
             load = true;
-        } else
-        {
-            auto lastWrite = std::filesystem::last_write_time(cs::fs::createWebFilePath(path));
-            if (lastWrite != m_Pages[path].lastModified)
-            {
-                load = true;
-                BLT_DEBUG("Page '%s' has been modified! Reloading now!", path.c_str());
-            }
-        }
+        } else if (isOutdated(path, find->second))
+            load = true;
         
         if (load)
         {
@@ -455,19 +477,40 @@ namespace cs
         return m_Pages[path].renderedPage;
     }
     
+    bool CacheEngine::isOutdated(const std::string& path, const CacheEngine::CacheValue& value)
+    {
+        auto lastWrite = std::filesystem::last_write_time(cs::fs::createWebFilePath(path));
+        if (lastWrite != value.lastModified)
+        {
+            BLT_DEBUG("Page '%s' has been modified! Reloading now!", path.c_str());
+            return true;
+        }
+        for (const auto& reference : value.staticReferences)
+        {
+            if (m_StaticCache.fingerprint(reference.path) != reference.fingerprint)
+            {
+                BLT_DEBUG("Static file '%s' linked by page '%s' has changed! Reloading now!", reference.path.c_str(), path.c_str());
+                return true;
+            }
+        }
+        return false;
+    }
+    
     void CacheEngine::loadPage(const std::string& path)
     {
         auto start = blt::system::getCurrentTimeNanoseconds();
         
         auto fullPath = cs::fs::createWebFilePath(path);
         auto page = HTMLPage::load(fullPath);
-        resolveLinks(path, *page);
-        const auto& renderedPage = page->getRawSite();
+        std::vector<StaticReference> staticReferences;
+        resolveLinks(path, *page, staticReferences);
+        auto renderedPage = std::make_shared<const std::string>(page->getRawSite());
         m_Pages[path] = CacheValue{
                 blt::system::getCurrentTimeNanoseconds(),
                 std::filesystem::last_write_time(fullPath),
                 std::move(page),
-                renderedPage
+                std::move(renderedPage),
+                std::move(staticReferences)
         };
         
         auto end = blt::system::getCurrentTimeNanoseconds();
@@ -508,7 +551,50 @@ namespace cs
         BLT_INFO("Pruned %d pages", prunedPages);
     }
     
-    void CacheEngine::resolveLinks(const std::string& file, HTMLPage& page)
+    void CacheEngine::fingerprintStaticLinks(std::string& site, std::vector<StaticReference>& staticReferences)
+    {
+        static const std::string prefix = "/static/";
+        
+        std::string result;
+        size_t last = 0;
+        size_t pos;
+        while ((pos = site.find(prefix, last)) != std::string::npos)
+        {
+            auto start = pos + prefix.size();
+            auto end = site.find_first_of("\"'() \t\r\n<>?#", start);
+            if (end == std::string::npos)
+                end = site.size();
+            result.append(site, last, start - last);
+            last = start;
+            
+            // only links which start at /static/, not urls on other hosts which happen to contain it
+            if (pos > 0 && std::string("\"'(= \t\r\n").find(site[pos - 1]) == std::string::npos)
+                continue;
+            
+            auto path = site.substr(start, end - start);
+            // links coming from already resolved parts are fingerprinted, they need to be recorded against this page as well
+            std::string base, hash;
+            if (StaticCache::splitFingerprint(path, base, hash) && !m_StaticCache.fingerprint(base).empty())
+                path = base;
+            if (path.empty() || path.find("..") != std::string::npos)
+                continue;
+            
+            auto fingerprinted = m_StaticCache.fingerprintedPath(path);
+            if (fingerprinted.empty())
+            {
+                BLT_WARN("Page links to static file '%s' which does not exist!", path.c_str());
+                continue;
+            }
+            
+            staticReferences.push_back({path, m_StaticCache.fingerprint(path)});
+            result += fingerprinted;
+            last = end;
+        }
+        result.append(site, last, std::string::npos);
+        site = std::move(result);
+    }
+    
+    void CacheEngine::resolveLinks(const std::string& file, HTMLPage& page, std::vector<StaticReference>& staticReferences)
     {
         CacheLexer lexer(page.getRawSite());
         std::string resolvedSite;
@@ -524,7 +610,7 @@ namespace cs
             if (lexer.hasTemplatePrefix())
             {
                 auto prefix = lexer.peekPrefix();
-                auto token = lexer.consumeToken();
+                std::string token(lexer.consumeToken());
                 
                 switch (prefix)
                 {
@@ -540,24 +626,22 @@ namespace cs
                         {
                             if (token.ends_with(suffix))
                             {
-                                resolvedSite += fetch(token);
+                                resolvedSite += *fetchPage(token);
                                 break;
                             }
                         }
                         break;
                     case '$':
-                        if (std::find_if(
-                                m_Context.begin(), m_Context.end(),
-                                [&token](auto in) -> bool {
-                                    return token == in.first;
-                                }
-                        ) == m_Context.end())
+                    {
+                        auto value = m_Context.find(std::string_view(token));
+                        if (value == m_Context.end())
                         {
                             // unable to find the token, we should throw an error to tell the user! (or admin in this case)
                             BLT_WARN("Unable to find token '%s'!", token.c_str());
                         } else
-                            resolvedSite += m_Context[token];
+                            resolvedSite += std::string_view(value->second);
                         break;
+                    }
                     default:
                         break;
                 }
@@ -565,13 +649,18 @@ namespace cs
                 resolvedSite += lexer.consume();
         }
         
+        fingerprintStaticLinks(resolvedSite, staticReferences);
         page.getRawSite() = resolvedSite;
     }
     
     std::string CacheEngine::fetch(const std::string& path, const context& context)
     {
-        auto fetched = fetch(path);
-        return RuntimeLexer::searchAndReplace(fetched, context);
+        // keeps this version of the page alive if another request reloads it meanwhile
+        auto page = fetch(path);
+        std::string results;
+        results.reserve(page->size());
+        RuntimeLexer::searchAndReplace(*page, context, results);
+        return results;
     }
     
     
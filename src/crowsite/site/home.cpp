@@ -25,21 +25,19 @@ namespace cs
         if (params.name.ends_with(".html"))
         {
             checkAndUpdateUserSession(params.app, params.req);
-            auto& session = params.app.get_context<Session>(params.req);
-            auto s_clientID = session.get("clientID", "");
-            auto s_clientToken = session.get("clientToken", "");
-            auto user_perms = cs::getUserPermissions(cs::getUserFromID(s_clientID));
             
             crow::mustache::context ctx;
-            cs::context context;
+            // released with the request, like the page built from it
+            cs::context context(params.req.arena);
             
+            // the runtime context already holds the validated login state, reuse it instead of querying again
             generateRuntimeContext(params, context);
             
             // pass perms in
-            if (user_perms & cs::PERM_ADMIN)
+            if (context.contains("_admin"))
                 ctx["_admin"] = true;
             
-            if (cs::isUserLoggedIn(s_clientID, s_clientToken))
+            if (context.contains("_logged_in"))
             {
                 ctx["_logged_in"] = true;
             } else
@@ -51,11 +49,11 @@ namespace cs
             auto referer = params.req.url_params.get("referer");
             if (referer)
                 ctx["referer"] = referer;
-            auto page = crow::mustache::compile(params.engine.fetch(params.name, context));
+            crow::mustache::template_t page(params.engine.fetch(params.name, context));
             return page.render(ctx);
         }
         
-        return params.engine.fetch("default.html");
+        return *params.engine.fetch("default.html");
     }
     
     crow::response handle_auth_page(const site_params& params)
@@ -67,28 +65,31 @@ namespace cs
         return handle_root_page(params);
     }
     
-    crow::response handle_login_request(const crow::request& req, CrowApp& app)
+    crow::task<crow::response> handle_login_request(const crow::request& req, CrowApp& app)
     {
         cs::parser::Post pp(req.body);
         auto& session = app.get_context<Session>(req);
         
-        std::string user_agent;
-        
-        for (const auto& h : req.headers)
-            if (h.first == "User-Agent")
-            {
-                user_agent = h.second;
-                break;
-            }
+        const std::string& user_agent = req.get_header_value("User-Agent");
         
         // either cs::redirect to clear the form if failed or pass user to index
-        if (cs::checkUserAuthorization(pp))
+        if (co_await cs::checkUserAuthorizationAsync(*req.io_service, pp))
         {
             cs::cookie_data data = cs::createUserAuthTokens(pp, user_agent);
-            if (!cs::storeUserData(pp["username"], user_agent, data))
+            // sqlite has no async interface, keep it off the io threads
+            bool stored = co_await crow::blocking(app, req, [&]() {
+                if (!cs::storeUserData(pp["username"], user_agent, data))
+                    return false;
+#ifdef CROWSITE_SIGNED_TOKENS
+                if (auto token = cs::createSignedUserToken(data.clientID, pp["username"], data.clientToken); !token.empty())
+                    data.clientToken = token;
+#endif
+                return true;
+            });
+            if (!stored)
             {
                 BLT_ERROR("Failed to update user data");
-                return cs::redirect("login.html");
+                co_return cs::redirect("login.html");
             }
             
             session.set("clientID", data.clientID);
@@ -99,8 +100,8 @@ namespace cs
                 cookie_context.set_cookie("clientID", data.clientID).path("/").max_age(cookie_age);
                 cookie_context.set_cookie("clientToken", data.clientToken).path("/").max_age(cookie_age);
             }
-            return cs::redirect(pp.hasKey("referer") ? pp["referer"] : "/");
+            co_return cs::redirect(pp.hasKey("referer") ? pp["referer"] : "/");
         } else
-            return cs::redirect("login.html");
+            co_return cs::redirect("login.html");
     }
 }
\ No newline at end of file
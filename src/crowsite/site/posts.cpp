@@ -17,13 +17,13 @@ namespace cs
     
     response_info handleProjectPage(const request_info& req)
     {
-        if (req.url_params.contains("post"))
+        if (auto postID = req.url_params.get("post"))
         {
-            BLT_TRACE(req.url_params.at("post"));
-            sql::statement posts(posts_database, "SELECT file FROM posts WHERE postID=?;");
-            posts.set(req.url_params.at("post"), 0);
-            posts.execute();
-            return {loadMarkdownAsHTML(cs::fs::createDataFilePath(posts.get<std::string>(2)))};
+            BLT_TRACE(postID);
+            sql::query<std::string_view> posts(posts_database, "SELECT file FROM posts WHERE postID=?;");
+            posts.bind(0, std::string_view(postID));
+            if (auto post = posts.first())
+                return {loadMarkdownAsHTML(cs::fs::createDataFilePath(std::string(std::get<0>(*post))))};
         }
         
         return {""};
@@ -34,26 +34,29 @@ namespace cs
         
         posts_database = new sql::database(cs::fs::createDataFilePath("db/posts.sqlite"));
         
-        sql::auto_statement(
-                posts_database,
-                "CREATE TABLE IF NOT EXISTS posts(postID INTEGER PRIMARY KEY AUTOINCREMENT, date TEXT, title TEXT, file TEXT);"
-        );
-        
-        sql::auto_statement(
-                posts_database,
-                "CREATE TABLE IF NOT EXISTS modifications(postID INTEGER, date TEXT, FOREIGN KEY(postID) REFERENCES posts(postID));"
-        );
+        std::vector<sql::migration> migrations;
         
-        sql::auto_statement(
-                posts_database,
-                "CREATE TABLE IF NOT EXISTS tags(postID INTEGER, tag TEXT, FOREIGN KEY(postID) REFERENCES posts(postID));"
+        migrations.push_back(
+                {1, "initial schema", {
+                        "CREATE TABLE IF NOT EXISTS posts(postID INTEGER PRIMARY KEY AUTOINCREMENT, date TEXT, title TEXT, file TEXT);",
+                        "CREATE TABLE IF NOT EXISTS modifications(postID INTEGER, date TEXT, FOREIGN KEY(postID) REFERENCES posts(postID));",
+                        "CREATE TABLE IF NOT EXISTS tags(postID INTEGER, tag TEXT, FOREIGN KEY(postID) REFERENCES posts(postID));",
+                        "CREATE TABLE IF NOT EXISTS types(postID INTEGER, type INTEGER, FOREIGN KEY(postID) REFERENCES posts(postID));"
+                }}
         );
         
-        sql::auto_statement(
-                posts_database,
-                "CREATE TABLE IF NOT EXISTS types(postID INTEGER, type INTEGER, FOREIGN KEY(postID) REFERENCES posts(postID));"
+        // posts are looked up by tag and the tags / types / modifications of a post by postID.
+        // each index carries the other column so these lookups never have to touch the tables
+        migrations.push_back(
+                {2, "covering indexes", {
+                        "CREATE INDEX IF NOT EXISTS tags_by_tag ON tags(tag, postID);",
+                        "CREATE INDEX IF NOT EXISTS tags_by_post ON tags(postID, tag);",
+                        "CREATE INDEX IF NOT EXISTS types_by_post ON types(postID, type);",
+                        "CREATE INDEX IF NOT EXISTS modifications_by_post ON modifications(postID, date);"
+                }}
         );
         
+        sql::migrate(posts_database, "posts", std::move(migrations));
     }
     
     void posts_cleanup()
@@ -12,9 +12,12 @@
 
 namespace cs
 {
+    // routes marked blocking wait on SQLite, Jellyfin or the markdown renderer, so they run on Crow's blocking workers
+    // instead of holding up the IO threads serving static and cached pages
+    
     inline void createLoginRoutes(CrowApp& app, CacheEngine& engine)
     {
-        CROW_ROUTE(app, "/login.html")(
+        CROW_ROUTE(app, "/login.html").blocking()(
                 [&app, &engine](const crow::request& req) -> crow::response {
                     if (cs::isUserLoggedIn(app, req))
                         return cs::redirect("/");
@@ -22,7 +25,7 @@ namespace cs
                 }
         );
         
-        CROW_ROUTE(app, "/logout.html")(
+        CROW_ROUTE(app, "/logout.html").blocking()(
                 [&app](const crow::request& req) -> crow::response {
                     cs::destroyUserSession(app, req);
                     return cs::redirect("/");
@@ -36,26 +39,35 @@ namespace cs
         );
     }
     
-    void establishHomeRoutes(CrowApp& app, CacheEngine& engine)
+    void establishStaticRoutes(CrowApp& app, StaticCache& cache)
     {
         CROW_ROUTE(app, "/favicon.ico")(
-                [](crow::response& local_fav_res) {
-                    local_fav_res.compressed = false;
-                    local_fav_res.set_static_file_info_unsafe(cs::fs::createStaticFilePath("images/favicon.ico"));
-                    local_fav_res.set_header("content-type", "image/x-icon");
-                    local_fav_res.end();
+                [&cache](const crow::request& req, crow::response& res) {
+                    cache.serve(req, res, "images/favicon.ico");
+                    res.end();
                 }
         );
         
+        CROW_ROUTE(app, CROWSITE_STATIC_ENDPOINT)(
+                [&cache](const crow::request& req, crow::response& res, std::string path) {
+                    crow::utility::sanitize_filename(path);
+                    cache.serve(req, res, path);
+                    res.end();
+                }
+        );
+    }
+    
+    void establishHomeRoutes(CrowApp& app, CacheEngine& engine)
+    {
         createLoginRoutes(app, engine);
         
-        CROW_ROUTE(app, "/<string>")(
+        CROW_ROUTE(app, "/<string>").blocking()(
                 [&app, &engine](const crow::request& req, const std::string& name) -> crow::response {
                     return cs::handle_root_page({app, engine, req, name});
                 }
         );
         
-        CROW_ROUTE(app, "/")(
+        CROW_ROUTE(app, "/").blocking()(
                 [&engine, &app](const crow::request& req) {
                     return cs::handle_root_page({app, engine, req, "index.html"});
                 }
@@ -0,0 +1,486 @@
+/*
+ * Created by Brett on 19/10/26.
+ * Licensed under GNU General Public License V3.0
+ * See LICENSE file for license detail
+ */
+#include <crowsite/site/static_cache.h>
+#include <blt/std/logging.h>
+#include <blt/std/time.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <vector>
+#include <mutex>
+
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <climits>
+#endif
+
+namespace cs
+{
+
+    static bool isCompressible(const std::string& mime)
+    {
+        // images, archives and most fonts are already compressed, trying again only wastes time and memory
+        return mime.starts_with("text/") || mime.ends_with("javascript") || mime.ends_with("json") || mime.ends_with("xml")
+               || mime == "image/svg+xml" || mime == "image/x-icon" || mime == "image/bmp" || mime == "application/wasm"
+               || mime == "font/ttf" || mime == "font/otf";
+    }
+
+    static std::string keepIfSmaller(std::string compressed, const std::string& original)
+    {
+        // a variant which saves less than a tenth isn't worth the memory or a Vary response
+        if (compressed.empty() || compressed.size() > original.size() - original.size() / 10)
+            return "";
+        return compressed;
+    }
+
+    /**
+     * @return true if the Accept-Encoding header lists the coding without disabling it through q=0
+     */
+    static bool acceptsEncoding(const std::string& header, std::string_view coding)
+    {
+        std::string_view view = header;
+        while (!view.empty())
+        {
+            auto end = view.find(',');
+            auto item = view.substr(0, end);
+            view = end == std::string_view::npos ? std::string_view{} : view.substr(end + 1);
+
+            auto params = item.find(';');
+            auto name = item.substr(0, params);
+            while (!name.empty() && name.front() == ' ')
+                name.remove_prefix(1);
+            while (!name.empty() && name.back() == ' ')
+                name.remove_suffix(1);
+            if (name != coding)
+                continue;
+
+            if (params == std::string_view::npos)
+                return true;
+            auto q = item.find("q=", params);
+            if (q == std::string_view::npos)
+                return true;
+            return std::strtod(std::string(item.substr(q + 2)).c_str(), nullptr) > 0;
+        }
+        return false;
+    }
+
+    // FNV-1a, the tags and fingerprints only have to change with the content
+    static constexpr uint64_t hashSeed = 14695981039346656037ull;
+
+    static uint64_t hashContent(uint64_t hash, const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string toHex(uint64_t hash)
+    {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+        return buffer;
+    }
+
+    static bool isFingerprint(std::string_view str)
+    {
+        return str.size() == StaticCache::fingerprintLength && std::all_of(str.begin(), str.end(), [](char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+        });
+    }
+
+    std::string StaticCache::createETag(const std::string& content)
+    {
+        return '"' + toHex(hashContent(hashSeed, content.data(), content.size())) + '"';
+    }
+
+    StaticCache::StaticCache(std::string root, const StaticCacheSettings& settings): m_Root(std::move(root)), m_Settings(settings)
+    {
+        std::replace(m_Root.begin(), m_Root.end(), '\\', '/');
+        if (!m_Root.ends_with('/'))
+            m_Root += '/';
+        startWatching();
+    }
+
+    StaticCache::~StaticCache()
+    {
+        m_Watching = false;
+        if (m_Watcher.joinable())
+            m_Watcher.join();
+#ifdef __linux__
+        if (m_WatchFD >= 0)
+            ::close(m_WatchFD);
+#endif
+    }
+
+    std::shared_ptr<const StaticAsset> StaticCache::fetch(const std::string& path)
+    {
+        {
+            std::shared_lock lock(m_Mutex);
+            auto find = m_Assets.find(path);
+            if (find != m_Assets.end())
+            {
+                bool valid = true;
+                if (!m_Watching)
+                {
+                    std::error_code error;
+                    valid = std::filesystem::last_write_time(m_Root + path, error) == find->second.asset->lastModified && !error;
+                }
+                if (valid)
+                {
+                    find->second.lastAccess = ++m_Clock;
+                    return find->second.asset;
+                }
+            }
+        }
+
+        // anything invalidated while we were loading may have been read half written, so it must not be inserted
+        auto generation = m_Generation.load();
+        auto asset = load(path);
+        if (asset)
+            insert(path, asset, generation);
+        else if (!m_Watching)
+            invalidate(path);
+        return asset;
+    }
+
+    std::shared_ptr<const StaticAsset> StaticCache::load(const std::string& path)
+    {
+        auto fullPath = m_Root + path;
+
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(fullPath, error))
+            return nullptr;
+        auto lastModified = std::filesystem::last_write_time(fullPath, error);
+        auto size = std::filesystem::file_size(fullPath, error);
+        if (error || size > m_Settings.maxFileSize)
+            return nullptr;
+
+        auto start = blt::system::getCurrentTimeNanoseconds();
+
+        std::ifstream file(fullPath, std::ios::binary);
+        if (!file)
+            return nullptr;
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+
+        auto asset = std::make_shared<StaticAsset>();
+        asset->body = buffer.str();
+        asset->lastModified = lastModified;
+        asset->etag = createETag(asset->body);
+
+        auto last_dot = path.find_last_of('.');
+        asset->mime = last_dot == std::string::npos ? "application/octet-stream" : crow::response::get_mime_type(path.substr(last_dot + 1));
+
+        if (isCompressible(asset->mime))
+        {
+            // compressed once and served many times, so spend the time on the best ratio
+            asset->gzip = keepIfSmaller(crow::compression::compress_string(asset->body, crow::compression::GZIP, Z_BEST_COMPRESSION), asset->body);
+#ifdef CROW_ENABLE_BROTLI
+            asset->brotli = keepIfSmaller(crow::compression::compress_brotli(asset->body, BROTLI_MAX_QUALITY), asset->body);
+#endif
+        }
+
+        // every response for the asset is one of these, so their headers are serialized up front
+        for (auto encoding : {StaticAsset::IDENTITY, StaticAsset::GZIP, StaticAsset::BROTLI})
+        {
+            for (int immutable = 0; immutable < 2; immutable++)
+            {
+                crow::ci_map headers;
+                headers.emplace("Content-Type", asset->mime);
+                headers.emplace("ETag", asset->etag);
+                if (!asset->gzip.empty() || !asset->brotli.empty())
+                    headers.emplace("Vary", "Accept-Encoding");
+                if (encoding == StaticAsset::GZIP)
+                    headers.emplace("Content-Encoding", "gzip");
+                else if (encoding == StaticAsset::BROTLI)
+                    headers.emplace("Content-Encoding", "br");
+                if (immutable)
+                    headers.emplace("Cache-Control", immutableCacheControl);
+                asset->headers[encoding][immutable] = std::make_shared<const crow::serialized_headers>(headers);
+            }
+        }
+
+        auto end = blt::system::getCurrentTimeNanoseconds();
+        BLT_DEBUG("Cached static file '%s' (%d bytes, gzip %d, brotli %d) in %fms", path.c_str(), asset->body.size(), asset->gzip.size(),
+                  asset->brotli.size(), (end - start) / 1000000.0);
+        return asset;
+    }
+
+    std::string StaticCache::fingerprint(const std::string& path)
+    {
+        {
+            std::shared_lock lock(m_Mutex);
+            auto find = m_Fingerprints.find(path);
+            if (find != m_Fingerprints.end())
+            {
+                std::error_code error;
+                if (m_Watching || std::filesystem::last_write_time(m_Root + path, error) == find->second.lastModified)
+                    return find->second.hash;
+            }
+        }
+
+        auto generation = m_Generation.load();
+        auto fullPath = m_Root + path;
+        std::error_code error;
+        auto lastModified = std::filesystem::last_write_time(fullPath, error);
+        std::ifstream file(fullPath, std::ios::binary);
+        if (error || !file || !std::filesystem::is_regular_file(fullPath, error))
+            return "";
+
+        // files too large for the cache are still referenced by pages, so hash in chunks rather than loading them whole
+        uint64_t hash = hashSeed;
+        char buffer[64 * 1024];
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+            hash = hashContent(hash, buffer, static_cast<size_t>(file.gcount()));
+        auto result = toHex(hash).substr(0, fingerprintLength);
+
+        std::unique_lock lock(m_Mutex);
+        if (generation == m_Generation)
+            m_Fingerprints[path] = Fingerprint{result, lastModified};
+        return result;
+    }
+
+    std::string StaticCache::fingerprintedPath(const std::string& path)
+    {
+        auto hash = fingerprint(path);
+        if (hash.empty())
+            return "";
+        auto last_dot = path.find_last_of('.');
+        auto last_slash = path.find_last_of('/');
+        if (last_dot == std::string::npos || (last_slash != std::string::npos && last_dot < last_slash))
+            return path + '.' + hash;
+        return path.substr(0, last_dot) + '.' + hash + path.substr(last_dot);
+    }
+
+    bool StaticCache::splitFingerprint(const std::string& path, std::string& base, std::string& hash)
+    {
+        auto last_slash = path.find_last_of('/');
+        auto name_start = last_slash == std::string::npos ? 0 : last_slash + 1;
+        auto last_dot = path.find_last_of('.');
+        if (last_dot == std::string::npos || last_dot < name_start)
+            return false;
+
+        // name.hash.ext
+        auto hash_dot = last_dot == name_start ? std::string::npos : path.find_last_of('.', last_dot - 1);
+        if (hash_dot != std::string::npos && hash_dot >= name_start &&
+            isFingerprint(std::string_view(path).substr(hash_dot + 1, last_dot - hash_dot - 1)))
+        {
+            hash = path.substr(hash_dot + 1, last_dot - hash_dot - 1);
+            base = path.substr(0, hash_dot) + path.substr(last_dot);
+            return true;
+        }
+
+        // name.hash, for files without an extension
+        if (isFingerprint(std::string_view(path).substr(last_dot + 1)))
+        {
+            hash = path.substr(last_dot + 1);
+            base = path.substr(0, last_dot);
+            return true;
+        }
+        return false;
+    }
+
+    void StaticCache::insert(const std::string& path, const std::shared_ptr<const StaticAsset>& asset, uint64_t generation)
+    {
+        auto memory = asset->memoryUsage() + path.size();
+        if (memory > m_Settings.maxMemory)
+            return;
+
+        std::unique_lock lock(m_Mutex);
+        if (generation != m_Generation)
+            return;
+        auto find = m_Assets.find(path);
+        if (find != m_Assets.end())
+        {
+            m_Memory -= find->second.memory;
+            m_Assets.erase(find);
+        }
+        prune(memory);
+
+        auto& value = m_Assets[path];
+        value.asset = asset;
+        value.memory = memory;
+        value.lastAccess = ++m_Clock;
+        m_Memory += memory;
+    }
+
+    void StaticCache::prune(uint64_t required)
+    {
+        while (!m_Assets.empty() && m_Memory + required > m_Settings.maxMemory)
+        {
+            auto oldest = m_Assets.begin();
+            for (auto it = m_Assets.begin(); it != m_Assets.end(); ++it)
+            {
+                if (it->second.lastAccess < oldest->second.lastAccess)
+                    oldest = it;
+            }
+            BLT_TRACE("Evicting static file '%s' (%d bytes)", oldest->first.c_str(), oldest->second.memory);
+            m_Memory -= oldest->second.memory;
+            m_Assets.erase(oldest);
+        }
+    }
+
+    void StaticCache::invalidate(const std::string& path)
+    {
+        std::unique_lock lock(m_Mutex);
+        ++m_Generation;
+        auto folder = path.empty() || path.ends_with('/') ? path : path + '/';
+        for (auto it = m_Assets.begin(); it != m_Assets.end();)
+        {
+            if (it->first == path || it->first.starts_with(folder))
+            {
+                m_Memory -= it->second.memory;
+                it = m_Assets.erase(it);
+            } else
+                ++it;
+        }
+        std::erase_if(m_Fingerprints, [&](const auto& fingerprint) {
+            return fingerprint.first == path || fingerprint.first.starts_with(folder);
+        });
+    }
+
+    void StaticCache::serve(const crow::request& req, crow::response& res, const std::string& requestedPath)
+    {
+        std::string path = requestedPath;
+        std::string base, hash;
+        bool immutable = false;
+        // an outdated fingerprint still gets the current file, just without the promise that it never changes
+        if (splitFingerprint(requestedPath, base, hash))
+        {
+            auto current = fingerprint(base);
+            if (!current.empty())
+            {
+                path = base;
+                immutable = current == hash;
+            }
+        }
+
+        auto asset = fetch(path);
+        if (!asset)
+        {
+            res.set_static_file_info_unsafe(m_Root + path);
+            if (immutable && res.code == 200)
+                res.set_header("Cache-Control", immutableCacheControl);
+            return;
+        }
+
+        res.compressed = false;
+        res.code = 200;
+
+        auto& match = req.get_header_value("If-None-Match");
+        if (!match.empty() && (match == "*" || match.find(asset->etag) != std::string::npos))
+        {
+            res.code = 304;
+            res.header_block = asset->headers[StaticAsset::IDENTITY][immutable];
+            return;
+        }
+
+        auto& encoding = req.get_header_value("Accept-Encoding");
+        auto variant = StaticAsset::IDENTITY;
+        if (!asset->brotli.empty() && acceptsEncoding(encoding, "br"))
+            variant = StaticAsset::BROTLI;
+        else if (!asset->gzip.empty() && acceptsEncoding(encoding, "gzip"))
+            variant = StaticAsset::GZIP;
+        res.header_block = asset->headers[variant][immutable];
+        // points into the cached asset and keeps it alive until written, a hit copies nothing
+        res.shared_body = std::shared_ptr<const std::string>(asset, &asset->variant(variant));
+    }
+
+    void StaticCache::startWatching()
+    {
+#ifdef __linux__
+        m_WatchFD = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_WatchFD < 0)
+        {
+            BLT_WARN("Unable to watch static directory '%s', cached files will be checked on every request", m_Root.c_str());
+            return;
+        }
+        watchFolder("");
+        m_Watching = true;
+        m_Watcher = std::thread([this]() { watch(); });
+#else
+        BLT_INFO("File watching is unavailable, cached static files will be checked on every request");
+#endif
+    }
+
+    void StaticCache::watchFolder(const std::string& relativePath)
+    {
+#ifdef __linux__
+        constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF;
+        auto wd = ::inotify_add_watch(m_WatchFD, (m_Root + relativePath).c_str(), mask);
+        if (wd < 0)
+        {
+            BLT_WARN("Unable to watch static folder '%s'", (m_Root + relativePath).c_str());
+            return;
+        }
+        m_WatchedFolders[wd] = relativePath;
+
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(m_Root + relativePath, error))
+        {
+            if (entry.is_directory(error))
+                watchFolder(relativePath + entry.path().filename().string() + '/');
+        }
+#else
+        (void) relativePath;
+#endif
+    }
+
+    void StaticCache::watch()
+    {
+#ifdef __linux__
+        alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+        pollfd pfd{m_WatchFD, POLLIN, 0};
+        while (m_Watching)
+        {
+            // wake up regularly so the destructor never waits long on shutdown
+            if (::poll(&pfd, 1, 250) <= 0)
+                continue;
+
+            ssize_t length;
+            while ((length = ::read(m_WatchFD, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* ptr = buffer; ptr < buffer + length;)
+                {
+                    auto* event = reinterpret_cast<inotify_event*>(ptr);
+                    ptr += sizeof(inotify_event) + event->len;
+
+                    if (event->mask & IN_Q_OVERFLOW)
+                    {
+                        BLT_WARN("Static file watcher overflowed, dropping the entire static cache");
+                        invalidate("");
+                        continue;
+                    }
+
+                    auto folder = m_WatchedFolders.find(event->wd);
+                    if (folder == m_WatchedFolders.end())
+                        continue;
+
+                    if (event->mask & IN_IGNORED)
+                    {
+                        m_WatchedFolders.erase(folder);
+                        continue;
+                    }
+
+                    auto path = folder->second + (event->len ? std::string(event->name) : std::string());
+                    invalidate(path);
+
+                    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                        watchFolder(path + '/');
+                }
+            }
+        }
+#endif
+    }
+
+}
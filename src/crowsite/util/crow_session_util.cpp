@@ -14,8 +14,11 @@ namespace cs
         auto& session = app.get_context<Session>(req);
         auto& cookie_context = app.get_context<crow::CookieParser>(req);
         
-        session.set("clientID", "");
-        session.set("clientToken", "");
+        cs::revokeUserSession(session.get("clientID", ""));
+        
+        // removing rather than blanking the values lets the session middleware drop the session entirely
+        session.remove("clientID");
+        session.remove("clientToken");
         cookie_context.set_cookie("clientID", "");
         cookie_context.set_cookie("clientToken", "");
     }
@@ -40,12 +43,30 @@ namespace cs
         return false;
     }
     
+    /**
+     * Replaces an expired signed token in the session, and in the cookie if the login is remembered.
+     * Otherwise the cookie would put the expired token back into the session on the next request.
+     */
+    static void storeRefreshedToken(CrowApp& app, const crow::request& req, const std::string& token)
+    {
+        auto& session = app.get_context<Session>(req);
+        auto& cookie_context = app.get_context<crow::CookieParser>(req);
+        session.set("clientToken", token);
+        if (!cookie_context.get_cookie("clientToken").empty())
+            cookie_context.set_cookie("clientToken", token).path("/").max_age(cookie_age);
+    }
+    
     bool isUserLoggedIn(CrowApp& app, const crow::request& req)
     {
         auto& session = app.get_context<Session>(req);
         auto s_clientID = session.get("clientID", "");
         auto s_clientToken = session.get("clientToken", "");
-        return cs::isUserLoggedIn(s_clientID, s_clientToken);
+        std::string refreshed;
+        if (!cs::isUserLoggedIn(s_clientID, s_clientToken, &refreshed))
+            return false;
+        if (!refreshed.empty())
+            storeRefreshedToken(app, req, refreshed);
+        return true;
     }
     
     bool isUserAdmin(CrowApp& app, const crow::request& req)
@@ -60,29 +81,56 @@ namespace cs
         auto& session = params.app.get_context<Session>(params.req);
         auto s_clientID = session.get("clientID", "");
         auto s_clientToken = session.get("clientToken", "");
-        if (cs::isUserLoggedIn(s_clientID, s_clientToken))
+        
+        std::string username;
+        uint32_t perms;
+        std::string refreshed;
+        // signed tokens carry the username and permissions, so the database is only needed for plain tokens
+        if (auto data = cs::getSignedUserData(s_clientID, s_clientToken))
         {
-            auto username = cs::getUserFromID(s_clientID);
-            auto perms = cs::getUserPermissions(username);
-            auto isAdmin = cs::isUserAdmin(username);
-            context["_logged_in"] = "True";
-            context["_username"] = username;
-            if (isAdmin)
-                context["_admin"] = "True";
-            if (perms & cs::PERM_READ_FILES)
-                context["_read_files"] = "True";
-            if (perms & cs::PERM_WRITE_FILES)
-                context["_write_files"] = "True";
-            if (perms & cs::PERM_CREATE_POSTS)
-                context["_create_posts"] = "True";
-            if (perms & cs::PERM_CREATE_COMMENTS)
-                context["_create_comments"] = "True";
-            if (perms & cs::PERM_CREATE_SHARES)
-                context["_create_shares"] = "True";
-            if (perms & cs::PERM_EDIT_POSTS)
-                context["_edit_posts"] = "True";
-            if (perms & cs::PERM_EDIT_COMMENTS)
-                context["_edit_comments"] = "True";
-        }
+            username = data->username;
+            perms = data->perms;
+        } else if (cs::isUserLoggedIn(s_clientID, s_clientToken, &refreshed))
+        {
+            // an expired signed token comes back renewed, which also carries what would be looked up
+            auto renewed = refreshed.empty() ? std::nullopt : cs::verifySignedUserToken(refreshed);
+            if (renewed)
+            {
+                storeRefreshedToken(params.app, params.req, refreshed);
+                username = renewed->username;
+                perms = renewed->perms;
+            } else
+            {
+                username = cs::getUserFromID(s_clientID);
+                perms = cs::getUserPermissions(username);
+            }
+        } else
+            return;
+        
+        // keys built with the context's allocator, operator[] would build them on the heap
+        crow::arena_allocator<char> allocator(context.get_allocator());
+        auto set = [&](std::string_view key, std::string_view value) {
+            context.insert_or_assign(cs::arena_string(key, allocator), cs::arena_string(value, allocator));
+        };
+        
+        auto isAdmin = perms & cs::PERM_ADMIN;
+        set("_logged_in", "True");
+        set("_username", username);
+        if (isAdmin)
+            set("_admin", "True");
+        if (perms & cs::PERM_READ_FILES)
+            set("_read_files", "True");
+        if (perms & cs::PERM_WRITE_FILES)
+            set("_write_files", "True");
+        if (perms & cs::PERM_CREATE_POSTS)
+            set("_create_posts", "True");
+        if (perms & cs::PERM_CREATE_COMMENTS)
+            set("_create_comments", "True");
+        if (perms & cs::PERM_CREATE_SHARES)
+            set("_create_shares", "True");
+        if (perms & cs::PERM_EDIT_POSTS)
+            set("_edit_posts", "True");
+        if (perms & cs::PERM_EDIT_COMMENTS)
+            set("_edit_comments", "True");
     }
 }
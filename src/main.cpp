@@ -43,8 +43,14 @@ int main(int argc, const char** argv)
             // set session id length (small value only for demonstration purposes)
             16,
             // init the store
-            crow::FileStore{std::string(CROWSITE_FILES_PATH) + "/data/session", cs::session_age}}};
-    app.use_compression(crow::compression::GZIP);
+            crow::LogStore{std::string(CROWSITE_FILES_PATH) + "/data/session.log", cs::session_age}}};
+    crow::compression::policy compression{crow::compression::BROTLI, crow::compression::GZIP};
+    // pages are rendered for every request, so favour cheap levels over the last few percent
+    compression.default_level = 4;
+    compression.levels["application/json"] = 1;
+    app.use_compression(compression);
+    // large pages are compressed off the IO threads so they don't hold up the small requests sharing them
+    app.compression_workers(static_cast<std::uint16_t>(std::max(2u, std::thread::hardware_concurrency() / 2)));
     app.loglevel(crow::LogLevel::WARNING);
     
     BLT_INFO("Creating static context");
@@ -62,37 +68,39 @@ int main(int argc, const char** argv)
     BLT_INFO("Starting cache engine");
     
     cs::CacheSettings settings;
-    cs::CacheEngine engine(static_context, settings);
+    cs::StaticCache staticCache;
+    cs::CacheEngine engine(static_context, staticCache, settings);
     
     cs::posts_init();
     
     BLT_INFO("Creating routes");
     
+    cs::establishStaticRoutes(app, staticCache);
     cs::establishHomeRoutes(app, engine);
     
-    CROW_ROUTE(app, "/projects/<path>")(
+    CROW_ROUTE(app, "/projects/<path>").blocking()(
             [&engine, &app](const crow::request& req, const std::string& path) {
                 CS_SESSION;
                 
                 return toResponse(
-                        cs::handleProjectPage({req.raw_url, s_clientID, s_clientToken, path, cs::toQueryString(req.url_params.getValues()), engine}));
+                        cs::handleProjectPage({req.raw_url, s_clientID, s_clientToken, path, req.url_params, engine}));
             }
     );
     
-    CROW_ROUTE(app, "/projects/")(
+    CROW_ROUTE(app, "/projects/").blocking()(
             [&engine, &app](const crow::request& req) {
                 CS_SESSION;
                 
                 return toResponse(
                         cs::handleProjectPage(
-                                {req.raw_url, s_clientID, s_clientToken, "index.html", cs::toQueryString(req.url_params.getValues()), engine}
+                                {req.raw_url, s_clientID, s_clientToken, "index.html", req.url_params, engine}
                         ));
             }
     );
     
     CROW_CATCHALL_ROUTE(app)(
             [&engine]() {
-                return engine.fetch("default.html");
+                return *engine.fetch("default.html");
             }
     );
     
@@ -116,6 +124,9 @@ int main(int argc, const char** argv)
     auto port = blt::arg_parse::get_cast<int32_t>(args["port"]);
     BLT_INFO("Starting Crow website on port %d", port);
     
+    // each IO thread accepts its own connections and stays on its own core
+    app.reuse_port();
+    
     if (args.contains("standalone"))
     {
         auto crw = app.port(port).multithreaded().run_async();